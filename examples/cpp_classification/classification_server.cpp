@@ -0,0 +1,305 @@
+#include <caffe/caffe.hpp>
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#endif  // USE_OPENCV
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <iomanip>
+#include <iostream>  // NOLINT(readability/streams)
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef USE_OPENCV
+using namespace caffe;  // NOLINT(build/namespaces)
+using std::string;
+
+/* Pair (label, confidence) representing a prediction. */
+typedef std::pair<string, float> Prediction;
+
+/* Classifies images for many connections at once: the images of all the
+ * clients are batched together by an InferenceEngine, which runs several
+ * copies of the net sharing one set of weights. */
+class ClassificationServer {
+ public:
+  ClassificationServer(const string& model_file,
+                       const string& trained_file,
+                       const string& mean_file,
+                       const string& label_file,
+                       int num_contexts,
+                       int max_batch_size,
+                       int max_latency_us);
+
+  std::vector<Prediction> Classify(const cv::Mat& img, int N = 5);
+
+  /* Serves one client until it hangs up. */
+  void Serve(int fd);
+
+ private:
+  void SetMean(const string& mean_file);
+
+  void Preprocess(const cv::Mat& img, float* input);
+
+ private:
+  shared_ptr<InferenceEngine<float> > engine_;
+  cv::Size input_geometry_;
+  int num_channels_;
+  cv::Mat mean_;
+  std::vector<string> labels_;
+};
+
+ClassificationServer::ClassificationServer(const string& model_file,
+                                           const string& trained_file,
+                                           const string& mean_file,
+                                           const string& label_file,
+                                           int num_contexts,
+                                           int max_batch_size,
+                                           int max_latency_us) {
+#ifdef CPU_ONLY
+  Caffe::set_mode(Caffe::CPU);
+#else
+  Caffe::set_mode(Caffe::GPU);
+#endif
+
+  /* Load the network, once per context. */
+  NetParameter param;
+  ReadNetParamsFromTextFileOrDie(model_file, &param);
+  engine_.reset(new InferenceEngine<float>(param, trained_file,
+      num_contexts, max_batch_size, max_latency_us));
+  const Net<float>& net = *engine_->net();
+
+  CHECK_EQ(net.num_outputs(), 1) << "Network should have exactly one output.";
+
+  Blob<float>* input_layer = net.input_blobs()[0];
+  num_channels_ = input_layer->channels();
+  CHECK(num_channels_ == 3 || num_channels_ == 1)
+    << "Input layer should have 1 or 3 channels.";
+  input_geometry_ = cv::Size(input_layer->width(), input_layer->height());
+
+  /* Load the binaryproto mean file. */
+  SetMean(mean_file);
+
+  /* Load labels. */
+  std::ifstream labels(label_file.c_str());
+  CHECK(labels) << "Unable to open labels file " << label_file;
+  string line;
+  while (std::getline(labels, line))
+    labels_.push_back(string(line));
+
+  CHECK_EQ(labels_.size(), engine_->output_count())
+    << "Number of labels is different from the output layer dimension.";
+}
+
+static bool PairCompare(const std::pair<float, int>& lhs,
+                        const std::pair<float, int>& rhs) {
+  return lhs.first > rhs.first;
+}
+
+/* Return the indices of the top N values of vector v. */
+static std::vector<int> Argmax(const std::vector<float>& v, int N) {
+  std::vector<std::pair<float, int> > pairs;
+  for (size_t i = 0; i < v.size(); ++i)
+    pairs.push_back(std::make_pair(v[i], i));
+  std::partial_sort(pairs.begin(), pairs.begin() + N, pairs.end(), PairCompare);
+
+  std::vector<int> result;
+  for (int i = 0; i < N; ++i)
+    result.push_back(pairs[i].second);
+  return result;
+}
+
+/* Return the top N predictions. Safe to call from any thread. */
+std::vector<Prediction> ClassificationServer::Classify(const cv::Mat& img,
+                                                       int N) {
+  std::vector<float> input(engine_->input_count());
+  Preprocess(img, &input[0]);
+
+  std::vector<float> output;
+  engine_->Infer(&input[0], &output);
+
+  N = std::min<int>(labels_.size(), N);
+  std::vector<int> maxN = Argmax(output, N);
+  std::vector<Prediction> predictions;
+  for (int i = 0; i < N; ++i) {
+    int idx = maxN[i];
+    predictions.push_back(std::make_pair(labels_[idx], output[idx]));
+  }
+
+  return predictions;
+}
+
+/* Load the mean file in binaryproto format. */
+void ClassificationServer::SetMean(const string& mean_file) {
+  BlobProto blob_proto;
+  ReadProtoFromBinaryFileOrDie(mean_file.c_str(), &blob_proto);
+
+  /* Convert from BlobProto to Blob<float> */
+  Blob<float> mean_blob;
+  mean_blob.FromProto(blob_proto);
+  CHECK_EQ(mean_blob.channels(), num_channels_)
+    << "Number of channels of mean file doesn't match input layer.";
+
+  /* The format of the mean file is planar 32-bit float BGR or grayscale. */
+  std::vector<cv::Mat> channels;
+  float* data = mean_blob.mutable_cpu_data();
+  for (int i = 0; i < num_channels_; ++i) {
+    /* Extract an individual channel. */
+    cv::Mat channel(mean_blob.height(), mean_blob.width(), CV_32FC1, data);
+    channels.push_back(channel);
+    data += mean_blob.height() * mean_blob.width();
+  }
+
+  /* Merge the separate channels into a single image. */
+  cv::Mat mean;
+  cv::merge(channels, mean);
+
+  /* Compute the global mean pixel value and create a mean image
+   * filled with this value. */
+  cv::Scalar channel_mean = cv::mean(mean);
+  mean_ = cv::Mat(input_geometry_, mean.type(), channel_mean);
+}
+
+/* Writes the planes of the preprocessed image to input, as the
+ * classification example writes them to the input layer. */
+void ClassificationServer::Preprocess(const cv::Mat& img, float* input) {
+  /* Convert the input image to the input image format of the network. */
+  cv::Mat sample;
+  if (img.channels() == 3 && num_channels_ == 1)
+    cv::cvtColor(img, sample, cv::COLOR_BGR2GRAY);
+  else if (img.channels() == 4 && num_channels_ == 1)
+    cv::cvtColor(img, sample, cv::COLOR_BGRA2GRAY);
+  else if (img.channels() == 4 && num_channels_ == 3)
+    cv::cvtColor(img, sample, cv::COLOR_BGRA2BGR);
+  else if (img.channels() == 1 && num_channels_ == 3)
+    cv::cvtColor(img, sample, cv::COLOR_GRAY2BGR);
+  else
+    sample = img;
+
+  cv::Mat sample_resized;
+  if (sample.size() != input_geometry_)
+    cv::resize(sample, sample_resized, input_geometry_);
+  else
+    sample_resized = sample;
+
+  cv::Mat sample_float;
+  if (num_channels_ == 3)
+    sample_resized.convertTo(sample_float, CV_32FC3);
+  else
+    sample_resized.convertTo(sample_float, CV_32FC1);
+
+  cv::Mat sample_normalized;
+  cv::subtract(sample_float, mean_, sample_normalized);
+
+  std::vector<cv::Mat> input_channels;
+  for (int i = 0; i < num_channels_; ++i) {
+    cv::Mat channel(input_geometry_, CV_32FC1, input);
+    input_channels.push_back(channel);
+    input += input_geometry_.area();
+  }
+  cv::split(sample_normalized, input_channels);
+}
+
+/* Writes all of data to fd, which a socket may take in several writes. */
+static bool WriteAll(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+/* Every line the client sends is an image path, answered by the top 5
+ * predictions, one per line, and an empty line. */
+void ClassificationServer::Serve(int fd) {
+  FILE* in = fdopen(fd, "r");
+  CHECK(in) << "Unable to open the connection";
+  char path[4096];
+  while (fgets(path, sizeof(path), in)) {
+    path[strcspn(path, "\r\n")] = '\0';
+    std::ostringstream reply;
+    cv::Mat img = cv::imread(path, -1);
+    if (img.empty()) {
+      reply << "error: unable to decode image " << path << "\n";
+    } else {
+      std::vector<Prediction> predictions = Classify(img);
+      for (size_t i = 0; i < predictions.size(); ++i) {
+        reply << std::fixed << std::setprecision(4) << predictions[i].second
+              << " - \"" << predictions[i].first << "\"\n";
+      }
+    }
+    reply << "\n";
+    const string answer = reply.str();
+    if (!WriteAll(fd, answer.data(), answer.size()))
+      break;
+  }
+  fclose(in);
+}
+
+int main(int argc, char** argv) {
+  if (argc != 6 && argc != 9) {
+    std::cerr << "Usage: " << argv[0]
+              << " deploy.prototxt network.caffemodel"
+              << " mean.binaryproto labels.txt socket_path"
+              << " [contexts max_batch max_latency_us]" << std::endl;
+    return 1;
+  }
+
+  ::google::InitGoogleLogging(argv[0]);
+
+  string model_file   = argv[1];
+  string trained_file = argv[2];
+  string mean_file    = argv[3];
+  string label_file   = argv[4];
+  string socket_path  = argv[5];
+  int num_contexts    = argc == 9 ? atoi(argv[6]) : 2;
+  int max_batch_size  = argc == 9 ? atoi(argv[7]) : 8;
+  int max_latency_us  = argc == 9 ? atoi(argv[8]) : 2000;
+  ClassificationServer server(model_file, trained_file, mean_file,
+                              label_file, num_contexts, max_batch_size,
+                              max_latency_us);
+
+  /* Listen on a local socket, one thread per connection. */
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  CHECK_GE(listener, 0) << "Unable to create the socket";
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  CHECK_LT(socket_path.size(), sizeof(address.sun_path))
+    << "Socket path too long: " << socket_path;
+  strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+  unlink(socket_path.c_str());
+  CHECK_EQ(bind(listener, reinterpret_cast<struct sockaddr*>(&address),
+                sizeof(address)), 0) << "Unable to bind " << socket_path;
+  CHECK_EQ(listen(listener, 64), 0) << "Unable to listen on " << socket_path;
+  LOG(INFO) << "Serving on " << socket_path;
+  for (;;) {
+    int fd = accept(listener, NULL, NULL);
+    if (fd < 0) {
+      LOG(ERROR) << "accept failed: " << strerror(errno);
+      continue;
+    }
+    boost::thread(&ClassificationServer::Serve, &server, fd).detach();
+  }
+}
+#else
+int main(int argc, char** argv) {
+  LOG(FATAL) << "This example requires OpenCV; compile with USE_OPENCV.";
+}
+#endif  // USE_OPENCV
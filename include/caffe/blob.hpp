@@ -217,7 +217,12 @@ class Blob {
   }
 
   const Dtype* cpu_data() const;
+  /**
+   * @brief Points the data to memory of count() elements the blob does not
+   *        own, as last written on the host, or on the device.
+   */
   void set_cpu_data(Dtype* data);
+  void set_gpu_data(Dtype* data);
   const int* gpu_shape() const;
   const Dtype* gpu_data() const;
   const Dtype* cpu_diff() const;
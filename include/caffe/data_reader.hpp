@@ -7,9 +7,16 @@
 
 #include "caffe/common.hpp"
 #include "caffe/internal_thread.hpp"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/blocking_queue.hpp"
 #include "caffe/util/db.hpp"
 
+/**
+ Forward declare boost::mutex instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class mutex; }
+
 namespace caffe {
 
 /**
@@ -19,16 +26,38 @@ namespace caffe {
  * databases are read sequentially, and that each solver accesses a different
  * subset of the database. Data is distributed to solvers in a round-robin
  * way to keep parallel training deterministic.
+ *
+ * With DataParameter.reader_threads above one, the reading thread splits the
+ * keys into as many contiguous ranges, each read and parsed by a Shard with
+ * its own cursor, and only hands the Datum out. The throughput of every
+ * shard is logged once a minute.
+ *
+ * From LMDB, whose pages stay mapped for as long as the read transaction of
+ * a cursor is open, the pixels are decoded in place, see Item.
  */
 class DataReader {
  public:
   explicit DataReader(const LayerParameter& param);
   ~DataReader();
 
-  inline BlockingQueue<Datum*>& free() const {
+  /**
+   * @brief A Datum as read from the source. If the cursor values stay in
+   * place, the uint8 pixels of a Datum that is not encoded are not copied
+   * out of the DB: data points to the size of them, valid for as long as
+   * the reader lives, and datum.data() is empty. Otherwise data is NULL.
+   */
+  struct Item {
+    Item() : data(NULL), size(0) { }
+
+    Datum datum;
+    const char* data;
+    size_t size;
+  };
+
+  inline BlockingQueue<Item*>& free() const {
     return queue_pair_->free_;
   }
-  inline BlockingQueue<Datum*>& full() const {
+  inline BlockingQueue<Item*>& full() const {
     return queue_pair_->full_;
   }
 
@@ -39,12 +68,37 @@ class DataReader {
     explicit QueuePair(int size);
     ~QueuePair();
 
-    BlockingQueue<Datum*> free_;
-    BlockingQueue<Datum*> full_;
+    BlockingQueue<Item*> free_;
+    BlockingQueue<Item*> full_;
 
   DISABLE_COPY_AND_ASSIGN(QueuePair);
   };
 
+  // Reads a range of size keys from start on, over and over
+  class Shard : public InternalThread {
+   public:
+    Shard(db::Cursor* cursor, const string& start, int size,
+        const shared_ptr<QueuePair>& qp,
+        const shared_ptr<boost::mutex>& stats_mutex);
+    virtual ~Shard();
+
+   protected:
+    void InternalThreadEntry();
+
+    shared_ptr<db::Cursor> cursor_;
+    const string start_;
+    const int size_;
+    shared_ptr<QueuePair> qp_;
+    // the Datum parsed and the time it took, since the last log
+    shared_ptr<boost::mutex> stats_mutex_;
+    int read_;
+    double busy_us_;
+
+    friend class DataReader;
+
+  DISABLE_COPY_AND_ASSIGN(Shard);
+  };
+
   // A single body is created per source
   class Body : public InternalThread {
    public:
@@ -54,9 +108,19 @@ class DataReader {
    protected:
     void InternalThreadEntry();
     void read_one(db::Cursor* cursor, QueuePair* qp);
+    // Splits the keys of db between num_shards shards and starts them.
+    void StartShards(db::DB* db, int num_shards);
+    void LogThroughput();
 
     const LayerParameter param_;
     BlockingQueue<shared_ptr<QueuePair> > new_queue_pairs_;
+    vector<shared_ptr<Shard> > shards_;
+    // one queue per shard, or one for all of them when out of order
+    vector<shared_ptr<QueuePair> > shard_queues_;
+    int next_queue_;
+    shared_ptr<boost::mutex> stats_mutex_;
+    int read_;
+    boost::posix_time::ptime log_start_;
 
     friend class DataReader;
 
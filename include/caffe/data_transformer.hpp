@@ -37,6 +37,21 @@ class DataTransformer {
    */
   void Transform(const Datum& datum, Blob<Dtype>* transformed_blob);
 
+  /**
+   * @brief Applies the transformation defined in the data layer's
+   * transform_param block to a Datum whose uint8 pixels are kept apart,
+   * as a DataReader::Item read in place holds them.
+   *
+   * @param datum
+   *    Datum describing the data to be transformed.
+   * @param data
+   *    The uint8 pixels of the datum, or NULL to take them from datum.
+   * @param transformed_blob
+   *    This is destination blob, see Transform(const Datum&, Blob*).
+   */
+  void Transform(const Datum& datum, const char* data,
+                 Blob<Dtype>* transformed_blob);
+
   /**
    * @brief Applies the transformation defined in the data layer's
    * transform_param block to a vector of Datum.
@@ -84,6 +99,27 @@ class DataTransformer {
    * */
   bool TransformImg(const cv::Mat& cv_img, Blob<Dtype>* transformed_blob);
   void TransformLabel(const cv::Mat& cv_label, Blob<Dtype>* transformed_blob, bool do_mirror);
+
+  /**
+   * @brief Applies one random geometric mapping (crop, mirror, zoom and
+   *    rotation, see TransformationParameter) to an image and its dense
+   *    label in a single pass over the output pixels.
+   *
+   * @param cv_img
+   *    8 bit image. Like TransformImg, it only has the mean_value
+   *    subtracted; scale and mean_file do not apply.
+   * @param cv_label
+   *    float label. It may differ in size from the image, it is then
+   *    mapped onto the image with its borders aligned.
+   * @param transformed_img
+   *    The image destination; its height and width select the output size.
+   * @param transformed_label
+   *    The label destination, of the same height and width. Points mapped
+   *    from outside the label are set to 0; the image is interpolated
+   *    bilinearly, the label takes the nearest point.
+   */
+  void TransformImgAndLabel(const cv::Mat& cv_img, const cv::Mat& cv_label,
+      Blob<Dtype>* transformed_img, Blob<Dtype>* transformed_label);
 #endif  // USE_OPENCV
 
   /**
@@ -146,8 +182,17 @@ class DataTransformer {
    *    A uniformly random integer value from ({0, 1, ..., n-1}).
    */
   virtual int Rand(int n);
+  /// Generates a random float from Uniform([a, b]).
+  float RandUniform(float a, float b);
 
-  void Transform(const Datum& datum, Dtype* transformed_data);
+  /**
+   * Transforms a Datum into transformed_data. uint8 pixels go through
+   * loops specialized for the mean and mirror of the datum, unless generic
+   * asks for the loop handling every case per pixel, which float_data
+   * always takes and which is kept as the reference of the fast paths.
+   */
+  void Transform(const Datum& datum, const char* data,
+                 Dtype* transformed_data, bool generic = false);
   // Tranformation parameters
   TransformationParameter param_;
 
@@ -0,0 +1,97 @@
+#ifndef CAFFE_INFERENCE_ENGINE_HPP_
+#define CAFFE_INFERENCE_ENGINE_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Serves the forward pass of one model to many client threads.
+ *
+ * A Net can run a single Forward at a time. The engine builds a number of
+ * forward contexts, each a TEST phase Net running in its own thread, that
+ * share the weights of the first one through ShareTrainedLayersWith. Infer
+ * may be called from any thread: the samples queue up, and the next free
+ * context takes up to max_batch_size of them as one batch, waiting at most
+ * max_latency_us after the oldest arrived for the batch to fill up.
+ *
+ * The net must have a single input, whose first axis is the batch. Each
+ * sample gets the concatenation of its slices of every net output.
+ */
+template <typename Dtype>
+class InferenceEngine {
+ public:
+  InferenceEngine(const NetParameter& param, const string& trained_file,
+      int num_contexts, int max_batch_size, int max_latency_us);
+  ~InferenceEngine();
+
+  /**
+   * @brief Runs one sample of input_count() values and fills output with
+   *        output_count() values. Blocks until done, thread safe.
+   */
+  void Infer(const Dtype* input, vector<Dtype>* output);
+
+  inline int input_count() const { return input_count_; }
+  inline int output_count() const { return output_count_; }
+  inline int num_contexts() const { return contexts_.size(); }
+  /// @brief the net of the first context, owning the shared weights
+  inline const shared_ptr<Net<Dtype> >& net() const {
+    return contexts_[0]->net_;
+  }
+  /// @brief the number of batches and samples run so far
+  size_t batches() const;
+  size_t samples() const;
+
+ protected:
+  struct Request;
+
+  // A forward context: one net and the thread running its batches
+  class Context : public InternalThread {
+   public:
+    Context(InferenceEngine* engine, const NetParameter& param);
+    virtual ~Context();
+
+   protected:
+    void InternalThreadEntry();
+    void Forward(const vector<Request*>& batch);
+
+    InferenceEngine* engine_;
+    shared_ptr<Net<Dtype> > net_;
+    int batch_size_;
+
+    friend class InferenceEngine;
+
+  DISABLE_COPY_AND_ASSIGN(Context);
+  };
+
+  // Blocks until a batch is ready, see the class comment.
+  void NextBatch(vector<Request*>* batch);
+  void Done(const vector<Request*>& batch);
+
+  const int max_batch_size_;
+  const int max_latency_us_;
+  int input_count_;
+  int output_count_;
+  vector<shared_ptr<Context> > contexts_;
+
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX, as in BlockingQueue.
+   */
+  class sync;
+  shared_ptr<sync> sync_;
+  size_t batches_;
+  size_t samples_;
+
+DISABLE_COPY_AND_ASSIGN(InferenceEngine);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_INFERENCE_ENGINE_HPP_
@@ -10,6 +10,7 @@
 #include "caffe/layer_factory.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/workspace.hpp"
 
 /**
  Forward declare boost::thread instead of including boost/thread.hpp
@@ -116,6 +117,14 @@ class Layer {
     is_shared_ = is_shared;
   }
 
+  /**
+   * @brief Gives the layer the scratch Workspace of its net, to set before
+   *        SetUp. Layers outside of a net keep their own buffers.
+   */
+  inline void set_workspace(const shared_ptr<Workspace>& workspace) {
+    workspace_ = workspace;
+  }
+
   /**
    * @brief Adjust the shapes of top blobs and internal buffers to accommodate
    *        the shapes of the bottom blobs.
@@ -294,6 +303,22 @@ class Layer {
     return true;
   }
 
+  /**
+   * @brief Returns an estimate of the floating point operations of one
+   *        Forward with the current shapes, used for profiling.
+   *
+   * Defaults to one operation per top value, which suits the element-wise
+   * layers. Layers dominated by products of matrices should override it.
+   */
+  virtual inline double ForwardFlops(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) const {
+    double flops = 0;
+    for (int i = 0; i < top.size(); ++i) {
+      flops += top[i]->count();
+    }
+    return flops;
+  }
+
   /**
    * @brief Specifies whether the layer should compute gradients w.r.t. a
    *        parameter at a particular index given by param_id.
@@ -326,6 +351,8 @@ class Layer {
   vector<shared_ptr<Blob<Dtype> > > blobs_;
   /** Vector indicating whether to compute the diff of each param blob. */
   vector<bool> param_propagate_down_;
+  /** The scratch memory shared by the layers of the net, if any. */
+  shared_ptr<Workspace> workspace_;
 
   /** The vector that indicates whether each top blob has a non-zero weight in
    *  the objective function. */
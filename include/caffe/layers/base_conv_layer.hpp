@@ -27,6 +27,12 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   virtual inline int MinBottomBlobs() const { return 1; }
   virtual inline int MinTopBlobs() const { return 1; }
   virtual inline bool EqualNumBottomTopBlobs() const { return true; }
+  // a multiply and an add per weight, output position and image
+  virtual inline double ForwardFlops(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) const {
+    return 2.0 * bottom.size() * num_ * conv_out_channels_ *
+        conv_out_spatial_dim_ * kernel_dim_;
+  }
 
  protected:
   // Helper functions that abstract away the column buffer and gemm arguments.
@@ -61,6 +67,14 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   virtual bool reverse_dimensions() = 0;
   // Compute height_out_ and width_out_ from other parameters.
   virtual void compute_output_shape() = 0;
+  /**
+   * @brief The scratch memory Reshape reserves in the net workspace: the
+   *        column buffer, unless the convolution is 1x1. Layers that do
+   *        without the columns return what they use instead; the workspace
+   *        still grows on the first fetch of the columns, if they fall
+   *        back to them.
+   */
+  virtual size_t ColumnBufferBytes();
 
   /// @brief The spatial dimensions of a filter kernel.
   Blob<int> kernel_shape_;
@@ -94,6 +108,11 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   bool force_nd_im2col_;
 
  private:
+  // the column buffer, in the net workspace when the layer has one
+  Dtype* col_buffer_cpu();
+#ifndef CPU_ONLY
+  Dtype* col_buffer_gpu();
+#endif
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
   inline void conv_im2col_cpu(const Dtype* data, Dtype* col_buff) {
     if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
@@ -51,6 +51,15 @@ class Batch {
   Blob<Dtype> data_, label_;
 };
 
+/**
+ * @brief Loads batches in a thread, ahead of the Forward calls.
+ *
+ * DataParameter.prefetch batches are kept, for every prefetching layer.
+ * The tops take the memory of the batch instead of a copy, and hold it
+ * until the next Forward, which gives the batch back to the thread. A layer
+ * shared between solvers copies the batch instead, as its tops outlive the
+ * call.
+ */
 template <typename Dtype>
 class BasePrefetchingDataLayer :
     public BaseDataLayer<Dtype>, public InternalThread {
@@ -67,16 +76,33 @@ class BasePrefetchingDataLayer :
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
-  // Prefetches batches (asynchronously if to GPU memory)
-  static const int PREFETCH_COUNT = 3;
+  /// @brief What the Forward calls found in the prefetch queue.
+  struct PrefetchStats {
+    PrefetchStats() : batches(0), empty(0), ready(0), wait_ms(0) {}
+    int batches;
+    /// the calls that had to wait for the thread: the input is the bottleneck
+    int empty;
+    /// the sum of the batches ready at each call
+    int ready;
+    double wait_ms;
+  };
+  inline const PrefetchStats& prefetch_stats() const {
+    return prefetch_stats_;
+  }
 
  protected:
   virtual void InternalThreadEntry();
   virtual void load_batch(Batch<Dtype>* batch) = 0;
+  // Gives the batch of the last call back to the thread and waits for the
+  // next one, keeping the statistics.
+  Batch<Dtype>* NextBatch();
 
-  Batch<Dtype> prefetch_[PREFETCH_COUNT];
+  vector<shared_ptr<Batch<Dtype> > > prefetch_;
   BlockingQueue<Batch<Dtype>*> prefetch_free_;
   BlockingQueue<Batch<Dtype>*> prefetch_full_;
+  // the batch the tops hold
+  Batch<Dtype>* prefetch_current_;
+  PrefetchStats prefetch_stats_;
 
   Blob<Dtype> transformed_data_;
   // new add
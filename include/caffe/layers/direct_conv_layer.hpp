@@ -0,0 +1,62 @@
+#ifndef CAFFE_DIRECT_CONV_LAYER_HPP_
+#define CAFFE_DIRECT_CONV_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief CPU implementation of ConvolutionLayer that does without the
+ *        im2col column buffer, selected with engine: DIRECT.
+ *
+ * A 2D convolution with stride 1 is computed as one GEMM per filter tap.
+ * The input is copied once, zero padded, and each tap multiplies the
+ * padded planes, shifted by the tap offset, by that tap's
+ * num_output x channels slice of the filters, accumulating into a padded
+ * output. The two padded buffers are about the size of the input and the
+ * output, where the column buffer is kernel size times the output.
+ * 1x1 convolutions are already a GEMM on the input; every other shape, the
+ * backward pass and the GPU use ConvolutionLayer.
+ */
+template <typename Dtype>
+class DirectConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit DirectConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+ protected:
+  // the padded buffers, in place of the columns
+  virtual size_t ColumnBufferBytes();
+  // the sizes of the padded buffers for the current input shape
+  void padded_counts(int* input_count, int* output_count);
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  // convolves one image
+  void forward_cpu_direct(const Dtype* input, const Dtype* bias,
+      Dtype* output);
+
+  bool use_direct_;
+  int kernel_h_, kernel_w_;
+  int dilation_h_, dilation_w_;
+  int pad_h_, pad_w_;
+  int height_, width_;
+  int padded_height_, padded_width_;
+  Blob<Dtype> padded_input_;
+  Blob<Dtype> padded_output_;
+  /// @brief the filters regrouped as taps x num_output x (channels / group)
+  Blob<Dtype> tap_weights_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_DIRECT_CONV_LAYER_HPP_
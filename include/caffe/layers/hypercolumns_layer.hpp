@@ -21,9 +21,7 @@ template <typename Dtype>
 class HyperColumnsLayer: public Layer<Dtype> {
 public:
     explicit HyperColumnsLayer(const LayerParameter& param) :
-        Layer<Dtype>(param) { cuda_instanced_ = false;}
-
-    virtual ~HyperColumnsLayer();
+        Layer<Dtype>(param) {}
 
     virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
                            const vector<Blob<Dtype>*>& top);
@@ -60,15 +58,52 @@ protected:
     int total_channels_; // the channels_ of the hypercolumns
     vector<int> width_, height_;
     vector<int> scalef_;
-    vector<Dtype> padf_;
     vector<int> channels_; // store the channels for every bottom
-
-    // for the use of gpu, I declare some elements here to avoid the multi-declare and save time
-    int* cuda_samplelist_;
-    bool cuda_instanced_;
+    vector<int> channel_offset_; // the first hypercolumn channel of every bottom
+
+    // the bilinear sampling tables, built in Reshape since they only depend on
+    // the bottom shapes. for bottom b, row_index_ holds the H_ upper then the H_
+    // lower row offsets (already multiplied by the bottom width) and col_index_
+    // the W_ left then the W_ right columns. the weights are those of the
+    // lower row / right column, zero when the point needs no interpolation
+    Blob<int> row_index_, col_index_;
+    Blob<Dtype> row_weight_, col_weight_;
+    // the selected points, copied here to be read by the gpu kernels
+    Blob<int> sample_list_;
+    // whether the cpu forward gathers from channels last copies of the bottoms
+    bool channels_last_;
+    vector<shared_ptr<Blob<Dtype> > > transposed_;
+    // training sampler state: the valid pixels of every image, the per pixel
+    // count of invalid channels they are found with, and the generator
+    vector<vector<int> > valid_points_;
+    vector<int> invalid_count_;
+    shared_ptr<Caffe::RNG> rng_;
 
 private:
     void generate_list(const Blob<Dtype>* feature_map); // generate random list
+    // collects valid_points_ for the images [begin, end)
+    void find_valid_points(int begin, int end, const Dtype* feature_data);
+
+    // the interpolation tables, fetched before the workers run since they
+    // must not touch the synced memory
+    struct Interpolation {
+        const int* row_index;
+        const int* col_index;
+        const Dtype* row_weight;
+        const Dtype* col_weight;
+    };
+    Interpolation cpu_interpolation();
+
+    // cpu workers run by the thread pool. forward splits the sampled points,
+    // backward splits the (num, channel) slices of the bottoms so that every
+    // bottom diff element is owned by exactly one worker
+    void forward_cpu_points(int begin, int end,
+                            const vector<const Dtype*>& bottom_data,
+                            const Interpolation& interp,
+                            Dtype* top_hypercolumns, Dtype* top_normal);
+    void backward_cpu_slices(int begin, int end, const Dtype* top_diff,
+                             const vector<Dtype*>& bottom_diff,
+                             const Interpolation& interp);
     
 };// end of HyperColumnsLayer
 }// namespace caffe
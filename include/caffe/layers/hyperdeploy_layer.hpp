@@ -42,17 +42,16 @@ protected:
                               const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
     // Note the gpu version is to implement. make sure the cpu version work first
 
-    vector<int> selected_points_; // the selected point
     int N_, K_, H_, W_; // the N, K, H, W of normal map
     int sample_num_; // sample_num per batch
     int total_channels_; // the channels_ of the hypercolumns
 
-    
-private:
-    void get_map_point(std::map<int, double>& result, int out_index,
-                       const vector<int>& original_size); // generate the correponding map point    
-
-    void generate_list(vector<int>& result, const Blob<Dtype>* feature_map, int batch); // generate random list
+    // the bilinear sampling tables of every bottom, built in Reshape. for
+    // bottom b, row_index_ holds the H_ upper then the H_ lower row offsets
+    // (already multiplied by the bottom width) and col_index_ the W_ left then
+    // the W_ right columns, the weights belong to the lower row / right column
+    Blob<int> row_index_, col_index_;
+    Blob<Dtype> row_weight_, col_weight_;
 
 };//end of class
 }//namespace caffe
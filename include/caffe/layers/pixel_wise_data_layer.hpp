@@ -15,6 +15,13 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/thread_pool.hpp"
+
+/**
+ Forward declare boost::mutex instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class mutex; }
 
 namespace caffe {
 /**
@@ -35,12 +42,40 @@ public:
     virtual inline int ExactNumBottomBlobs() const { return 0; }
     virtual inline int ExactNumTopBlobs() const { return 2; }
 
+    // how long the batches prefetched so far took. read and transform sum
+    // the time of every decode worker, so they can exceed the batch time
+    struct PrefetchTimes {
+        int batches;
+        double batch_ms, read_ms, transform_ms;
+    };
+    PrefetchTimes prefetch_times() const;
+
 protected:
     shared_ptr<Caffe::RNG> prefetch_rgn_;
     virtual void ShuffleImages();
     virtual void load_batch(Batch<Dtype>* batch);
+    // decodes and transforms the share of the batch items of the workers
+    // [begin, end), every worker writing through its own transformer into
+    // prefetch_data and prefetch_label, fetched from batch beforehand
+    void decode_items(int begin, int end, Batch<Dtype>* batch,
+        Dtype* prefetch_data, Dtype* prefetch_label);
     vector<std::pair<std::string, std::string> > lines_; // store the image and label path
     int lines_id_;
+
+    // the shapes of one item, inferred once unless variable_size is set
+    vector<int> top_shape_, top_label_shape_;
+    // whether the outputs have one size and go through TransformImgAndLabel
+    bool joint_transform_;
+    // per decode worker state. worker 0 uses the layer's data_transformer_
+    shared_ptr<ThreadPool> decode_pool_;
+    vector<shared_ptr<DataTransformer<Dtype> > > transformers_;
+    vector<shared_ptr<Blob<Dtype> > > worker_data_, worker_label_;
+    vector<double> worker_read_us_, worker_trans_us_;
+    // the lines of the batch being loaded, picked before decoding starts
+    vector<std::pair<std::string, std::string> > batch_lines_;
+
+    shared_ptr<boost::mutex> times_mutex_;
+    PrefetchTimes times_;
 };
 
 }// namespace caffe
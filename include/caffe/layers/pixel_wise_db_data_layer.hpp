@@ -0,0 +1,47 @@
+#ifndef CAFFE_PIXEL_WISE_DB_DATA_LAYER_HPP_
+#define CAFFE_PIXEL_WISE_DB_DATA_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/data_reader.hpp"
+#include "caffe/data_transformer.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/layers/base_data_layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Reads image and dense label pairs packed into a LMDB or LevelDB by
+ *        tools/convert_pixelwise_imageset, through a DataReader.
+ *
+ * data_param gives the source, backend and batch size. Of
+ * pixel_wise_data_param, the resizing, is_color and label_channel fields
+ * are used as by the PixelWiseDataLayer.
+ */
+template <typename Dtype>
+class PixelWiseDBDataLayer : public BasePrefetchingDataLayer<Dtype> {
+ public:
+  explicit PixelWiseDBDataLayer(const LayerParameter& param);
+  virtual ~PixelWiseDBDataLayer();
+  virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  // PixelWiseDBDataLayer uses DataReader instead for sharing for parallelism
+  virtual inline bool ShareInParallel() const { return false; }
+  virtual inline const char* type() const { return "PixelWiseDBData"; }
+  virtual inline int ExactNumBottomBlobs() const { return 0; }
+  virtual inline int ExactNumTopBlobs() const { return 2; }
+
+ protected:
+  virtual void load_batch(Batch<Dtype>* batch);
+  // the shapes of one item, given the image size stored in the datum
+  void InferShapes(const Datum& datum, vector<int>* top_shape,
+      vector<int>* top_label_shape);
+
+  DataReader reader_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_PIXEL_WISE_DB_DATA_LAYER_HPP_
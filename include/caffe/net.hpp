@@ -11,9 +11,46 @@
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/benchmark.hpp"
 
 namespace caffe {
 
+/**
+ * @brief What a Net records of one layer while profiling, summed over the
+ *        calls since the last reset.
+ */
+struct LayerProfile {
+  LayerProfile()
+      : forward_calls(0), backward_calls(0), forward_ms(0), backward_ms(0),
+        forward_flops(0), malloc_bytes(0), to_gpu_copies(0), to_gpu_bytes(0),
+        to_cpu_copies(0), to_cpu_bytes(0) {}
+  int forward_calls;
+  int backward_calls;
+  double forward_ms;
+  double backward_ms;
+  /// estimate for one Forward with the last shapes, see Layer::ForwardFlops
+  double forward_flops;
+  /// host and device memory allocated by the blobs during the calls
+  size_t malloc_bytes;
+  /// host <-> device copies of the blobs during the calls
+  size_t to_gpu_copies;
+  size_t to_gpu_bytes;
+  size_t to_cpu_copies;
+  size_t to_cpu_bytes;
+};
+
+/// @brief The host <-> device copies of one blob in the calls of one layer.
+struct BlobTransfers {
+  string layer;
+  /// the blob name, or the layer name and param index, "diff" suffixed for
+  /// the diff; "(internal)" for the own buffers of the layer
+  string blob;
+  bool to_gpu;
+  size_t copies;
+  size_t bytes;
+};
+
 /**
  * @brief Connects Layer%s together into a directed acyclic graph (DAG)
  *        specified by a NetParameter.
@@ -116,8 +153,12 @@ class Net {
   void CopyTrainedLayersFromHDF5(const string trained_filename);
   /// @brief Writes the net to a proto.
   void ToProto(NetParameter* param, bool write_diff = false) const;
-  /// @brief Writes the net to an HDF5 file.
-  void ToHDF5(const string& filename, bool write_diff = false) const;
+  /**
+   * @brief Writes the net to an HDF5 file, deflating its datasets at
+   *        compression_level if positive.
+   */
+  void ToHDF5(const string& filename, bool write_diff = false,
+      int compression_level = 0) const;
 
   /// @brief returns the network name.
   inline const string& name() const { return name_; }
@@ -187,6 +228,14 @@ class Net {
   inline const vector<bool>& has_params_decay() const {
     return has_params_decay_;
   }
+  /**
+   * @brief Returns a blob holding the data and diff of all the learnable
+   *        params back to back, in the order of learnable_params(), when the
+   *        net was built with flat_params, in CPU mode and while every param
+   *        still lives there, with its head on the host; NULL otherwise.
+   *        Checking leaves the params as they are.
+   */
+  Blob<Dtype>* flat_cpu_params();
   const map<string, int>& param_names_index() const {
     return param_names_index_;
   }
@@ -215,6 +264,43 @@ class Net {
   const shared_ptr<Layer<Dtype> > layer_by_name(const string& layer_name) const;
 
   void set_debug_info(const bool value) { debug_info_ = value; }
+  /// @brief returns the bytes of the buffers shared under plan_memory
+  inline size_t planned_memory() const { return planned_memory_; }
+  /**
+   * @brief Turns the profiling of every layer Forward and Backward on or
+   *        off. The GPU is synchronized after each layer while on.
+   */
+  void set_profile(const bool value);
+  inline bool profile() const { return profile_; }
+  /// @brief Clears the layer profiles and the trace.
+  void ResetProfile();
+  /// @brief returns the profile of each layer since the last reset
+  inline const vector<LayerProfile>& layer_profiles() const {
+    return layer_profiles_;
+  }
+  /// @brief Logs the layer profiles as a table.
+  void LogProfile() const;
+  /**
+   * @brief Writes every profiled layer call as a Chrome trace, to load in
+   *        chrome://tracing.
+   */
+  void WriteChromeTrace(const string& filename) const;
+  /**
+   * @brief Sets what to do on a copy to the host inside a layer on the GPU,
+   *        see NetParameter.sync_check.
+   */
+  void set_sync_check(const NetParameter_SyncCheck value);
+  inline NetParameter_SyncCheck sync_check() const { return sync_check_; }
+  /// @brief Turns the recording of the blob copies on or off.
+  void set_trace_transfers(const bool value);
+  inline bool trace_transfers() const { return trace_transfers_; }
+  /// @brief returns the recorded blob copies, by layer and blob
+  inline const vector<BlobTransfers>& transfers() const { return transfers_; }
+  inline void ClearTransfers() { transfers_.clear(); }
+  /// @brief Logs the recorded blob copies.
+  void LogTransfers() const;
+  /// @brief returns the scratch memory shared by the layers
+  inline const shared_ptr<Workspace>& workspace() const { return workspace_; }
 
   // Helpers for Init.
   /**
@@ -241,12 +327,22 @@ class Net {
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
 
+  /// @brief Lets the blobs with disjoint lifetimes share memory.
+  void PlanMemory();
+  /// @brief Moves the learnable params into flat_params_.
+  void FlattenParams();
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Backward.
   void BackwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Update.
   void UpdateDebugInfo(const int param_id);
+  /// @brief Helpers for profiling a layer call.
+  void ProfileStart();
+  void ProfileStop(const int layer_id, const bool backward);
+  /// @brief Helpers for attributing the blob copies to a layer call.
+  void TransfersStart(const int layer_id);
+  void TransfersStop(const int layer_id);
 
   /// @brief The network name
   string name_;
@@ -301,10 +397,37 @@ class Net {
   /// the weight decay multipliers for learnable_params_
   vector<float> params_weight_decay_;
   vector<bool> has_params_decay_;
+  /// The data and diff of learnable_params_ under flat_params
+  shared_ptr<Blob<Dtype> > flat_params_;
   /// The bytes of memory used by this net
   size_t memory_used_;
+  /// The buffers shared by the blobs under plan_memory
+  vector<shared_ptr<SyncedMemory> > memory_arena_;
+  size_t planned_memory_;
+  /// The scratch memory shared by the layers, like the convolution columns
+  shared_ptr<Workspace> workspace_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
+  /// Whether to profile the layers, and what was recorded.
+  bool profile_;
+  vector<LayerProfile> layer_profiles_;
+  struct TraceEvent {
+    int layer_id;
+    bool backward;
+    double start_us;
+    double duration_us;
+  };
+  vector<TraceEvent> trace_;
+  shared_ptr<Timer> profile_timer_;
+  boost::posix_time::ptime profile_epoch_;
+  double profile_start_us_;
+  SyncedMemoryStats profile_stats_;
+  /// What to do on the blob copies, and what was recorded.
+  NetParameter_SyncCheck sync_check_;
+  bool trace_transfers_;
+  bool watch_transfers_;
+  vector<SyncedMemoryTransfer> layer_transfers_;
+  vector<BlobTransfers> transfers_;
   /// The root net that actually holds the shared layers in data parallelism
   const Net* const root_net_;
   DISABLE_COPY_AND_ASSIGN(Net);
@@ -59,6 +59,25 @@ class GPUParams : public Params<Dtype> {
   using Params<Dtype>::diff_;
 };
 
+// Params stored in host memory. The weights are those of the root, read in
+// place by every solver, while each solver has a gradient of its own.
+template<typename Dtype>
+class CPUParams : public Params<Dtype> {
+ public:
+  CPUParams(shared_ptr<Solver<Dtype> > root_solver, Dtype* root_data);
+  virtual ~CPUParams();
+
+  void configure(Solver<Dtype>* solver) const;
+
+ protected:
+  const bool own_data_;
+  bool use_cuda_;
+
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+};
+
 class DevicePair {
  public:
   DevicePair(int parent, int device)
@@ -116,6 +135,51 @@ class P2PSync : public GPUParams<Dtype>, public Solver<Dtype>::Callback,
   using Params<Dtype>::diff_;
 };
 
+// Synchronous data parallelism between the threads of a host. Every solver
+// runs its own net on its own batches, on the weights of the root. Once all
+// the gradients are ready the root sums them slice by slice on the thread
+// pool, each slice staying in cache while the gradients of every solver are
+// added to it, and updates the weights while the others wait to start the
+// next iteration. Layers writing their own parameters in the forward pass,
+// as the running averages of BatchNorm, would race between the solvers.
+template<typename Dtype>
+class CPUSync : public CPUParams<Dtype>, public Solver<Dtype>::Callback,
+    public InternalThread {
+ public:
+  CPUSync(shared_ptr<Solver<Dtype> > root_solver, CPUSync<Dtype>* root,
+          const SolverParameter& param, int rank);
+  virtual ~CPUSync();
+
+  inline const shared_ptr<Solver<Dtype> >& solver() const {
+    return solver_;
+  }
+
+  // Trains with num_solvers solvers, the calling thread running the root.
+  // Caffe::solver_count() must be set to it before the root solver is
+  // created, for the data layers to hand each solver its own batches.
+  void Run(int num_solvers);
+  inline const int initial_iter() const { return initial_iter_; }
+
+ protected:
+  void on_start();
+  void on_gradients_ready();
+
+  void InternalThreadEntry();
+  // Sums the gradients of the solvers over [begin, end) into the root's.
+  void Reduce(int begin, int end);
+
+  CPUSync<Dtype>* root_;
+  const int rank_;
+  vector<shared_ptr<CPUSync<Dtype> > > solvers_;
+  BlockingQueue<CPUSync<Dtype>*> queue_;
+  const int initial_iter_;
+  shared_ptr<Solver<Dtype> > solver_;
+
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+};
+
 }  // namespace caffe
 
 #endif
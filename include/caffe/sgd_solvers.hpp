@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "caffe/solver.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -36,6 +37,16 @@ class SGDSolver : public Solver<Dtype> {
   virtual void SnapshotSolverStateToHDF5(const string& model_filename);
   virtual void RestoreSolverStateFromHDF5(const string& state_file);
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file);
+  /**
+   * Whether ComputeUpdateValue adds the L2 weight decay itself on CPU, in
+   * the same pass over the parameter as the update, instead of Regularize.
+   */
+  virtual inline bool FusesWeightDecay() const { return false; }
+  /// The L2 decay a fused CPU update adds for param_id, zero if none.
+  Dtype FusedWeightDecay(int param_id) const;
+  /// Runs a fused elementwise CPU update over count elements, in chunks on
+  /// the global thread pool once the parameter is large enough.
+  static void ParallelUpdate(int count, const ThreadPool::RangeFunction& fn);
   // history maintains the historical momentum data.
   // update maintains update related data and is not needed in snapshots.
   // temp maintains other information that might be needed in computation
@@ -71,6 +82,7 @@ class AdaGradSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual inline bool FusesWeightDecay() const { return true; }
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with AdaGrad.";
@@ -91,6 +103,7 @@ class RMSPropSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual inline bool FusesWeightDecay() const { return true; }
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with RMSProp.";
@@ -115,6 +128,7 @@ class AdaDeltaSolver : public SGDSolver<Dtype> {
  protected:
   void AdaDeltaPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual inline bool FusesWeightDecay() const { return true; }
 
   DISABLE_COPY_AND_ASSIGN(AdaDeltaSolver);
 };
@@ -139,6 +153,7 @@ class AdamSolver : public SGDSolver<Dtype> {
  protected:
   void AdamPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual inline bool FusesWeightDecay() const { return true; }
 
   DISABLE_COPY_AND_ASSIGN(AdamSolver);
 };
@@ -9,6 +9,8 @@
 
 namespace caffe {
 
+class SnapshotWriter;
+
 /**
   * @brief Enumeration of actions that a client of the Solver may request by
   * implementing the Solver's action request function, which a
@@ -100,6 +102,12 @@ class Solver {
   string SnapshotFilename(const string extension);
   string SnapshotToBinaryProto();
   string SnapshotToHDF5();
+  /**
+   * Writes a snapshot file, or stages it for the background writer under
+   * async_snapshots. The solver must not touch proto afterwards.
+   */
+  void WriteSnapshot(shared_ptr<google::protobuf::Message> proto,
+      const string& filename);
   // The test routine
   void TestAll();
   void Test(const int test_net_id = 0);
@@ -129,6 +137,9 @@ class Solver {
   // True iff a request to stop early was received.
   bool requested_early_exit_;
 
+  // Writes the snapshots in the background under async_snapshots.
+  shared_ptr<SnapshotWriter> snapshot_writer_;
+
   DISABLE_COPY_AND_ASSIGN(Solver);
 };
 
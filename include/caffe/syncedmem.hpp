@@ -2,8 +2,12 @@
 #define CAFFE_SYNCEDMEM_HPP_
 
 #include <cstdlib>
+#include <string>
+#include <vector>
 
 #include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/memory_pool.hpp"
 
 namespace caffe {
 
@@ -12,30 +16,51 @@ namespace caffe {
 // The improvement in performance seems negligible in the single GPU case,
 // but might be more significant for parallel training. Most importantly,
 // it improved stability for large models on many GPUs.
+// The blocks come from the host MemoryPool and go back to it, for reuse.
 inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda) {
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
-    CUDA_CHECK(cudaMallocHost(ptr, size));
+    *ptr = MemoryPool::Host(true).Allocate(size);
     *use_cuda = true;
     return;
   }
 #endif
-  *ptr = malloc(size);
+  *ptr = MemoryPool::Host(false).Allocate(size);
   *use_cuda = false;
-  CHECK(*ptr) << "host allocation of size " << size << " failed";
 }
 
 inline void CaffeFreeHost(void* ptr, bool use_cuda) {
-#ifndef CPU_ONLY
-  if (use_cuda) {
-    CUDA_CHECK(cudaFreeHost(ptr));
-    return;
-  }
-#endif
-  free(ptr);
+  MemoryPool::Host(use_cuda).Free(ptr);
 }
 
 
+/**
+ * @brief Counts of the memory allocated and copied between host and device
+ *        by SyncedMemory, kept per thread.
+ */
+struct SyncedMemoryStats {
+  SyncedMemoryStats()
+      : cpu_malloc_bytes(0), gpu_malloc_bytes(0), to_gpu_copies(0),
+        to_gpu_bytes(0), to_cpu_copies(0), to_cpu_bytes(0) {}
+  size_t cpu_malloc_bytes;
+  size_t gpu_malloc_bytes;
+  size_t to_gpu_copies;
+  size_t to_gpu_bytes;
+  size_t to_cpu_copies;
+  size_t to_cpu_bytes;
+};
+
+class SyncedMemory;
+
+/// @brief One host <-> device copy of a SyncedMemory.
+struct SyncedMemoryTransfer {
+  const SyncedMemory* memory;
+  /// the layer that made it, or NULL outside of the layer calls of a Net
+  const string* layer;
+  bool to_gpu;
+  size_t bytes;
+};
+
 /**
  * @brief Manages memory allocation and synchronization between the host (CPU)
  *        and device (GPU).
@@ -67,9 +92,25 @@ class SyncedMemory {
   void async_gpu_push(const cudaStream_t& stream);
 #endif
 
+  /// @brief The counters of the calling thread, from its start.
+  static SyncedMemoryStats& thread_stats();
+  /// @brief The counters of all the threads, from the start of the process.
+  static SyncedMemoryStats global_stats();
+  /**
+   * @brief Attributes the following copies of the calling thread to a layer,
+   *        until called again. Each copy is appended to trace if not NULL,
+   *        and the copies to the host are handled as sync_check says.
+   */
+  static void set_transfer_context(const string* layer,
+      vector<SyncedMemoryTransfer>* trace,
+      NetParameter_SyncCheck sync_check);
+
  private:
   void to_cpu();
   void to_gpu();
+  // Count and check a copy, or an allocation.
+  void CountTransfer(bool to_gpu);
+  void CountMalloc(bool gpu);
   void* cpu_ptr_;
   void* gpu_ptr_;
   size_t size_;
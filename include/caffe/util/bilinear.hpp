@@ -0,0 +1,18 @@
+#ifndef CAFFE_UTIL_BILINEAR_HPP_
+#define CAFFE_UTIL_BILINEAR_HPP_
+
+namespace caffe {
+
+// Fills the bilinear sampling table of one axis for the hypercolumn layers.
+// Pixel i of an original axis of `length` pixels is mapped onto a feature
+// map axis of `bottom_length` pixels that was downsampled by `scale`, with
+// pixel centers aligned and clamped at the borders. lo[i] and hi[i] are the
+// two neighbouring feature map coordinates and weight[i] the weight of
+// hi[i]; a zero weight means the point falls onto lo[i] and hi[i] == lo[i].
+template <typename Dtype>
+void bilinear_axis_table(const int length, const int bottom_length,
+    const int scale, int* lo, int* hi, Dtype* weight);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_BILINEAR_HPP_
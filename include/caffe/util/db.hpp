@@ -16,8 +16,14 @@ class Cursor {
   virtual ~Cursor() { }
   virtual void SeekToFirst() = 0;
   virtual void Next() = 0;
+  // Moves to the first key at or after key.
+  virtual void Seek(const string& key) = 0;
   virtual string key() = 0;
   virtual string value() = 0;
+  // Points to the value in place, without a copy, until the cursor moves.
+  virtual void value(const char** data, size_t* size) = 0;
+  // Whether the values stay in place for as long as the cursor lives.
+  virtual bool values_pinned() { return false; }
   virtual bool valid() = 0;
 
   DISABLE_COPY_AND_ASSIGN(Cursor);
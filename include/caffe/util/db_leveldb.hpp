@@ -18,8 +18,13 @@ class LevelDBCursor : public Cursor {
   ~LevelDBCursor() { delete iter_; }
   virtual void SeekToFirst() { iter_->SeekToFirst(); }
   virtual void Next() { iter_->Next(); }
+  virtual void Seek(const string& key) { iter_->Seek(key); }
   virtual string key() { return iter_->key().ToString(); }
   virtual string value() { return iter_->value().ToString(); }
+  virtual void value(const char** data, size_t* size) {
+    *data = iter_->value().data();
+    *size = iter_->value().size();
+  }
   virtual bool valid() { return iter_->Valid(); }
 
  private:
@@ -20,10 +20,12 @@ void hdf5_load_nd_dataset(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
     Blob<Dtype>* blob);
 
+// A positive compression_level (at most 9) writes a chunked dataset with the
+// shuffle and deflate filters, which hdf5_load_nd_dataset reads back as is.
 template <typename Dtype>
 void hdf5_save_nd_dataset(
     const hid_t file_id, const string& dataset_name, const Blob<Dtype>& blob,
-    bool write_diff = false);
+    bool write_diff = false, int compression_level = 0);
 
 int hdf5_load_int(hid_t loc_id, const string& dataset_name);
 void hdf5_save_int(hid_t loc_id, const string& dataset_name, int i);
@@ -90,6 +90,17 @@ inline void WriteProtoToBinaryFile(
   WriteProtoToBinaryFile(proto, filename.c_str());
 }
 
+/**
+ * @brief Writes proto to filename through a temporary file next to it that
+ *        is synced to disk and renamed over filename, so that a crash leaves
+ *        either the previous file or the complete new one.
+ */
+void WriteProtoToBinaryFileAtomic(const Message& proto,
+    const string& filename);
+
+/// @brief Syncs temp_filename to disk and renames it to filename.
+void RenameFileDurably(const string& temp_filename, const string& filename);
+
 bool ReadFileToDatum(const string& filename, const int label, Datum* datum);
 
 inline bool ReadFileToDatum(const string& filename, Datum* datum) {
@@ -129,6 +140,30 @@ inline bool ReadImageToDatum(const string& filename, const int label,
 bool DecodeDatumNative(Datum* datum);
 bool DecodeDatum(Datum* datum, bool is_color);
 
+/**
+ * Parses a serialized Datum but leaves its uint8 pixels where they are in
+ * buffer: *data points to the *data_size of them and datum->data() stays
+ * empty. An encoded Datum, or one without pixels, is parsed whole and *data
+ * is NULL.
+ */
+bool ParseDatumInPlace(const char* buffer, size_t size, Datum* datum,
+    const char** data, size_t* data_size);
+
+/**
+ * Reorders a label stored as matlab writes it, channel planes of column
+ * major rows x cols matrices, into rows x cols x channels interleaved order.
+ */
+void LabelToInterleaved(const float* src, const int rows, const int cols,
+    const int channels, float* dst);
+
+/**
+ * Reads a raw float label file of rows x cols x channels values through a
+ * memory mapping into dst, interleaved as LabelToInterleaved leaves it.
+ * Returns false if the file cannot be read or its size does not match.
+ */
+bool ReadLabelToBuffer(const string& filename, const int rows,
+    const int cols, const int channels, float* dst);
+
 #ifdef USE_OPENCV
 cv::Mat ReadLabelToCVMat(const string& filename,
     const int rows, const int cols, const int height,
@@ -153,6 +188,26 @@ cv::Mat DecodeDatumToCVMatNative(const Datum& datum);
 cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color);
 
 void CVMatToDatum(const cv::Mat& cv_img, Datum* datum);
+
+/**
+ * Packs an image and its dense float label into one Datum: the image is
+ * kept encoded in data (re-encoded as `encoding`, png if unset, when it is
+ * resized or converted), channels/height/width describe the image and
+ * float_data holds the label resized alike, as height x width x
+ * label_channel interleaved floats.
+ */
+bool ReadPixelWiseToDatum(const string& image_filename,
+    const string& label_filename, const int label_channel,
+    const int height, const int width, const bool is_color,
+    const string& encoding, Datum* datum);
+
+/**
+ * Unpacks a Datum written by ReadPixelWiseToDatum. The label Mat views
+ * the float_data of the datum without copying it, so it is only valid as
+ * long as the datum is left untouched.
+ */
+bool DecodePixelWiseDatum(const Datum& datum, const int label_channel,
+    const bool is_color, cv::Mat* cv_img, cv::Mat* cv_label);
 #endif  // USE_OPENCV
 
 }  // namespace caffe
@@ -0,0 +1,38 @@
+#ifndef CAFFE_UTIL_MAPPED_FILE_HPP_
+#define CAFFE_UTIL_MAPPED_FILE_HPP_
+
+#include <string>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A read-only memory mapping of a whole file.
+ *
+ * data() views the file contents without copying them; the pages are read
+ * in by the kernel as they are touched. The view is valid until Close() or
+ * the destruction of the object.
+ */
+class MappedFile {
+ public:
+  MappedFile() : data_(NULL), size_(0) {}
+  ~MappedFile() { Close(); }
+
+  /// Maps filename, returns false and logs if it cannot be opened.
+  bool Open(const string& filename);
+  void Close();
+
+  inline const char* data() const { return data_; }
+  inline size_t size() const { return size_; }
+
+ private:
+  char* data_;
+  size_t size_;
+
+DISABLE_COPY_AND_ASSIGN(MappedFile);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_MAPPED_FILE_HPP_
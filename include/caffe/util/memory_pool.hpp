@@ -0,0 +1,99 @@
+#ifndef CAFFE_UTIL_MEMORY_POOL_HPP_
+#define CAFFE_UTIL_MEMORY_POOL_HPP_
+
+#include <map>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/// @brief What a MemoryPool did since its start, in blocks and bytes.
+struct MemoryPoolStats {
+  MemoryPoolStats()
+      : hits(0), misses(0), releases(0), requested_bytes(0),
+        allocated_bytes(0), cached_bytes(0), peak_bytes(0) {}
+  /// allocations served from the cache, and from the system
+  size_t hits;
+  size_t misses;
+  /// cached blocks returned to the system, by Release or on failure
+  size_t releases;
+  /// the bytes asked for by the blocks in use, and the bytes they span
+  size_t requested_bytes;
+  size_t allocated_bytes;
+  /// the bytes of the free blocks kept for reuse
+  size_t cached_bytes;
+  /// the most bytes ever held from the system, in use and cached
+  size_t peak_bytes;
+  /// the share of the blocks in use lost to the rounding to size classes
+  inline double fragmentation() const {
+    return allocated_bytes ?
+        1. - static_cast<double>(requested_bytes) / allocated_bytes : 0.;
+  }
+};
+
+/**
+ * @brief A caching allocator by size classes.
+ *
+ * Sizes are rounded up to a class, a power of two or one of the three
+ * quarters between two powers of two, which bounds the waste to a quarter
+ * of a block. Freed blocks are kept by class and handed out again to the
+ * next allocation of the class, so the memory of a net that reshapes every
+ * batch is recycled instead of going back and forth to the system. When the
+ * system is out of memory, the cached blocks are released and the
+ * allocation retried. Thread safe.
+ *
+ * SyncedMemory takes its host memory from the pools of Host and its device
+ * memory from the pools of Device.
+ */
+class MemoryPool {
+ public:
+  // The system allocator: Allocate returns NULL on failure.
+  typedef void* (*AllocateFunction)(size_t size);
+  typedef void (*FreeFunction)(void* ptr);
+
+  MemoryPool(AllocateFunction allocate, FreeFunction free);
+  ~MemoryPool();
+
+  /// @brief Returns a block of at least size bytes; fatal on failure.
+  void* Allocate(size_t size);
+  /// @brief Takes back a block of Allocate, to cache it.
+  void Free(void* ptr);
+  /// @brief Returns the cached blocks to the system.
+  void Release();
+  MemoryPoolStats stats() const;
+
+  /// @brief The size of the blocks serving size bytes.
+  static size_t SizeClass(size_t size);
+
+  /// @brief The pool of the host memory, pinned by CUDA or not.
+  static MemoryPool& Host(bool pinned);
+  /// @brief The pool of the memory of a GPU, to use with the GPU current.
+  static MemoryPool& Device(int device);
+  /// @brief Releases the cached blocks of all the pools.
+  static void ReleaseAll();
+
+ protected:
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+   */
+  class sync;
+
+  // Called with the lock held.
+  void ReleaseCached();
+
+  AllocateFunction allocate_;
+  FreeFunction free_;
+  shared_ptr<sync> sync_;
+  // the free blocks by class, and the requested size of the blocks in use
+  std::map<size_t, vector<void*> > cached_;
+  std::map<void*, size_t> in_use_;
+  MemoryPoolStats stats_;
+
+DISABLE_COPY_AND_ASSIGN(MemoryPool);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_MEMORY_POOL_HPP_
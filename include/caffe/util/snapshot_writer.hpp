@@ -0,0 +1,61 @@
+#ifndef CAFFE_UTIL_SNAPSHOT_WRITER_HPP_
+#define CAFFE_UTIL_SNAPSHOT_WRITER_HPP_
+
+#include <google/protobuf/message.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/util/blocking_queue.hpp"
+
+namespace caffe {
+
+using ::google::protobuf::Message;
+
+/**
+ * @brief Writes the files of solver snapshots on a background thread, so
+ *        that training goes on while they are serialized and saved.
+ *
+ * A snapshot is staged between Begin and Commit as protos, copies that the
+ * solver no longer touches, and its files are written in the order they
+ * were added, each durably and atomically: a crash leaves either the
+ * previous version of a file or the complete new one. At most
+ * max_in_flight snapshots are staged or being written at once; Begin waits
+ * for the oldest one to be written beyond that.
+ */
+class SnapshotWriter : public InternalThread {
+ public:
+  explicit SnapshotWriter(int max_in_flight);
+  virtual ~SnapshotWriter();
+
+  /// Starts staging a snapshot, waiting while too many are in flight.
+  void Begin();
+  /// Stages proto to be written to filename, taking ownership of it.
+  void Add(shared_ptr<Message> proto, const string& filename);
+  /// Hands the staged snapshot to the background thread.
+  void Commit();
+  /// Waits for all the committed snapshots to be written.
+  void Flush();
+
+  inline int max_in_flight() const { return max_in_flight_; }
+
+  typedef vector<pair<shared_ptr<Message>, string> > Snapshot;
+
+ protected:
+  virtual void InternalThreadEntry();
+
+  const int max_in_flight_;
+  BlockingQueue<Snapshot*> free_;
+  BlockingQueue<Snapshot*> full_;
+  vector<shared_ptr<Snapshot> > snapshots_;
+  Snapshot* staged_;
+
+DISABLE_COPY_AND_ASSIGN(SnapshotWriter);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SNAPSHOT_WRITER_HPP_
@@ -0,0 +1,75 @@
+#ifndef CAFFE_UTIL_THREAD_POOL_HPP_
+#define CAFFE_UTIL_THREAD_POOL_HPP_
+
+#include <boost/function.hpp>
+
+#include <vector>
+
+#include "caffe/common.hpp"
+
+/**
+ Forward declare boost::thread instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class thread; }
+
+namespace caffe {
+
+/**
+ * @brief A fixed set of worker threads for data-parallel CPU loops.
+ *
+ * Work is described as a range [0, n) which is cut into contiguous chunks,
+ * each handed to the functor as fn(begin, end). The calling thread executes
+ * chunks as well, so a pool of one thread spawns nothing and ParallelFor
+ * reduces to fn(0, n). ParallelFor may be called from several threads at
+ * once and from inside a running chunk: a waiting caller keeps draining the
+ * queue instead of sleeping, so nested loops cannot deadlock.
+ *
+ * Chunks run on threads without Caffe's thread local state, so they must
+ * not draw from Caffe's RNG or touch SyncedMemory heads; fetch the
+ * cpu_data()/mutable_cpu_data() pointers before calling ParallelFor.
+ */
+class ThreadPool {
+ public:
+  typedef boost::function<void(int, int)> RangeFunction;
+
+  explicit ThreadPool(int num_threads);
+  ~ThreadPool();
+
+  /// Number of threads that run chunks, the calling thread included.
+  inline int num_threads() const { return num_threads_; }
+
+  /**
+   * Runs fn over [0, n) split into at most num_chunks contiguous pieces
+   * (one per thread when num_chunks <= 0) and returns once all of them
+   * have finished. Chunk boundaries only depend on n and num_chunks.
+   */
+  void ParallelFor(int n, const RangeFunction& fn, int num_chunks = 0);
+
+  /// The process-wide pool shared by the CPU implementations.
+  static ThreadPool& Global();
+  /**
+   * Resizes the global pool; defaults to the hardware concurrency. Call it
+   * before any network runs, never while the global pool is in use.
+   */
+  static void SetGlobalThreads(int num_threads);
+
+ protected:
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+   */
+  class sync;
+
+  void WorkerEntry();
+
+  int num_threads_;
+  vector<shared_ptr<boost::thread> > threads_;
+  shared_ptr<sync> sync_;
+
+DISABLE_COPY_AND_ASSIGN(ThreadPool);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_THREAD_POOL_HPP_
@@ -0,0 +1,50 @@
+#ifndef CAFFE_WORKSPACE_HPP_
+#define CAFFE_WORKSPACE_HPP_
+
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Scratch memory shared by the layers of a Net.
+ *
+ * The layers of a net run one at a time, so the buffers they only need
+ * within a single Forward or Backward call (like the convolution column
+ * buffers) can all live in one allocation, as large as the largest of them.
+ * Layers Reserve their size when reshaping and fetch the pointer on every
+ * call, as a larger reservation replaces the memory. Its content is not
+ * kept from one call to the next.
+ */
+class Workspace {
+ public:
+  Workspace() : size_(0) {}
+
+  /// @brief Makes sure the next fetches are at least size bytes.
+  void Reserve(size_t size) {
+    if (size > size_) {
+      // allocated on the first fetch
+      memory_.reset(new SyncedMemory(size));
+      size_ = size;
+    }
+  }
+  void* mutable_cpu_data(size_t size) {
+    Reserve(size);
+    return memory_->mutable_cpu_data();
+  }
+  void* mutable_gpu_data(size_t size) {
+    Reserve(size);
+    return memory_->mutable_gpu_data();
+  }
+  size_t size() const { return size_; }
+
+ private:
+  shared_ptr<SyncedMemory> memory_;
+  size_t size_;
+
+  DISABLE_COPY_AND_ASSIGN(Workspace);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_WORKSPACE_HPP_
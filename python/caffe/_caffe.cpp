@@ -114,6 +114,15 @@ void Net_Save(const Net<Dtype>& net, string filename) {
   WriteProtoToBinaryFile(net_param, filename.c_str());
 }
 
+// The layer profiles, copied to a list
+bp::list Net_LayerProfiles(const Net<Dtype>& net) {
+  bp::list profiles;
+  for (int i = 0; i < net.layer_profiles().size(); ++i) {
+    profiles.append(net.layer_profiles()[i]);
+  }
+  return profiles;
+}
+
 void Net_SetInputArrays(Net<Dtype>* net, bp::object data_obj,
     bp::object labels_obj) {
   // check that this network has an input MemoryDataLayer
@@ -267,9 +276,25 @@ BOOST_PYTHON_MODULE(_caffe) {
         bp::return_value_policy<bp::copy_const_reference>()))
     .def("_set_input_arrays", &Net_SetInputArrays,
         bp::with_custodian_and_ward<1, 2, bp::with_custodian_and_ward<1, 3> >())
+    .add_property("profile", &Net<Dtype>::profile, &Net<Dtype>::set_profile)
+    .def("reset_profile", &Net<Dtype>::ResetProfile)
+    .add_property("_layer_profiles", &Net_LayerProfiles)
+    .def("write_chrome_trace", &Net<Dtype>::WriteChromeTrace)
     .def("save", &Net_Save);
   BP_REGISTER_SHARED_PTR_TO_PYTHON(Net<Dtype>);
 
+  bp::class_<LayerProfile>("LayerProfile", bp::no_init)
+    .def_readonly("forward_calls", &LayerProfile::forward_calls)
+    .def_readonly("backward_calls", &LayerProfile::backward_calls)
+    .def_readonly("forward_ms", &LayerProfile::forward_ms)
+    .def_readonly("backward_ms", &LayerProfile::backward_ms)
+    .def_readonly("forward_flops", &LayerProfile::forward_flops)
+    .def_readonly("malloc_bytes", &LayerProfile::malloc_bytes)
+    .def_readonly("to_gpu_copies", &LayerProfile::to_gpu_copies)
+    .def_readonly("to_gpu_bytes", &LayerProfile::to_gpu_bytes)
+    .def_readonly("to_cpu_copies", &LayerProfile::to_cpu_copies)
+    .def_readonly("to_cpu_bytes", &LayerProfile::to_cpu_bytes);
+
   bp::class_<Blob<Dtype>, shared_ptr<Blob<Dtype> >, boost::noncopyable>(
     "Blob", bp::no_init)
     .add_property("shape",
@@ -75,6 +75,15 @@ def _Net_outputs(self):
     return self._output_list
 
 
+@property
+def _Net_layer_profiles(self):
+    """
+    An OrderedDict (bottom to top, i.e., input to output) of the layer
+    profiles recorded while net.profile is on, indexed by layer name
+    """
+    return OrderedDict(zip(self._layer_names, self._layer_profiles))
+
+
 def _Net_forward(self, blobs=None, start=None, end=None, **kwargs):
     """
     Forward pass: prepare inputs and run the net forward.
@@ -312,6 +321,7 @@ class _Net_IdNameWrapper:
 Net.blobs = _Net_blobs
 Net.blob_loss_weights = _Net_blob_loss_weights
 Net.params = _Net_params
+Net.layer_profiles = _Net_layer_profiles
 Net.forward = _Net_forward
 Net.backward = _Net_backward
 Net.forward_all = _Net_forward_all
@@ -63,6 +63,26 @@ class TestNet(unittest.TestCase):
         self.net.forward()
         self.net.backward()
 
+    def test_profile(self):
+        self.net.profile = True
+        self.net.forward()
+        self.net.backward()
+        profiles = self.net.layer_profiles
+        self.assertEqual(list(profiles.keys()), list(self.net._layer_names))
+        self.assertEqual(profiles['conv'].forward_calls, 1)
+        self.assertEqual(profiles['conv'].backward_calls, 1)
+        # 5 images x 11 outputs x 8 x 9 positions x 2 channels x 2 x 2 taps
+        self.assertEqual(profiles['conv'].forward_flops,
+                         2 * 5 * 11 * 8 * 9 * 2 * 2 * 2)
+        f = tempfile.NamedTemporaryFile(mode='w+', delete=False)
+        f.close()
+        self.net.write_chrome_trace(f.name)
+        with open(f.name) as trace:
+            self.assertIn('"cat":"backward"', trace.read())
+        os.remove(f.name)
+        self.net.reset_profile()
+        self.assertEqual(self.net.layer_profiles['conv'].forward_calls, 0)
+
     def test_inputs_outputs(self):
         self.assertEqual(self.net.inputs, [])
         self.assertEqual(self.net.outputs, ['loss'])
@@ -1,4 +1,5 @@
 #include <boost/thread.hpp>
+#include <algorithm>
 #include <map>
 #include <string>
 #include <vector>
@@ -7,6 +8,7 @@
 #include "caffe/data_reader.hpp"
 #include "caffe/layers/data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/io.hpp"
 
 namespace caffe {
 
@@ -44,17 +46,33 @@ DataReader::~DataReader() {
 DataReader::QueuePair::QueuePair(int size) {
   // Initialize the free queue with requested number of datums
   for (int i = 0; i < size; ++i) {
-    free_.push(new Datum());
+    free_.push(new Item());
   }
 }
 
 DataReader::QueuePair::~QueuePair() {
-  Datum* datum;
-  while (free_.try_pop(&datum)) {
-    delete datum;
+  Item* item;
+  while (free_.try_pop(&item)) {
+    delete item;
   }
-  while (full_.try_pop(&datum)) {
-    delete datum;
+  while (full_.try_pop(&item)) {
+    delete item;
+  }
+}
+
+// Parses the value at the cursor, without copying it out of the DB
+static void ReadItem(db::Cursor* cursor, DataReader::Item* item) {
+  const char* value;
+  size_t size;
+  cursor->value(&value, &size);
+  if (cursor->values_pinned()) {
+    CHECK(ParseDatumInPlace(value, size, &item->datum, &item->data,
+        &item->size)) << "Could not parse the Datum of " << cursor->key();
+  } else {
+    item->data = NULL;
+    item->size = 0;
+    CHECK(item->datum.ParseFromArray(value, size))
+        << "Could not parse the Datum of " << cursor->key();
   }
 }
 
@@ -62,7 +80,10 @@ DataReader::QueuePair::~QueuePair() {
 
 DataReader::Body::Body(const LayerParameter& param)
     : param_(param),
-      new_queue_pairs_() {
+      new_queue_pairs_(),
+      next_queue_(0),
+      stats_mutex_(new boost::mutex()),
+      read_(0) {
   StartInternalThread();
 }
 
@@ -76,6 +97,10 @@ void DataReader::Body::InternalThreadEntry() {
   shared_ptr<db::Cursor> cursor(db->NewCursor());
   vector<shared_ptr<QueuePair> > qps;
   try {
+    if (param_.data_param().reader_threads() > 1) {
+      StartShards(db.get(), param_.data_param().reader_threads());
+    }
+    log_start_ = boost::posix_time::microsec_clock::local_time();
     int solver_count = param_.phase() == TRAIN ? Caffe::solver_count() : 1;
 
     // To ensure deterministic runs, only start running once all solvers
@@ -100,19 +125,133 @@ void DataReader::Body::InternalThreadEntry() {
   } catch (boost::thread_interrupted&) {
     // Interrupted exception is expected on shutdown
   }
+  // the shards read from db
+  shards_.clear();
 }
 
 void DataReader::Body::read_one(db::Cursor* cursor, QueuePair* qp) {
-  Datum* datum = qp->free_.pop();
-  // TODO deserialize in-place instead of copy?
-  datum->ParseFromString(cursor->value());
-  qp->full_.push(datum);
-
-  // go to the next iter
-  cursor->Next();
-  if (!cursor->valid()) {
-    DLOG(INFO) << "Restarting data prefetching from start.";
-    cursor->SeekToFirst();
+  Item* item = qp->free_.pop();
+  if (shards_.size()) {
+    QueuePair* shard_qp = shard_queues_[next_queue_].get();
+    next_queue_ = (next_queue_ + 1) % shard_queues_.size();
+    // hand the parsed Datum over without a copy
+    Item* parsed = shard_qp->full_.pop();
+    item->datum.Swap(&parsed->datum);
+    std::swap(item->data, parsed->data);
+    std::swap(item->size, parsed->size);
+    shard_qp->free_.push(parsed);
+  } else {
+    ReadItem(cursor, item);
+  }
+  qp->full_.push(item);
+
+  if (shards_.empty()) {
+    // go to the next iter
+    cursor->Next();
+    if (!cursor->valid()) {
+      DLOG(INFO) << "Restarting data prefetching from start.";
+      cursor->SeekToFirst();
+    }
+  }
+  const int kLogSeconds = 60;
+  if (++read_ % 1000 == 0 && (boost::posix_time::microsec_clock::local_time()
+      - log_start_).total_seconds() >= kLogSeconds) {
+    LogThroughput();
+  }
+}
+
+void DataReader::Body::StartShards(db::DB* db, int num_shards) {
+  shared_ptr<db::Cursor> cursor(db->NewCursor());
+  int count = 0;
+  for (cursor->SeekToFirst(); cursor->valid(); cursor->Next()) {
+    ++count;
+  }
+  CHECK_GT(count, 0) << "No data in " << param_.data_param().source();
+  num_shards = std::min(num_shards, count);
+  const bool keep_order = param_.data_param().keep_order();
+  const int queue_size = param_.data_param().prefetch() *
+      param_.data_param().batch_size();
+  if (!keep_order) {
+    shard_queues_.push_back(shared_ptr<QueuePair>(new QueuePair(queue_size)));
+  }
+  cursor->SeekToFirst();
+  int position = 0;
+  for (int i = 0; i < num_shards; ++i) {
+    const int start = static_cast<int64_t>(count) * i / num_shards;
+    const int end = static_cast<int64_t>(count) * (i + 1) / num_shards;
+    for (; position < start; ++position) {
+      cursor->Next();
+    }
+    if (keep_order) {
+      shard_queues_.push_back(shared_ptr<QueuePair>(
+          new QueuePair(std::max(queue_size / num_shards, 1))));
+    }
+    // the cursors are made here, as the DB does not make them concurrently
+    shards_.push_back(shared_ptr<Shard>(new Shard(db->NewCursor(),
+        cursor->key(), end - start, shard_queues_.back(), stats_mutex_)));
+  }
+  LOG(INFO) << "Reading " << count << " Datum of "
+      << param_.data_param().source() << " with " << num_shards
+      << " threads" << (keep_order ? "" : ", out of order");
+}
+
+void DataReader::Body::LogThroughput() {
+  const double seconds = (boost::posix_time::microsec_clock::local_time() -
+      log_start_).total_microseconds() / 1e6;
+  LOG(INFO) << "Read " << read_ / seconds << " Datum/s from "
+      << param_.data_param().source();
+  boost::mutex::scoped_lock lock(*stats_mutex_);
+  for (int i = 0; i < shards_.size(); ++i) {
+    Shard* shard = shards_[i].get();
+    LOG(INFO) << "    shard " << i << ": " << shard->read_ / seconds
+        << " Datum/s, busy " << 100 * shard->busy_us_ / 1e6 / seconds
+        << "% of the time";
+    shard->read_ = 0;
+    shard->busy_us_ = 0;
+  }
+  read_ = 0;
+  log_start_ = boost::posix_time::microsec_clock::local_time();
+}
+
+//
+
+DataReader::Shard::Shard(db::Cursor* cursor, const string& start, int size,
+    const shared_ptr<QueuePair>& qp,
+    const shared_ptr<boost::mutex>& stats_mutex)
+    : cursor_(cursor), start_(start), size_(size), qp_(qp),
+      stats_mutex_(stats_mutex), read_(0), busy_us_(0) {
+  StartInternalThread();
+}
+
+DataReader::Shard::~Shard() {
+  StopInternalThread();
+}
+
+void DataReader::Shard::InternalThreadEntry() {
+  try {
+    CPUTimer timer;
+    cursor_->Seek(start_);
+    int position = 0;
+    while (!must_stop()) {
+      Item* item = qp_->free_.pop();
+      timer.Start();
+      ReadItem(cursor_.get(), item);
+      if (++position == size_) {
+        position = 0;
+        cursor_->Seek(start_);
+      } else {
+        cursor_->Next();
+      }
+      const double busy_us = timer.MicroSeconds();
+      {
+        boost::mutex::scoped_lock lock(*stats_mutex_);
+        ++read_;
+        busy_us_ += busy_us;
+      }
+      qp_->full_.push(item);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
   }
 }
 
@@ -2,6 +2,10 @@
 #include <opencv2/core/core.hpp>
 #endif  // USE_OPENCV
 
+#include <boost/random/uniform_real.hpp>
+
+#include <algorithm>
+#include <cmath>
 #include <string>
 #include <vector>
 
@@ -38,10 +42,47 @@ DataTransformer<Dtype>::DataTransformer(const TransformationParameter& param,
   }
 }
 
+// (pixel - mean) * scale along a row of uint8 pixels, written backwards
+// when mirrored. The loops are free of branches so they vectorize.
+template<typename Dtype>
+static void TransformRow(const uint8_t* pixels, const Dtype mean,
+    const Dtype scale, const int width, const bool mirror, Dtype* top) {
+  if (mirror) {
+    Dtype* back = top + width - 1;
+    for (int w = 0; w < width; ++w) {
+      back[-w] = (static_cast<Dtype>(pixels[w]) - mean) * scale;
+    }
+  } else {
+    for (int w = 0; w < width; ++w) {
+      top[w] = (static_cast<Dtype>(pixels[w]) - mean) * scale;
+    }
+  }
+}
+
+// The same with a mean per pixel, as read from a mean file
+template<typename Dtype>
+static void TransformRow(const uint8_t* pixels, const Dtype* mean,
+    const Dtype scale, const int width, const bool mirror, Dtype* top) {
+  if (mirror) {
+    Dtype* back = top + width - 1;
+    for (int w = 0; w < width; ++w) {
+      back[-w] = (static_cast<Dtype>(pixels[w]) - mean[w]) * scale;
+    }
+  } else {
+    for (int w = 0; w < width; ++w) {
+      top[w] = (static_cast<Dtype>(pixels[w]) - mean[w]) * scale;
+    }
+  }
+}
+
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const Datum& datum,
-                                       Dtype* transformed_data) {
-  const string& data = datum.data();
+                                       const char* data,
+                                       Dtype* transformed_data,
+                                       bool generic) {
+  if (!data && datum.data().size() > 0) {
+    data = datum.data().data();
+  }
   const int datum_channels = datum.channels();
   const int datum_height = datum.height();
   const int datum_width = datum.width();
@@ -50,7 +91,7 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   const Dtype scale = param_.scale();
   const bool do_mirror = param_.mirror() && Rand(2);
   const bool has_mean_file = param_.has_mean_file();
-  const bool has_uint8 = data.size() > 0;
+  const bool has_uint8 = data != NULL;
   const bool has_mean_values = mean_values_.size() > 0;
 
   CHECK_GT(datum_channels, 0);
@@ -93,6 +134,28 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
     }
   }
 
+  if (has_uint8 && !generic) {
+    // The usual uint8 pixels go row by row, the choice of mean and mirror
+    // made once per datum instead of once per pixel.
+    const uint8_t* pixels = reinterpret_cast<const uint8_t*>(data);
+    for (int c = 0; c < datum_channels; ++c) {
+      const Dtype mean_value = has_mean_values ? mean_values_[c] : Dtype(0);
+      for (int h = 0; h < height; ++h) {
+        const int data_index =
+            (c * datum_height + h_off + h) * datum_width + w_off;
+        Dtype* top = transformed_data + (c * height + h) * width;
+        if (has_mean_file) {
+          TransformRow(pixels + data_index, mean + data_index, scale, width,
+              do_mirror, top);
+        } else {
+          TransformRow(pixels + data_index, mean_value, scale, width,
+              do_mirror, top);
+        }
+      }
+    }
+    return;
+  }
+
   Dtype datum_element;
   int top_index, data_index;
   for (int c = 0; c < datum_channels; ++c) {
@@ -130,6 +193,12 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const Datum& datum,
                                        Blob<Dtype>* transformed_blob) {
+  Transform(datum, NULL, transformed_blob);
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::Transform(const Datum& datum, const char* data,
+                                       Blob<Dtype>* transformed_blob) {
   // If datum is encoded, decoded and transform the cv::image.
   if (datum.encoded()) {
 #ifdef USE_OPENCV
@@ -178,7 +247,7 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   }
 
   Dtype* transformed_data = transformed_blob->mutable_cpu_data();
-  Transform(datum, transformed_data);
+  Transform(datum, data, transformed_data);
 }
 
 template<typename Dtype>
@@ -422,11 +491,169 @@ void DataTransformer<Dtype>::TransformLabel(const cv::Mat& cv_label, Blob<Dtype>
                     top_index = (c * height + h) * width + w;
                 }
                 Dtype pixel = static_cast<Dtype>(ptr[img_index++]);
+                // a mirrored normal points the other way along x
+                if (do_mirror && c == 0 && param_.normal_label()) {
+                    pixel = -pixel;
+                }
                 transformed_data[top_index] = pixel;
             }
         }
     }
 }
+
+template<typename Dtype>
+void DataTransformer<Dtype>::TransformImgAndLabel(const cv::Mat& cv_img,
+    const cv::Mat& cv_label, Blob<Dtype>* transformed_img,
+    Blob<Dtype>* transformed_label) {
+  const int img_channels = cv_img.channels();
+  const int img_height = cv_img.rows;
+  const int img_width = cv_img.cols;
+  const int label_channels = cv_label.channels();
+  const int label_height = cv_label.rows;
+  const int label_width = cv_label.cols;
+  const int height = transformed_img->height();
+  const int width = transformed_img->width();
+  CHECK_EQ(img_channels, transformed_img->channels());
+  CHECK_EQ(label_channels, transformed_label->channels());
+  CHECK_EQ(height, transformed_label->height());
+  CHECK_EQ(width, transformed_label->width());
+  CHECK_LE(height, img_height);
+  CHECK_LE(width, img_width);
+  CHECK(cv_img.depth() == CV_8U) << "Image data type must be unsigned byte";
+  CHECK(cv_label.depth() == CV_32F) << "Label data type must be float";
+  CHECK(!param_.normal_label() || label_channels >= 2)
+      << "Normal labels need x and y channels";
+
+  // only mean_value applies, as in TransformImg: the pixel-wise layers have
+  // never taken mean_file or scale, whichever path they use
+  vector<Dtype> mean(img_channels, 0);
+  if (mean_values_.size() > 0) {
+    CHECK(mean_values_.size() == 1 || mean_values_.size() == img_channels) <<
+        "Specify either 1 mean_value or as many as channels: " << img_channels;
+    for (int c = 0; c < img_channels; ++c) {
+      mean[c] = mean_values_[mean_values_.size() == 1 ? 0 : c];
+    }
+  }
+
+  // Draw the mapping. Output pixel (h, w), centered as (u, v), comes from
+  // the image point (cx, cy) + A (u, v) with A = R(angle) M / zoom, M the
+  // optional mirroring of u.
+  const bool do_mirror = param_.mirror() && Rand(2);
+  float zoom = 1;
+  float angle = 0;
+  int w_off = (img_width - width) / 2;
+  int h_off = (img_height - height) / 2;
+  if (phase_ == TRAIN) {
+    if (param_.max_zoom() > param_.min_zoom()) {
+      zoom = RandUniform(param_.min_zoom(), param_.max_zoom());
+    } else {
+      zoom = param_.min_zoom();
+    }
+    if (param_.max_rotation() > 0) {
+      angle = RandUniform(-param_.max_rotation(), param_.max_rotation()) *
+          M_PI / 180;
+    }
+    if (img_height > height) {
+      h_off = Rand(img_height - height + 1);
+    }
+    if (img_width > width) {
+      w_off = Rand(img_width - width + 1);
+    }
+  }
+  CHECK_GT(zoom, 0);
+  const float mirror = do_mirror ? -1 : 1;
+  const float a00 = std::cos(angle) / zoom * mirror;
+  const float a01 = -std::sin(angle) / zoom;
+  const float a10 = std::sin(angle) / zoom * mirror;
+  const float a11 = std::cos(angle) / zoom;
+  const float cx = w_off + (width - 1) / 2.f;
+  const float cy = h_off + (height - 1) / 2.f;
+  // normals turn back by the angle, then follow the mirroring
+  const float n00 = std::cos(angle) * mirror;
+  const float n01 = std::sin(angle) * mirror;
+  const float n10 = -std::sin(angle);
+  const float n11 = std::cos(angle);
+  const bool normal = param_.normal_label();
+
+  Dtype* img_data = transformed_img->mutable_cpu_data();
+  Dtype* label_data = transformed_label->mutable_cpu_data();
+  const int spatial = height * width;
+  const bool same_size = label_height == img_height &&
+      label_width == img_width;
+  if (zoom == 1 && angle == 0 && same_size) {
+    // plain crop and mirror: every output pixel is a source pixel
+    for (int h = 0; h < height; ++h) {
+      const uchar* img_row = cv_img.ptr<uchar>(h + h_off);
+      const float* label_row = cv_label.ptr<float>(h + h_off);
+      for (int w = 0; w < width; ++w) {
+        const int x = w_off + (do_mirror ? width - 1 - w : w);
+        const int top_index = h * width + w;
+        const uchar* pixel = img_row + x * img_channels;
+        for (int c = 0; c < img_channels; ++c) {
+          img_data[c * spatial + top_index] = pixel[c] - mean[c];
+        }
+        const float* point = label_row + x * label_channels;
+        for (int c = 0; c < label_channels; ++c) {
+          label_data[c * spatial + top_index] = point[c];
+        }
+        if (normal && do_mirror) {
+          label_data[top_index] = -point[0];
+        }
+      }
+    }
+    return;
+  }
+  const float label_sx = static_cast<float>(label_width) / img_width;
+  const float label_sy = static_cast<float>(label_height) / img_height;
+  for (int h = 0; h < height; ++h) {
+    const float v = h - (height - 1) / 2.f;
+    for (int w = 0; w < width; ++w) {
+      const float u = w - (width - 1) / 2.f;
+      const float x = cx + a00 * u + a01 * v;
+      const float y = cy + a10 * u + a11 * v;
+      const int top_index = h * width + w;
+      // the image, bilinear
+      if (x < 0 || y < 0 || x > img_width - 1 || y > img_height - 1) {
+        for (int c = 0; c < img_channels; ++c) {
+          img_data[c * spatial + top_index] = 0;
+        }
+      } else {
+        const int x0 = static_cast<int>(x);
+        const int y0 = static_cast<int>(y);
+        const int x1 = std::min(x0 + 1, img_width - 1);
+        const int y1 = std::min(y0 + 1, img_height - 1);
+        const float fx = x - x0;
+        const float fy = y - y0;
+        const uchar* p00 = cv_img.ptr<uchar>(y0) + x0 * img_channels;
+        const uchar* p01 = cv_img.ptr<uchar>(y0) + x1 * img_channels;
+        const uchar* p10 = cv_img.ptr<uchar>(y1) + x0 * img_channels;
+        const uchar* p11 = cv_img.ptr<uchar>(y1) + x1 * img_channels;
+        for (int c = 0; c < img_channels; ++c) {
+          const float pixel = (1 - fy) * ((1 - fx) * p00[c] + fx * p01[c]) +
+              fy * ((1 - fx) * p10[c] + fx * p11[c]);
+          img_data[c * spatial + top_index] = pixel - mean[c];
+        }
+      }
+      // the label, nearest
+      const int lx = static_cast<int>(std::floor((x + 0.5f) * label_sx));
+      const int ly = static_cast<int>(std::floor((y + 0.5f) * label_sy));
+      if (lx < 0 || ly < 0 || lx >= label_width || ly >= label_height) {
+        for (int c = 0; c < label_channels; ++c) {
+          label_data[c * spatial + top_index] = 0;
+        }
+        continue;
+      }
+      const float* point = cv_label.ptr<float>(ly) + lx * label_channels;
+      for (int c = 0; c < label_channels; ++c) {
+        label_data[c * spatial + top_index] = point[c];
+      }
+      if (normal) {
+        label_data[top_index] = n00 * point[0] + n01 * point[1];
+        label_data[spatial + top_index] = n10 * point[0] + n11 * point[1];
+      }
+    }
+  }
+}
 #endif  // USE_OPENCV
 
 template<typename Dtype>
@@ -626,7 +853,8 @@ vector<int> DataTransformer<Dtype>::InferBlobShape(
 template <typename Dtype>
 void DataTransformer<Dtype>::InitRand() {
   const bool needs_rand = param_.mirror() ||
-      (phase_ == TRAIN && param_.crop_size());
+      (phase_ == TRAIN && (param_.crop_size() ||
+      param_.max_zoom() > param_.min_zoom() || param_.max_rotation() > 0));
   if (needs_rand) {
     const unsigned int rng_seed = caffe_rng_rand();
     rng_.reset(new Caffe::RNG(rng_seed));
@@ -644,6 +872,16 @@ int DataTransformer<Dtype>::Rand(int n) {
   return ((*rng)() % n);
 }
 
+template <typename Dtype>
+float DataTransformer<Dtype>::RandUniform(float a, float b) {
+  CHECK(rng_);
+  CHECK_LE(a, b);
+  caffe::rng_t* rng =
+      static_cast<caffe::rng_t*>(rng_->generator());
+  boost::uniform_real<float> dist(a, b);
+  return dist(*rng);
+}
+
 INSTANTIATE_CLASS(DataTransformer);
 
 }  // namespace caffe
@@ -0,0 +1,199 @@
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "caffe/inference_engine.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+struct InferenceEngine<Dtype>::Request {
+  const Dtype* input;
+  vector<Dtype>* output;
+  boost::system_time arrival;
+  bool done;
+};
+
+template <typename Dtype>
+class InferenceEngine<Dtype>::sync {
+ public:
+  mutable boost::mutex mutex_;
+  boost::condition_variable queued_;
+  boost::condition_variable done_;
+  std::deque<Request*> queue_;
+};
+
+template <typename Dtype>
+InferenceEngine<Dtype>::InferenceEngine(const NetParameter& param,
+    const string& trained_file, int num_contexts, int max_batch_size,
+    int max_latency_us)
+    : max_batch_size_(max_batch_size), max_latency_us_(max_latency_us),
+      sync_(new sync()), batches_(0), samples_(0) {
+  CHECK_GT(num_contexts, 0);
+  CHECK_GT(max_batch_size, 0);
+  CHECK_GE(max_latency_us, 0);
+  NetParameter test_param(param);
+  test_param.mutable_state()->set_phase(TEST);
+  for (int i = 0; i < num_contexts; ++i) {
+    contexts_.push_back(shared_ptr<Context>(new Context(this, test_param)));
+  }
+  Net<Dtype>* net = contexts_[0]->net_.get();
+  if (!trained_file.empty()) {
+    net->CopyTrainedLayersFrom(trained_file);
+  }
+  for (int i = 1; i < num_contexts; ++i) {
+    contexts_[i]->net_->ShareTrainedLayersWith(net);
+  }
+  CHECK_EQ(net->num_inputs(), 1) << "The net should have exactly one input.";
+  input_count_ = net->input_blobs()[0]->count(1);
+  output_count_ = 0;
+  for (int i = 0; i < net->num_outputs(); ++i) {
+    output_count_ += net->output_blobs()[i]->count(1);
+  }
+  LOG(INFO) << "Inference engine: " << num_contexts << " contexts, batches of"
+      << " up to " << max_batch_size << " samples or " << max_latency_us
+      << " us of wait";
+  // Sync the shared weights here, or the first forwards of the contexts
+  // would all race to copy them to the device at once.
+  const vector<shared_ptr<Blob<Dtype> > >& params = net->params();
+  for (int i = 0; i < params.size(); ++i) {
+    if (Caffe::mode() == Caffe::GPU) {
+      params[i]->gpu_data();
+    } else {
+      params[i]->cpu_data();
+    }
+  }
+  for (int i = 0; i < num_contexts; ++i) {
+    contexts_[i]->StartInternalThread();
+  }
+}
+
+template <typename Dtype>
+InferenceEngine<Dtype>::~InferenceEngine() {
+  // before sync_ goes away
+  for (int i = 0; i < contexts_.size(); ++i) {
+    contexts_[i]->StopInternalThread();
+  }
+}
+
+template <typename Dtype>
+void InferenceEngine<Dtype>::Infer(const Dtype* input,
+    vector<Dtype>* output) {
+  Request request;
+  request.input = input;
+  request.output = output;
+  request.done = false;
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  request.arrival = boost::get_system_time();
+  sync_->queue_.push_back(&request);
+  // wakes the contexts waiting for a batch to fill up as well
+  sync_->queued_.notify_all();
+  while (!request.done) {
+    sync_->done_.wait(lock);
+  }
+}
+
+template <typename Dtype>
+void InferenceEngine<Dtype>::NextBatch(vector<Request*>* batch) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  std::deque<Request*>& queue = sync_->queue_;
+  do {
+    while (queue.empty()) {
+      sync_->queued_.wait(lock);
+    }
+    const boost::system_time deadline = queue.front()->arrival +
+        boost::posix_time::microseconds(max_latency_us_);
+    // another context may take the queue while this one waits
+    while (!queue.empty() && queue.size() < max_batch_size_ &&
+        sync_->queued_.timed_wait(lock, deadline)) {
+    }
+  } while (queue.empty());
+  const int batch_size = std::min<int>(queue.size(), max_batch_size_);
+  batch->assign(queue.begin(), queue.begin() + batch_size);
+  queue.erase(queue.begin(), queue.begin() + batch_size);
+}
+
+template <typename Dtype>
+void InferenceEngine<Dtype>::Done(const vector<Request*>& batch) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  for (int i = 0; i < batch.size(); ++i) {
+    batch[i]->done = true;
+  }
+  ++batches_;
+  samples_ += batch.size();
+  sync_->done_.notify_all();
+}
+
+template <typename Dtype>
+size_t InferenceEngine<Dtype>::batches() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return batches_;
+}
+
+template <typename Dtype>
+size_t InferenceEngine<Dtype>::samples() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return samples_;
+}
+
+template <typename Dtype>
+InferenceEngine<Dtype>::Context::Context(InferenceEngine* engine,
+    const NetParameter& param)
+    : engine_(engine), net_(new Net<Dtype>(param)), batch_size_(-1) {
+}
+
+template <typename Dtype>
+InferenceEngine<Dtype>::Context::~Context() {
+  // before net_ goes away
+  StopInternalThread();
+}
+
+template <typename Dtype>
+void InferenceEngine<Dtype>::Context::InternalThreadEntry() {
+  try {
+    vector<Request*> batch;
+    while (!must_stop()) {
+      engine_->NextBatch(&batch);
+      Forward(batch);
+      engine_->Done(batch);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+template <typename Dtype>
+void InferenceEngine<Dtype>::Context::Forward(const vector<Request*>& batch) {
+  Blob<Dtype>* input = net_->input_blobs()[0];
+  if (batch.size() != batch_size_) {
+    batch_size_ = static_cast<int>(batch.size());
+    vector<int> shape = input->shape();
+    shape[0] = batch_size_;
+    input->Reshape(shape);
+    net_->Reshape();
+  }
+  const int input_count = engine_->input_count_;
+  Dtype* input_data = input->mutable_cpu_data();
+  for (int i = 0; i < batch_size_; ++i) {
+    caffe_copy(input_count, batch[i]->input, input_data + i * input_count);
+  }
+  net_->Forward();
+  for (int i = 0; i < batch_size_; ++i) {
+    vector<Dtype>* output = batch[i]->output;
+    output->resize(engine_->output_count_);
+    int offset = 0;
+    for (int j = 0; j < net_->num_outputs(); ++j) {
+      const Blob<Dtype>* blob = net_->output_blobs()[j];
+      const int count = blob->count(1);
+      caffe_copy(count, blob->cpu_data() + i * count, &(*output)[offset]);
+      offset += count;
+    }
+  }
+}
+
+INSTANTIATE_CLASS(InferenceEngine);
+
+}  // namespace caffe
@@ -7,6 +7,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/blocking_queue.hpp"
 
 namespace caffe {
@@ -36,9 +37,12 @@ template <typename Dtype>
 BasePrefetchingDataLayer<Dtype>::BasePrefetchingDataLayer(
     const LayerParameter& param)
     : BaseDataLayer<Dtype>(param),
-      prefetch_free_(), prefetch_full_() {
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_free_.push(&prefetch_[i]);
+      prefetch_(param.data_param().prefetch()),
+      prefetch_free_(), prefetch_full_(), prefetch_current_(NULL) {
+  CHECK_GT(prefetch_.size(), 0) << "Prefetch at least one batch.";
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i].reset(new Batch<Dtype>());
+    prefetch_free_.push(prefetch_[i].get());
   }
 }
 
@@ -50,18 +54,18 @@ void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
   // calls so that the prefetch thread does not accidentally make simultaneous
   // cudaMalloc calls when the main thread is running. In some GPUs this
   // seems to cause failures if we do not so.
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_[i].data_.mutable_cpu_data();
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i]->data_.mutable_cpu_data();
     if (this->output_labels_) {
-      prefetch_[i].label_.mutable_cpu_data();
+      prefetch_[i]->label_.mutable_cpu_data();
     }
   }
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
-    for (int i = 0; i < PREFETCH_COUNT; ++i) {
-      prefetch_[i].data_.mutable_gpu_data();
+    for (int i = 0; i < prefetch_.size(); ++i) {
+      prefetch_[i]->data_.mutable_gpu_data();
       if (this->output_labels_) {
-        prefetch_[i].label_.mutable_gpu_data();
+        prefetch_[i]->label_.mutable_gpu_data();
       }
     }
   }
@@ -87,7 +91,11 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
       load_batch(batch);
 #ifndef CPU_ONLY
       if (Caffe::mode() == Caffe::GPU) {
+        // from the pinned host memory of the batch
         batch->data_.data().get()->async_gpu_push(stream);
+        if (this->output_labels_) {
+          batch->label_.data().get()->async_gpu_push(stream);
+        }
         CUDA_CHECK(cudaStreamSynchronize(stream));
       }
 #endif
@@ -103,25 +111,63 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 #endif
 }
 
+template <typename Dtype>
+Batch<Dtype>* BasePrefetchingDataLayer<Dtype>::NextBatch() {
+  if (prefetch_current_) {
+    prefetch_free_.push(prefetch_current_);
+    prefetch_current_ = NULL;
+  }
+  PrefetchStats& stats = prefetch_stats_;
+  const int ready = prefetch_full_.size();
+  CPUTimer timer;
+  timer.Start();
+  Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  stats.wait_ms += timer.MilliSeconds();
+  ++stats.batches;
+  stats.ready += ready;
+  if (ready == 0) {
+    ++stats.empty;
+  }
+  const int kLogInterval = 1000;
+  if (stats.batches % kLogInterval == 0) {
+    LOG_IF(INFO, Caffe::root_solver()) << "Prefetch of "
+        << this->layer_param_.name() << ": " << stats.batches << " batches, "
+        << 100. * stats.empty / stats.batches << "% waited for ("
+        << stats.wait_ms << " ms), "
+        << static_cast<double>(stats.ready) / stats.batches << " of "
+        << prefetch_.size() << " ready on average";
+  }
+  return batch;
+}
+
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  Batch<Dtype>* batch = NextBatch();
   // Reshape to loaded data.
   top[0]->ReshapeLike(batch->data_);
-  // Copy the data
-  caffe_copy(batch->data_.count(), batch->data_.cpu_data(),
-             top[0]->mutable_cpu_data());
-  DLOG(INFO) << "Prefetch copied";
   if (this->output_labels_) {
     // Reshape to loaded labels.
     top[1]->ReshapeLike(batch->label_);
-    // Copy the labels.
-    caffe_copy(batch->label_.count(), batch->label_.cpu_data(),
-        top[1]->mutable_cpu_data());
   }
-
-  prefetch_free_.push(batch);
+  if (this->IsShared()) {
+    // Copy the data
+    caffe_copy(batch->data_.count(), batch->data_.cpu_data(),
+               top[0]->mutable_cpu_data());
+    DLOG(INFO) << "Prefetch copied";
+    if (this->output_labels_) {
+      // Copy the labels.
+      caffe_copy(batch->label_.count(), batch->label_.cpu_data(),
+          top[1]->mutable_cpu_data());
+    }
+    prefetch_free_.push(batch);
+    return;
+  }
+  top[0]->set_cpu_data(batch->data_.mutable_cpu_data());
+  if (this->output_labels_) {
+    top[1]->set_cpu_data(batch->label_.mutable_cpu_data());
+  }
+  prefetch_current_ = batch;
 }
 
 #ifdef CPU_ONLY
@@ -7,23 +7,38 @@ namespace caffe {
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::Forward_gpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  // The last batch goes back to the thread, to be overwritten, so make sure
+  // the kernels reading it are done.
+  CUDA_CHECK(cudaStreamSynchronize(cudaStreamDefault));
+  Batch<Dtype>* batch = NextBatch();
   // Reshape to loaded data.
   top[0]->ReshapeLike(batch->data_);
-  // Copy the data
-  caffe_copy(batch->data_.count(), batch->data_.gpu_data(),
-      top[0]->mutable_gpu_data());
   if (this->output_labels_) {
     // Reshape to loaded labels.
     top[1]->ReshapeLike(batch->label_);
-    // Copy the labels.
-    caffe_copy(batch->label_.count(), batch->label_.gpu_data(),
-        top[1]->mutable_gpu_data());
   }
-  // Ensure the copy is synchronous wrt the host, so that the next batch isn't
-  // copied in meanwhile.
-  CUDA_CHECK(cudaStreamSynchronize(cudaStreamDefault));
-  prefetch_free_.push(batch);
+  if (this->IsShared()) {
+    // Copy the data
+    caffe_copy(batch->data_.count(), batch->data_.gpu_data(),
+        top[0]->mutable_gpu_data());
+    if (this->output_labels_) {
+      // Copy the labels.
+      caffe_copy(batch->label_.count(), batch->label_.gpu_data(),
+          top[1]->mutable_gpu_data());
+    }
+    // Ensure the copy is synchronous wrt the host, so that the next batch
+    // isn't copied in meanwhile.
+    CUDA_CHECK(cudaStreamSynchronize(cudaStreamDefault));
+    prefetch_free_.push(batch);
+    return;
+  }
+  // Through gpu_data, which leaves the batch synced: the thread then writes
+  // its host memory without copying the device memory back first.
+  top[0]->set_gpu_data(const_cast<Dtype*>(batch->data_.gpu_data()));
+  if (this->output_labels_) {
+    top[1]->set_gpu_data(const_cast<Dtype*>(batch->label_.gpu_data()));
+  }
+  prefetch_current_ = batch;
 }
 
 INSTANTIATE_LAYER_GPU_FORWARD(BasePrefetchingDataLayer);
@@ -0,0 +1,169 @@
+#include <vector>
+
+#include "caffe/layers/direct_conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  const int* kernel_shape = this->kernel_shape_.cpu_data();
+  const int* stride = this->stride_.cpu_data();
+  use_direct_ = this->num_spatial_axes_ == 2 && !this->is_1x1_ &&
+      stride[0] == 1 && stride[1] == 1;
+  if (!use_direct_) {
+    return;
+  }
+  const int* pad = this->pad_.cpu_data();
+  kernel_h_ = kernel_shape[0];
+  kernel_w_ = kernel_shape[1];
+  dilation_h_ = this->dilation_.cpu_data()[0];
+  dilation_w_ = this->dilation_.cpu_data()[1];
+  pad_h_ = pad[0];
+  pad_w_ = pad[1];
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::padded_counts(int* input_count,
+    int* output_count) {
+  const int padded_height = this->conv_input_shape_.cpu_data()[1] + 2 * pad_h_;
+  const int padded_width = this->conv_input_shape_.cpu_data()[2] + 2 * pad_w_;
+  // The taps furthest right and down read past the last padded plane, by
+  // at most this many values, for outputs that are dropped.
+  const int overrun = dilation_h_ * (kernel_h_ - 1) * padded_width +
+      dilation_w_ * (kernel_w_ - 1);
+  *input_count = this->channels_ * padded_height * padded_width + overrun;
+  *output_count = this->num_output_ * padded_height * padded_width;
+}
+
+template <typename Dtype>
+size_t DirectConvolutionLayer<Dtype>::ColumnBufferBytes() {
+  if (!use_direct_) {
+    return ConvolutionLayer<Dtype>::ColumnBufferBytes();
+  }
+  int input_count, output_count;
+  padded_counts(&input_count, &output_count);
+  return (input_count + output_count) * sizeof(Dtype);
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  // reserves the padded buffers in the workspace, through ColumnBufferBytes
+  ConvolutionLayer<Dtype>::Reshape(bottom, top);
+  if (!use_direct_) {
+    return;
+  }
+  height_ = this->conv_input_shape_.cpu_data()[1];
+  width_ = this->conv_input_shape_.cpu_data()[2];
+  padded_height_ = height_ + 2 * pad_h_;
+  padded_width_ = width_ + 2 * pad_w_;
+  vector<int> padded_shape(1);
+  int output_count;
+  padded_counts(&padded_shape[0], &output_count);
+  padded_input_.Reshape(padded_shape);
+  padded_shape[0] = output_count;
+  padded_output_.Reshape(padded_shape);
+  vector<int> weight_shape(3);
+  weight_shape[0] = kernel_h_ * kernel_w_;
+  weight_shape[1] = this->num_output_;
+  weight_shape[2] = this->channels_ / this->group_;
+  tap_weights_.Reshape(weight_shape);
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::forward_cpu_direct(const Dtype* input,
+    const Dtype* bias, Dtype* output) {
+  const int padded_dim = padded_height_ * padded_width_;
+  // in a net both padded buffers go to the shared workspace
+  Dtype* padded_input;
+  Dtype* padded_output;
+  if (this->workspace_) {
+    padded_input = static_cast<Dtype*>(this->workspace_->mutable_cpu_data(
+        (padded_input_.count() + padded_output_.count()) * sizeof(Dtype)));
+    padded_output = padded_input + padded_input_.count();
+  } else {
+    padded_input = padded_input_.mutable_cpu_data();
+    padded_output = padded_output_.mutable_cpu_data();
+  }
+  // zero padded copy of the input, the overrun past the last plane included
+  caffe_set(padded_input_.count(), Dtype(0), padded_input);
+  for (int c = 0; c < this->channels_; ++c) {
+    for (int h = 0; h < height_; ++h) {
+      caffe_copy(width_, input + (c * height_ + h) * width_,
+          padded_input + c * padded_dim + (h + pad_h_) * padded_width_ +
+          pad_w_);
+    }
+  }
+  // Output (y, x) of tap (i, j) reads the padded input at
+  // (y + i * dilation_h, x + j * dilation_w), a fixed shift of the flat
+  // index y * padded_width + x. Every tap is then one GEMM over the shifted
+  // padded planes, of which the columns x >= output width and the rows
+  // y >= output height are computed and dropped.
+  const int out_channels_group = this->num_output_ / this->group_;
+  const int in_channels_group = this->channels_ / this->group_;
+  const Dtype* tap_weights = tap_weights_.cpu_data();
+  caffe_set(padded_output_.count(), Dtype(0), padded_output);
+  for (int i = 0; i < kernel_h_; ++i) {
+    for (int j = 0; j < kernel_w_; ++j) {
+      const int tap = i * kernel_w_ + j;
+      const int shift = i * dilation_h_ * padded_width_ + j * dilation_w_;
+      for (int g = 0; g < this->group_; ++g) {
+        caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, out_channels_group,
+            padded_dim, in_channels_group, (Dtype)1.,
+            tap_weights + tap_weights_.offset(tap, g * out_channels_group),
+            padded_input + g * in_channels_group * padded_dim + shift,
+            (Dtype)1., padded_output + g * out_channels_group * padded_dim);
+      }
+    }
+  }
+  const int out_h = this->output_shape_[0];
+  const int out_w = this->output_shape_[1];
+  for (int o = 0; o < this->num_output_; ++o) {
+    for (int y = 0; y < out_h; ++y) {
+      caffe_copy(out_w, padded_output + o * padded_dim + y * padded_width_,
+          output + (o * out_h + y) * out_w);
+    }
+    if (bias) {
+      caffe_add_scalar(out_h * out_w, bias[o], output + o * out_h * out_w);
+    }
+  }
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!use_direct_) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  // regroup the filters by tap, into num_output x (channels / group)
+  // matrices
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  Dtype* tap_weights = tap_weights_.mutable_cpu_data();
+  const int taps = kernel_h_ * kernel_w_;
+  const int in_channels_group = this->channels_ / this->group_;
+  for (int o = 0; o < this->num_output_; ++o) {
+    for (int c = 0; c < in_channels_group; ++c) {
+      for (int t = 0; t < taps; ++t) {
+        tap_weights[(t * this->num_output_ + o) * in_channels_group + c] =
+            *(weight++);
+      }
+    }
+  }
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = top[i]->mutable_cpu_data();
+    for (int n = 0; n < this->num_; ++n) {
+      forward_cpu_direct(bottom_data + n * this->bottom_dim_, bias,
+          top_data + n * this->top_dim_);
+    }
+  }
+}
+
+INSTANTIATE_CLASS(DirectConvolutionLayer);
+
+}  // namespace caffe
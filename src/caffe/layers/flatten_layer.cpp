@@ -24,6 +24,8 @@ void FlattenLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
   top[0]->Reshape(top_shape);
   CHECK_EQ(top[0]->count(), bottom[0]->count());
+  // share already, so that the top aliases the bottom from setup on
+  top[0]->ShareData(*bottom[0]);
 }
 
 template <typename Dtype>
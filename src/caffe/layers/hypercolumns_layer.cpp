@@ -4,18 +4,71 @@
 	> Mail: mylivejiang@gmail.com
 	> Created Time: 2016年06月06日 星期一 19时40分04秒
  ************************************************************************/
+#include <boost/bind.hpp>
+
 #include <vector>
 #include <map>
 #include <cmath>
 #include <algorithm>
-#include <ctime>
-#include <cstdlib>
 
 #include "caffe/layers/hypercolumns_layer.hpp"
+#include "caffe/util/bilinear.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/rng.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
+// copy the positions [begin, end) of a num x channels x spatial blob into
+// num x spatial x channels order, tile by tile to stay in cache
+template <typename Dtype>
+static void transpose_channels_last(int begin, int end, const Dtype* src,
+        Dtype* dst, const int channels, const int spatial) {
+    const int kTile = 16;
+    for (int i0 = begin; i0 < end; i0 += kTile) {
+        const int i1 = std::min(i0 + kTile, end);
+        for (int c0 = 0; c0 < channels; c0 += kTile) {
+            const int c1 = std::min(c0 + kTile, channels);
+            for (int i = i0; i < i1; ++i) {
+                const Dtype* from = src + (i / spatial) * channels * spatial
+                    + i % spatial;
+                Dtype* to = dst + i * channels;
+                for (int c = c0; c < c1; ++c) {
+                    to[c] = from[c * spatial];
+                }
+            }
+        }
+    }
+}
+
+template <typename Dtype>
+void HyperColumnsLayer<Dtype>::find_valid_points(int begin, int end,
+        const Dtype* feature_data) {
+    // a point is valid unless all of its channels hold the invalid value or
+    // any of them is nan. count per pixel, walking every channel plane in
+    // order so the scan stays contiguous
+    const Dtype invalid_value = Dtype(invalid_condition_);
+    const int spatial = H_ * W_;
+    for (int i = begin; i < end; ++i) {
+        int* count = &invalid_count_[i * spatial];
+        std::fill(count, count + spatial, 0);
+        for (int c = 0; c < K_; ++c) {
+            const Dtype* plane = feature_data + (i * K_ + c) * spatial;
+            for (int j = 0; j < spatial; ++j) {
+                const Dtype value = plane[j];
+                count[j] += (value == invalid_value) + (value != value) * K_;
+            }
+        }
+        vector<int>& valid = valid_points_[i];
+        valid.clear();
+        for (int j = 0; j < spatial; ++j) {
+            if (count[j] < K_) {
+                valid.push_back(j);
+            }
+        }
+    }
+}
+
 template <typename Dtype>
 void HyperColumnsLayer<Dtype>::generate_list(const Blob<Dtype>* feature_map) {
     // generate sampling list. when training do random sampling. when testing whole
@@ -32,44 +85,37 @@ void HyperColumnsLayer<Dtype>::generate_list(const Blob<Dtype>* feature_map) {
         }
     } 
     else {
-        double invalid_value = Dtype(invalid_condition_);
-        // do the random sample job
-        vector<int> holds;
-        for(int i = 0; i < H_*W_; ++i) {
-            holds.push_back(i);
-        }
-        // the sample seed
-        const Dtype* feature_data = feature_map->cpu_data();// for cpp
-        std::srand(unsigned(std::time(0)));
+        // find the valid points of every image in parallel, then draw from them
+        // here, since only this thread may use the generator
+        invalid_count_.resize(N_ * H_ * W_);
+        valid_points_.resize(N_);
+        ThreadPool::Global().ParallelFor(N_, boost::bind(
+            &HyperColumnsLayer<Dtype>::find_valid_points, this, _1, _2,
+            feature_map->cpu_data()));
+        caffe::rng_t* rng = static_cast<caffe::rng_t*>(rng_->generator());
         for (int i = 0; i < N_; ++i) {
-            std::random_shuffle(holds.begin(), holds.end());
-            int count = 0;
-            for (int j = 0; j < holds.size(); ++j) {
-                const int index = holds[j];
-                // check whether it is valid, and the value of each channel not all be zero
-                bool valid = true;
-                int invalid_count = 0;
-                // data check
-                for (int c = 0; c < K_; ++c) {
-                    const int offset = feature_map->offset(i, c);
-                    const Dtype value = feature_data[offset+index];
-                    if (value != value) {
-                        valid = false;
-                        break;
-                    }
-                    if (value == invalid_value) {
-                        ++invalid_count; // maybe another judge ? add one condition
-                    }
-                }
-                // assign
-                if (valid && invalid_count != K_) {
-                    selected_points_.push_back(index);
-                    ++count;
-                }
-                if (count >= sample_num_) {
-                    break;
+            vector<int>& valid = valid_points_[i];
+            if (valid.empty()) {
+                LOG(WARNING) << "No valid point in image " << i
+                    << ", sampling from all of them";
+                for (int j = 0; j < H_ * W_; ++j) {
+                    valid.push_back(j);
                 }
             }
+            // partial fisher-yates: the first picks are distinct points. an
+            // image with fewer valid points than sample_num_ repeats some of
+            // them, so that every image owns exactly sample_num_ rows
+            const int n = valid.size();
+            const int picks = std::min(n, sample_num_);
+            for (int j = 0; j < picks; ++j) {
+                boost::uniform_int<int> dist(j, n - 1);
+                std::swap(valid[j], valid[dist(*rng)]);
+                selected_points_.push_back(valid[j]);
+            }
+            for (int j = picks; j < sample_num_; ++j) {
+                boost::uniform_int<int> dist(0, n - 1);
+                selected_points_.push_back(valid[dist(*rng)]);
+            }
         }
     }
 }
@@ -84,17 +130,25 @@ void HyperColumnsLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     // bottom: normal_map, conv1_2, conv2_2, conv3_3, conv4_3, conv5_3, fc-conv7. length of 7
     // top: top[0] hypercolumns, top[1] the corresponding sampled normal point
     is_train_ = this->layer_param_.hypercolumns_param().is_train();
-    skip_ratio_ = this->layer_param_.hypercolumns_param().skip_ratio();
+    channels_last_ = this->layer_param_.hypercolumns_param().channels_last();
     invalid_condition_ = this->layer_param_.hypercolumns_param().invalid_condition();
     if (!(invalid_condition_ == 0 || invalid_condition_ == -1)) {
         LOG(ERROR) << "Unrecognized invalid condition. be 0 or -1";
     }
+    const int64_t seed = this->layer_param_.hypercolumns_param().random_seed();
+    rng_.reset(new Caffe::RNG(seed >= 0 ? seed : caffe_rng_rand()));
+}
+
+template <typename Dtype>
+void HyperColumnsLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+        const vector<Blob<Dtype>*>& top) {
     const Blob<Dtype>* normal_map = bottom[0];
     N_ = normal_map->shape(0);
     K_ = normal_map->shape(1);
     H_ = normal_map->shape(2);
     W_ = normal_map->shape(3);
     // here check the skip_ratio_, to make sure it can divide the H_*W_
+    skip_ratio_ = this->layer_param_.hypercolumns_param().skip_ratio();
     while(true) {
         if ((H_*W_) % skip_ratio_ == 0)
             break;
@@ -107,27 +161,56 @@ void HyperColumnsLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
         sample_num_ = H_ * W_ / skip_ratio_; // skip some data points
     // note here I make the normal be bottom 0, and push it to the data store
     // to make consistence
-    width_.push_back(bottom[0]->shape(2));
-    height_.push_back(bottom[0]->shape(3));
+    width_.clear();
+    height_.clear();
+    scalef_.clear();
+    channels_.clear();
+    channel_offset_.clear();
+    width_.push_back(bottom[0]->shape(3));
+    height_.push_back(bottom[0]->shape(2));
     scalef_.push_back(1);
-    padf_.push_back(0.0);
     channels_.push_back(bottom[0]->channels());
+    channel_offset_.push_back(0);
     int channel = 0;
     for (int i = 1; i < bottom.size(); ++i) {
         channels_.push_back(bottom[i]->channels());
+        channel_offset_.push_back(channel);
         channel += channels_[i];
         width_.push_back(bottom[i]->shape(3));
         height_.push_back(bottom[i]->shape(2));
-        const int scale = H_ / bottom[i]->shape(2);
-        scalef_.push_back(scale);
-        padf_.push_back(static_cast<Dtype>((scale-1.0)/2));
+        scalef_.push_back(H_ / bottom[i]->shape(2));
     }
     total_channels_ = channel;
-}
+    channel_offset_.push_back(total_channels_);
+
+    // build the sampling tables, for every bottom and every original row/col
+    const int num_bottom = bottom.size();
+    row_index_.Reshape(num_bottom, 2, H_, 1);
+    col_index_.Reshape(num_bottom, 2, W_, 1);
+    row_weight_.Reshape(num_bottom, H_, 1, 1);
+    col_weight_.Reshape(num_bottom, W_, 1, 1);
+    for (int b = 1; b < num_bottom; ++b) {
+        int* row_index = row_index_.mutable_cpu_data() + row_index_.offset(b);
+        int* col_index = col_index_.mutable_cpu_data() + col_index_.offset(b);
+        bilinear_axis_table(H_, height_[b], scalef_[b], row_index,
+            row_index + H_, row_weight_.mutable_cpu_data() + row_weight_.offset(b));
+        bilinear_axis_table(W_, width_[b], scalef_[b], col_index,
+            col_index + W_, col_weight_.mutable_cpu_data() + col_weight_.offset(b));
+        for (int h = 0; h < 2 * H_; ++h) {
+            row_index[h] *= width_[b];
+        }
+    }
+    sample_list_.Reshape(N_ * sample_num_, 1, 1, 1);
+    if (channels_last_) {
+        transposed_.resize(bottom.size());
+        for (int b = 1; b < bottom.size(); ++b) {
+            if (!transposed_[b]) {
+                transposed_[b].reset(new Blob<Dtype>());
+            }
+            transposed_[b]->Reshape(N_, height_[b], width_[b], channels_[b]);
+        }
+    }
 
-template <typename Dtype>
-void HyperColumnsLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
-        const vector<Blob<Dtype>*>& top) {
     // reshape the top
     // top[0] is the hypercolumns, which is M * total_channels_, where M = sample_num_ * N_
     // top[1] is the sampled normal point, which is M * k
@@ -151,91 +234,140 @@ void HyperColumnsLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     // forward step
     Dtype* top_normal = top[1]->mutable_cpu_data();
     Dtype* top_hypercolumns = top[0]->mutable_cpu_data();
-    const Dtype* bottom_normal = bottom[0]->cpu_data();
     caffe_set(top[1]->count(), Dtype(0.0), top_normal);
     caffe_set(top[0]->count(), Dtype(0), top_hypercolumns);
     // generate sampling list 
     generate_list(bottom[0]);
-    // do the forward job
+    // fetch every pointer here, the workers must not touch the synced memory
+    vector<const Dtype*> bottom_data(bottom.size());
+    for (int b = 0; b < bottom.size(); ++b) {
+        bottom_data[b] = bottom[b]->cpu_data();
+    }
+    if (channels_last_) {
+        for (int b = 1; b < bottom.size(); ++b) {
+            Dtype* transposed = transposed_[b]->mutable_cpu_data();
+            ThreadPool::Global().ParallelFor(N_ * height_[b] * width_[b],
+                boost::bind(&transpose_channels_last<Dtype>, _1, _2,
+                            bottom_data[b], transposed, channels_[b],
+                            height_[b] * width_[b]));
+            bottom_data[b] = transposed;
+        }
+    }
+    const Interpolation interp = cpu_interpolation();
+    // do the forward job, every point writes its own rows of the tops
+    ThreadPool::Global().ParallelFor(selected_points_.size(),
+        boost::bind(&HyperColumnsLayer<Dtype>::forward_cpu_points, this,
+                    _1, _2, boost::cref(bottom_data), boost::cref(interp),
+                    top_hypercolumns, top_normal));
+}
+
+template <typename Dtype>
+typename HyperColumnsLayer<Dtype>::Interpolation
+HyperColumnsLayer<Dtype>::cpu_interpolation() {
+    Interpolation interp;
+    interp.row_index = row_index_.cpu_data();
+    interp.col_index = col_index_.cpu_data();
+    interp.row_weight = row_weight_.cpu_data();
+    interp.col_weight = col_weight_.cpu_data();
+    return interp;
+}
+
+template <typename Dtype>
+void HyperColumnsLayer<Dtype>::forward_cpu_points(int begin, int end,
+        const vector<const Dtype*>& bottom_data, const Interpolation& interp,
+        Dtype* top_hypercolumns, Dtype* top_normal) {
+    const Dtype* bottom_normal = bottom_data[0];
+    const int* row_index = interp.row_index;
+    const int* col_index = interp.col_index;
+    const Dtype* row_weight = interp.row_weight;
+    const Dtype* col_weight = interp.col_weight;
     int h, w, n, index;
-    int fw, fh, cw, ch; // the floor and ceil elements
-    Dtype tempw, temph; // the raw divide
     Dtype delta_w, delta_h;
-    int top_index = 0;
-    int top_n_index = 0;
-    for (int i = 0; i < selected_points_.size(); ++i) {
+    int top_index = begin * total_channels_;
+    int top_n_index = begin * K_;
+    for (int i = begin; i < end; ++i) {
         // for every top sampling feature point
         index = selected_points_[i]; // the index
-        h = index / W_; // the w in the original
-        w = index % W_; // the h in the original
+        h = index / W_; // the h in the original
+        w = index % W_; // the w in the original
         n = i / sample_num_; // the num
-        // for debug
         // find the corresponding locations for every bottom
-        for (int b = 1; b < bottom.size(); ++b) {
-            const Dtype* bottom_data = bottom[b]->cpu_data();
+        for (int b = 1; b < bottom_data.size(); ++b) {
+            const Dtype* data = bottom_data[b];
             const int padding = height_[b] * width_[b];
-            const int channels = bottom[b]->channels();
-            int slice = n * channels * padding;
-            tempw = (w - padf_[b]) / scalef_[b]; // the computed 
-            temph = (h - padf_[b]) / scalef_[b];
-            fw = static_cast<int>(floor(tempw));
-            fh = static_cast<int>(floor(temph));
-            cw = static_cast<int>(ceil(tempw));
-            ch = static_cast<int>(ceil(temph));
-            // boundary check
-            fw = fw > 0 ? fw : 0;
-            cw = cw > 0 ? cw : 0;
-            fh = fh > 0 ? fh : 0;
-            ch = ch > 0 ? ch : 0;
-            cw = cw < width_[b] ? cw : fw;
-            ch = ch < height_[b] ? ch : fh;
-            /**
-            if (i == 0 || (i == N_*sample_num_-1)) {
-                LOG(INFO) << "for point " << i << " bottom " << b-1 << "the corresponding is "  << fw
-                          << " " << fh << " " << cw << " " << ch;
+            const int channels = channels_[b];
+            const int* rows = row_index + b * 2 * H_;
+            const int* cols = col_index + b * 2 * W_;
+            const int slice = n * channels * padding;
+            delta_h = row_weight[b * H_ + h];
+            delta_w = col_weight[b * W_ + w];
+            if (channels_last_) {
+                // the channels of a bottom point are contiguous, blend them
+                // as whole vectors
+                const int pixel = n * padding;
+                const Dtype* data1 = data + (pixel + rows[h] + cols[w]) * channels;
+                const Dtype* data2 = data + (pixel + rows[h] + cols[W_ + w]) * channels;
+                const Dtype* data3 = data + (pixel + rows[H_ + h] + cols[w]) * channels;
+                const Dtype* data4 = data + (pixel + rows[H_ + h] + cols[W_ + w]) * channels;
+                Dtype* top = top_hypercolumns + top_index;
+                if ((delta_w == 0) && (delta_h == 0)) {
+                    for (int c = 0; c < channels; ++c) {
+                        top[c] = data1[c];
+                    }
+                }
+                else if (delta_h == 0) {
+                    for (int c = 0; c < channels; ++c) {
+                        top[c] = data1[c] * (1-delta_w) + data2[c] * delta_w;
+                    }
+                }
+                else if (delta_w == 0) {
+                    for (int c = 0; c < channels; ++c) {
+                        top[c] = data1[c] * (1-delta_h) + data3[c] * delta_h;
+                    }
+                }
+                else {
+                    for (int c = 0; c < channels; ++c) {
+                        top[c] = (data1[c]*(1-delta_h) + data3[c]*(delta_h)) * (1-delta_w) +
+                            (data2[c]*(1-delta_h) + data4[c]*(delta_h)) * delta_w;
+                    }
+                }
+                top_index += channels;
+                continue;
             }
-             **/
+            int offset1 = slice + rows[h] + cols[w];
             // assign values
-            if ((fw == cw) && (fh == ch)) {
-                int offset = slice +  fh * width_[b] + fw;
+            if ((delta_w == 0) && (delta_h == 0)) {
                 for (int c = 0; c < channels; ++c) {
-                    top_hypercolumns[top_index++] = bottom_data[offset];
-                    offset += padding;
+                    top_hypercolumns[top_index++] = data[offset1];
+                    offset1 += padding;
                 }
             }
-            else if (fh == ch) {
-                delta_w = tempw - fw;
-                int offset1 = slice + fh * width_[b] + fw;
-                int offset2 = offset1 + 1;
+            else if (delta_h == 0) {
+                int offset2 = slice + rows[h] + cols[W_ + w];
                 for (int c = 0; c < channels; ++c) {
                     top_hypercolumns[top_index++] = 
-                        bottom_data[offset1] * (1-delta_w) + bottom_data[offset2] * delta_w;
+                        data[offset1] * (1-delta_w) + data[offset2] * delta_w;
                     offset1 += padding;
                     offset2 += padding;
                 }
             }
-            else if (fw == cw) {
-                delta_h = temph - fh;
-                int offset1 = slice + fh * width_[b] + fw;
-                int offset2 = offset1 + width_[b];
+            else if (delta_w == 0) {
+                int offset2 = slice + rows[H_ + h] + cols[w];
                 for (int c = 0; c < channels; ++c) {
                     top_hypercolumns[top_index++] = 
-                        bottom_data[offset1] * (1-delta_h) + bottom_data[offset2] * delta_h;
+                        data[offset1] * (1-delta_h) + data[offset2] * delta_h;
                     offset1 += padding;
                     offset2 += padding;
                 }
             }
             else {
-                delta_w = tempw - fw;
-                delta_h = temph - fh;
-                int offset1 = slice + fh * width_[b] + fw;
-                int offset2 = offset1 + 1;
-                int offset3 = offset1 + width_[b];
-                int offset4 = offset3 + 1;
+                int offset2 = slice + rows[h] + cols[W_ + w];
+                int offset3 = slice + rows[H_ + h] + cols[w];
+                int offset4 = slice + rows[H_ + h] + cols[W_ + w];
                 for (int c = 0; c < channels; ++c) {
                     top_hypercolumns[top_index++] = 
-                        (bottom_data[offset1]*(1-delta_h) + bottom_data[offset3]*(delta_h)) * (1-delta_w) + 
-                        (bottom_data[offset2]*(1-delta_h) + bottom_data[offset4]*(delta_h)) * delta_w;
+                        (data[offset1]*(1-delta_h) + data[offset3]*(delta_h)) * (1-delta_w) + 
+                        (data[offset2]*(1-delta_h) + data[offset4]*(delta_h)) * delta_w;
                     offset1 += padding;
                     offset2 += padding;
                     offset3 += padding;
@@ -259,83 +391,93 @@ void HyperColumnsLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
                                             const vector<Blob<Dtype>*>& bottom) {
     // backward step
     const Dtype* top_diff = top[0]->cpu_diff();
-    // first set the value to zero for every bottom diff
+    vector<Dtype*> bottom_diff(bottom.size(), NULL);
     for (int i = 1; i < bottom.size(); ++i) {
-        caffe_set(bottom[i]->count(), Dtype(0), bottom[i]->mutable_cpu_diff());
+        bottom_diff[i] = bottom[i]->mutable_cpu_diff();
     }
-    // do backward
-    int h, w, n, index;
-    int fw, fh, cw, ch;
-    Dtype tempw, temph;
+    // the work is split by the (num, channel) slices of the bottoms instead of
+    // by points. a slice only receives diff from its own channel of its own
+    // image, so there are no write races and the sum order stays the serial one
+    const Interpolation interp = cpu_interpolation();
+    ThreadPool::Global().ParallelFor(N_ * total_channels_,
+        boost::bind(&HyperColumnsLayer<Dtype>::backward_cpu_slices, this,
+                    _1, _2, top_diff, boost::cref(bottom_diff),
+                    boost::cref(interp)));
+}
+
+template <typename Dtype>
+void HyperColumnsLayer<Dtype>::backward_cpu_slices(int begin, int end,
+        const Dtype* top_diff, const vector<Dtype*>& bottom_diff,
+        const Interpolation& interp) {
+    int h, w, index;
     Dtype delta_w, delta_h;
-    int top_index = 0;
-    for (int i = 0; i < selected_points_.size(); ++i) {
-        index = selected_points_[i];
-        n = i / sample_num_;
-        h = index / W_;
-        w = index % W_;
-        // find the corresponding feature point in the bottom
-        for (int b = 1; b < bottom.size(); ++b) {
-            Dtype* bottom_diff = bottom[b]->mutable_cpu_diff();
-            const int padding = width_[b] * height_[b];
-            const int channels = bottom[b]->channels();
-            int slice = n * channels * padding;
-            tempw = (w - padf_[b]) / scalef_[b];
-            temph = (h - padf_[b]) / scalef_[b];
-            fw = static_cast<int>(floor(tempw));
-            fh = static_cast<int>(floor(temph));
-            cw = static_cast<int>(ceil(tempw));
-            ch = static_cast<int>(ceil(temph));
-            // boundary check
-            fw = fw > 0 ? fw : 0;
-            cw = cw > 0 ? cw : 0;
-            fh = fh > 0 ? fh : 0;
-            ch = ch > 0 ? ch : 0;
-            cw = cw < width_[b] ? cw : fw;
-            ch = ch < height_[b] ? ch : fh;
+    int unit = begin;
+    while (unit < end) {
+        // locate the image, the bottom and the channel range of this piece
+        const int n = unit / total_channels_;
+        const int channel = unit % total_channels_;
+        int b = 1;
+        while (channel >= channel_offset_[b + 1]) {
+            ++b;
+        }
+        const int c_begin = channel - channel_offset_[b];
+        const int c_end = std::min(channels_[b], c_begin + end - unit);
+        unit += c_end - c_begin;
+
+        const int padding = width_[b] * height_[b];
+        const int* rows = interp.row_index + row_index_.offset(b);
+        const int* cols = interp.col_index + col_index_.offset(b);
+        const Dtype* row_weight = interp.row_weight + row_weight_.offset(b);
+        const Dtype* col_weight = interp.col_weight + col_weight_.offset(b);
+        Dtype* diff = bottom_diff[b] + (n * channels_[b] + c_begin) * padding;
+        // first set the value to zero for the owned slices
+        caffe_set((c_end - c_begin) * padding, Dtype(0), diff);
+        const int last = std::min<int>((n + 1) * sample_num_,
+                                       selected_points_.size());
+        for (int i = n * sample_num_; i < last; ++i) {
+            index = selected_points_[i];
+            h = index / W_;
+            w = index % W_;
+            int top_index = i * total_channels_ + channel;
+            // find the corresponding feature point in the bottom
+            delta_h = row_weight[h];
+            delta_w = col_weight[w];
+            int offset1 = rows[h] + cols[w];
 
             // assign values
-            if ((fw==cw) && (fh==ch)) {
-                int offset = slice + fh * width_[b] + fw;
-                for (int c = 0; c < channels; ++c) {
-                    bottom_diff[offset] += top_diff[top_index++];
-                    offset += padding;
+            if ((delta_w == 0) && (delta_h == 0)) {
+                for (int c = c_begin; c < c_end; ++c) {
+                    diff[offset1] += top_diff[top_index++];
+                    offset1 += padding;
                 }
             }
-            else if (fh == ch) {
-                delta_w = tempw - fw;
-                int offset1 = slice + fh * width_[b] + fw;
-                int offset2 = offset1 + 1;
-                for (int c = 0; c < channels; ++c) {
-                    bottom_diff[offset1] += top_diff[top_index] * (1-delta_w);
-                    bottom_diff[offset2] += top_diff[top_index++] * delta_w;
+            else if (delta_h == 0) {
+                int offset2 = rows[h] + cols[W_ + w];
+                for (int c = c_begin; c < c_end; ++c) {
+                    diff[offset1] += top_diff[top_index] * (1-delta_w);
+                    diff[offset2] += top_diff[top_index++] * delta_w;
                     offset1 += padding;
                     offset2 += padding;
                 }
             }
-            else if (fw == cw) {
-                delta_h = temph - fh;
-                int offset1 = slice + fh * width_[b] + fw;
-                int offset2 = offset1 + width_[b];
-                for (int c = 0; c < channels; ++c) {
-                    bottom_diff[offset1] += top_diff[top_index] * (1 - delta_h);
-                    bottom_diff[offset2] += top_diff[top_index++] * delta_h;
+            else if (delta_w == 0) {
+                int offset2 = rows[H_ + h] + cols[w];
+                for (int c = c_begin; c < c_end; ++c) {
+                    diff[offset1] += top_diff[top_index] * (1 - delta_h);
+                    diff[offset2] += top_diff[top_index++] * delta_h;
                     offset1 += padding;
                     offset2 += padding;
                 }
             }
             else {
-                delta_w = tempw - fw;
-                delta_h = temph - fh;
-                int offset1 = slice + fh * width_[b] + fw;
-                int offset2 = offset1 + 1;
-                int offset3 = offset1 + width_[b];
-                int offset4 = offset3 + 1;
-                for (int c = 0; c < channels; ++c) {
-                    bottom_diff[offset1] += top_diff[top_index] * (1-delta_w) * (1-delta_h);
-                    bottom_diff[offset2] += top_diff[top_index] * (1-delta_h) * delta_w;
-                    bottom_diff[offset3] += top_diff[top_index] * delta_h * (1-delta_w);
-                    bottom_diff[offset4] += top_diff[top_index++] * delta_h * delta_w;
+                int offset2 = rows[h] + cols[W_ + w];
+                int offset3 = rows[H_ + h] + cols[w];
+                int offset4 = rows[H_ + h] + cols[W_ + w];
+                for (int c = c_begin; c < c_end; ++c) {
+                    diff[offset1] += top_diff[top_index] * (1-delta_w) * (1-delta_h);
+                    diff[offset2] += top_diff[top_index] * (1-delta_h) * delta_w;
+                    diff[offset3] += top_diff[top_index] * delta_h * (1-delta_w);
+                    diff[offset4] += top_diff[top_index++] * delta_h * delta_w;
                     offset1 += padding;
                     offset2 += padding;
                     offset3 += padding;
@@ -346,17 +488,6 @@ void HyperColumnsLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     }
 }
 
-template <typename Dtype>
-HyperColumnsLayer<Dtype>::~HyperColumnsLayer() {
-    #ifndef CPU_ONLY
-        if (cuda_instanced_) {
-            CUDA_CHECK(cudaFree(cuda_samplelist_));
-            CUDA_POST_KERNEL_CHECK;
-        }
-    #endif
-    cuda_instanced_ = false;
-}
-
 #ifdef CPU_ONLY
     STUB_GPU(HyperColumnsLayer);
 #endif
@@ -33,10 +33,13 @@ __global__ void ForwardNormal(const int nthreads,
 
 template <typename Dtype>
 __global__ void ForwardHypercolumns(const int nthreads,
-                                    const Dtype* bottom_data, const int num, const int bottom_channels,
-                                    const int bottom_height, const int bottom_width, const int sample_pernum,
+                                    const Dtype* bottom_data, const int bottom_channels,
+                                    const int bottom_size, const int sample_pernum,
                                     const int top_channels, const int top_channel_offset, const int* sampling_list,
-                                    const int original_h, Dtype* const top_data) {
+                                    const int original_h, const int original_w,
+                                    const int* row_index, const Dtype* row_weight,
+                                    const int* col_index, const Dtype* col_weight,
+                                    Dtype* const top_data) {
     //forward hypercolumns, separate for each bottom
     CUDA_KERNEL_LOOP(index, nthreads) {
         const int top_n = index / bottom_channels;
@@ -44,36 +47,20 @@ __global__ void ForwardHypercolumns(const int nthreads,
         const int bottom_channel = index % bottom_channels; // get the actual channel of the bottom
         const int top_index = bottom_channel + top_n * top_channels + top_channel_offset;
         const int sample_index = sampling_list[top_n];
-        const Dtype* const bottom_slice = bottom_data + (bottom_n * bottom_channels + bottom_channel) * bottom_height * bottom_width;
-        // get the corresponding bottom_index, according to the top. using bilinear intercept
-        const double scale = original_h * 1.0 / bottom_height;
-        const int x = sample_index / original_h;
-        const int y = sample_index % original_h;
-        const double r = x / scale + 1.0 / (2.0 * scale) - 0.5;
-        const double c = y / scale + 1.0 / (2.0 * scale) - 0.5;
-        const int u = floor(r);
-        const int v = floor(c);
-        double delta_r = r - u;
-        double delta_c = c - v;
-        if (u < 0)
-            delta_r = 1;
-        if (u + 1 >= bottom_width)
-            delta_r = 0;
-        if (v < 0)
-            delta_c = 1;
-        if (v + 1 >= bottom_height)
-            delta_c = 0;
-        // assign the value, notice the boundary check
-        Dtype value = 0;
-        if ((1 - delta_r) * (1 - delta_c) != 0)
-            value += bottom_slice[u * bottom_height + v] * (1 - delta_r) * (1 - delta_c);
-        if (delta_r * (1 - delta_c) != 0)
-            value += bottom_slice[(u+1) * bottom_height + v] * delta_r * (1 - delta_c);
-        if (delta_c * (1 - delta_r) != 0)
-            value += bottom_slice[u * bottom_height + v + 1] * delta_c * (1 - delta_r);
-        if (delta_r * delta_c != 0)
-            value += bottom_slice[(u+1) * bottom_height + v + 1] * delta_r * delta_c;
-        top_data[top_index] = value;
+        const Dtype* const bottom_slice = bottom_data + (bottom_n * bottom_channels + bottom_channel) * bottom_size;
+        // get the corresponding bottom points from the sampling tables. the
+        // unused neighbours have zero weights, so always blend all four
+        const int h = sample_index / original_w;
+        const int w = sample_index % original_w;
+        const int r0 = row_index[h];
+        const int r1 = row_index[original_h + h];
+        const int c0 = col_index[w];
+        const int c1 = col_index[original_w + w];
+        const Dtype delta_h = row_weight[h];
+        const Dtype delta_w = col_weight[w];
+        top_data[top_index] =
+            (bottom_slice[r0 + c0] * (1 - delta_h) + bottom_slice[r1 + c0] * delta_h) * (1 - delta_w) +
+            (bottom_slice[r0 + c1] * (1 - delta_h) + bottom_slice[r1 + c1] * delta_h) * delta_w;
     }
 }
 
@@ -83,14 +70,9 @@ void HyperColumnsLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
   const vector<Blob<Dtype>*>& top) {
     // generate sampling list
     generate_list(bottom[0]);
-    // to make sure malloc only once
-    if (!cuda_instanced_) {
-        CUDA_CHECK(cudaMalloc(&cuda_samplelist_, selected_points_.size() * sizeof(int)));
-        cuda_instanced_ = true;
-    }
-    CUDA_CHECK(cudaMemcpy(cuda_samplelist_, &selected_points_[0], selected_points_.size()* sizeof(int), cudaMemcpyHostToDevice));
-    //LOG(INFO) << "hypercolumns forward 1st points with "<<selected_points_[0];
-    //LOG(INFO) << "hypercolumns forward last points with "<<selected_points_[sample_num_-1];
+    std::copy(selected_points_.begin(), selected_points_.end(),
+              sample_list_.mutable_cpu_data());
+    const int* sample_list = sample_list_.gpu_data();
 
     // normal
     Dtype* top_normal = top[1]->mutable_gpu_data();
@@ -98,7 +80,7 @@ void HyperColumnsLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
     const Dtype* bottom_normal = bottom[0]->gpu_data();
     const int count1 = top[1]->count();
     ForwardNormal<Dtype><<<CAFFE_GET_BLOCKS(count1), CAFFE_CUDA_NUM_THREADS>>>(
-            count1, bottom_normal, N_, K_, H_, W_, sample_num_, cuda_samplelist_, top_normal
+            count1, bottom_normal, N_, K_, H_, W_, sample_num_, sample_list, top_normal
     );
 
 
@@ -106,29 +88,32 @@ void HyperColumnsLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
     Dtype* top_hypercolumns = top[0]->mutable_gpu_data();
     caffe_gpu_set(top[0]->count(), Dtype(0.0), top_hypercolumns);
 
-    int top_channel_offset = 0;
     for (int i = 1; i < bottom.size(); ++i) {
         const Dtype* bottom_data = bottom[i]->gpu_data();
-        const int bottom_channels = bottom[i]->shape(1);
-        const int bottom_height = bottom[i]->shape(2);
-        const int bottom_width = bottom[i]->shape(3);
+        const int bottom_channels = channels_[i];
+        const int bottom_size = height_[i] * width_[i];
         const int nthreads = N_ * sample_num_ * bottom_channels;
         ForwardHypercolumns<Dtype><<<CAFFE_GET_BLOCKS(nthreads), CAFFE_CUDA_NUM_THREADS>>>(
-        nthreads, bottom_data, N_, bottom_channels, bottom_height, bottom_width, sample_num_,
-        total_channels_, top_channel_offset, cuda_samplelist_, H_, top_hypercolumns
+        nthreads, bottom_data, bottom_channels, bottom_size, sample_num_,
+        total_channels_, channel_offset_[i], sample_list, H_, W_,
+        row_index_.gpu_data() + row_index_.offset(i), row_weight_.gpu_data() + row_weight_.offset(i),
+        col_index_.gpu_data() + col_index_.offset(i), col_weight_.gpu_data() + col_weight_.offset(i),
+        top_hypercolumns
         );
-        top_channel_offset += bottom_channels;
     }
-
+    CUDA_POST_KERNEL_CHECK;
 }
 
 
 template <typename Dtype>
 __global__ void BackwardHypercolumns(const int nthreads,
-                                     Dtype* const bottom_data, const int num, const int bottom_channels,
-                                     const int bottom_height, const int bottom_width, const int sample_pernum,
+                                     Dtype* const bottom_data, const int bottom_channels,
+                                     const int bottom_size, const int sample_pernum,
                                      const int top_channels, const int top_channel_offset, const int* sampling_list,
-                                     const int original_h, const Dtype* const top_data) {
+                                     const int original_h, const int original_w,
+                                     const int* row_index, const Dtype* row_weight,
+                                     const int* col_index, const Dtype* col_weight,
+                                     const Dtype* const top_data) {
     // backward hypercolumns, seperate for each bottom
     CUDA_KERNEL_LOOP(index, nthreads) {
         const int top_n = index / bottom_channels;
@@ -136,34 +121,24 @@ __global__ void BackwardHypercolumns(const int nthreads,
         const int bottom_channel = index % bottom_channels;
         const int top_index = bottom_channel + top_n * top_channels + top_channel_offset;
         const int sampling_index = sampling_list[top_n];
-        Dtype* bottom_slice = bottom_data + (bottom_n * bottom_channels + bottom_channel) * bottom_height * bottom_width;
-        // back, get the corresponding bottom index and do the job
-        const double scale = original_h * 1.0 / bottom_height;
-        const int x = sampling_index / original_h;
-        const int y = sampling_index % original_h;
-        const double r = x / scale + 1.0 / (2.0 * scale) - 0.5;
-        const double c = y / scale + 1.0 / (2.0 * scale) - 0.5;
-        const int u = floor(r);
-        const int v = floor(c);
-        double delta_r = r - u;
-        double delta_c = c - v;
-        if (u < 0)
-            delta_r = 1;
-        if (u + 1 >= bottom_width)
-            delta_r = 0;
-        if (v < 0)
-            delta_c = 1;
-        if (v + 1 >= bottom_height)
-            delta_c = 0;
-        // notice the boundary check
-        if ((1 - delta_r) * (1 - delta_c) != 0)
-            bottom_slice[u * bottom_width + v] += top_data[top_index] * (1 - delta_r) * (1 - delta_c);
-        if (delta_r * (1 - delta_c) != 0)
-            bottom_slice[(u+1) * bottom_width + v] += top_data[top_index] * delta_r * (1 - delta_c);
-        if (delta_c * (1 - delta_r) != 0)
-            bottom_slice[u * bottom_width + v + 1] += top_data[top_index] * delta_c * (1 - delta_r);
-        if (delta_r * delta_c != 0)
-            bottom_slice[(u+1) * bottom_width + v + 1] += top_data[top_index] * delta_r * delta_c;
+        Dtype* bottom_slice = bottom_data + (bottom_n * bottom_channels + bottom_channel) * bottom_size;
+        // back, get the corresponding bottom points from the sampling tables
+        const int h = sampling_index / original_w;
+        const int w = sampling_index % original_w;
+        const int r0 = row_index[h];
+        const int r1 = row_index[original_h + h];
+        const int c0 = col_index[w];
+        const int c1 = col_index[original_w + w];
+        const Dtype delta_h = row_weight[h];
+        const Dtype delta_w = col_weight[w];
+        const Dtype diff = top_data[top_index];
+        bottom_slice[r0 + c0] += diff * (1 - delta_w) * (1 - delta_h);
+        if (delta_w != 0)
+            bottom_slice[r0 + c1] += diff * (1 - delta_h) * delta_w;
+        if (delta_h != 0)
+            bottom_slice[r1 + c0] += diff * delta_h * (1 - delta_w);
+        if (delta_w * delta_h != 0)
+            bottom_slice[r1 + c1] += diff * delta_h * delta_w;
     }
 }
 
@@ -172,21 +147,22 @@ void HyperColumnsLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
     // backward step, back the diff in top[0] to the bottom, except bottom[0]
     const Dtype *top_diff = top[0]->gpu_diff();
-    int top_channel_offset = 0;
+    const int* sample_list = sample_list_.gpu_data();
     for (int i = 1; i < bottom.size(); ++i) {
         Dtype* bottom_diff = bottom[i]->mutable_gpu_diff();
         caffe_gpu_set(bottom[i]->count(), Dtype(0.0), bottom_diff);
-        const int bottom_channels = bottom[i]->shape(1);
-        const int bottom_height = bottom[i]->shape(2);
-        const int bottom_width = bottom[i]->shape(3);
+        const int bottom_channels = channels_[i];
+        const int bottom_size = height_[i] * width_[i];
         const int nthreads = N_ * sample_num_ * bottom_channels;
         BackwardHypercolumns<Dtype><<<CAFFE_GET_BLOCKS(nthreads), CAFFE_CUDA_NUM_THREADS>>>(
-        nthreads, bottom_diff, N_, bottom_channels, bottom_height, bottom_width, sample_num_,
-        total_channels_, top_channel_offset, cuda_samplelist_, H_, top_diff
+        nthreads, bottom_diff, bottom_channels, bottom_size, sample_num_,
+        total_channels_, channel_offset_[i], sample_list, H_, W_,
+        row_index_.gpu_data() + row_index_.offset(i), row_weight_.gpu_data() + row_weight_.offset(i),
+        col_index_.gpu_data() + col_index_.offset(i), col_weight_.gpu_data() + col_weight_.offset(i),
+        top_diff
         );
-        top_channel_offset += bottom_channels;
     }
-
+    CUDA_POST_KERNEL_CHECK;
 }
 
 INSTANTIATE_LAYER_GPU_FUNCS(HyperColumnsLayer);
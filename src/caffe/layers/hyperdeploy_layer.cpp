@@ -5,71 +5,12 @@
 	> Created Time: 2016年09月12日 星期一 12时15分28秒
  ************************************************************************/
 #include <vector>
-#include <map>
-#include <cmath>
-#include <algorithm>
 
 #include "caffe/layers/hyperdeploy_layer.hpp"
+#include "caffe/util/bilinear.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
-template <typename Dtype>
-void HyperDeployLayer<Dtype>::get_map_point(std::map<int, double>& result,
-        int out_index, const vector<int>& original_map_size) {
-    /***
-     * This function uses the bilinear interpolation to locate the corresponding
-     * point in the original feature map with their corresponding weights.
-     * note, since the orinal size is known, represents the coordinates by a single
-     * value
-     * */
-   double scale = H_ / original_map_size[0];
-   int x = out_index / H_;
-   int y = out_index % H_;
-   int h = original_map_size[0];
-   int w = original_map_size[1];
-   double r = x / scale + 1.0 / (2.0 * scale) - 0.5;
-   double c = y / scale + 1.0 / (2.0 * scale) - 0.5;
-   int u = floor(r);
-   int v = floor(c);
-   double delta_r = r - u;
-   double delta_c = c - v;
-   if (u < 0)
-       delta_r = 1;
-   if (u + 1 >= h)
-       delta_r = 0;
-   if (v < 0)
-       delta_c = 1;
-   if (v + 1 >= w)
-       delta_c = 0;
-   result.clear();
-   if ((1-delta_r) * (1-delta_c) != 0)
-       result.insert(std::make_pair(u * w + v, 
-                   (1-delta_r)* (1-delta_c)));
-   if (delta_r * (1-delta_c) != 0)
-       result.insert(std::make_pair((u+1)*w + v,
-                   delta_r * (1-delta_c)));
-   if (delta_c * (1-delta_r) != 0)
-       result.insert(std::make_pair(u * w + v + 1,
-                   delta_c * (1-delta_r)));
-   if (delta_r * delta_c != 0)
-       result.insert(std::make_pair((u+1)*w + v + 1,
-                   delta_r * delta_c));
-
-}
-
-
-template <typename Dtype>
-void HyperDeployLayer<Dtype>::generate_list(vector<int>& result, 
-        const Blob<Dtype>* feature_map, int batch) {
-    int h = feature_map->shape(2);
-    int w = feature_map->shape(3);
-    vector<int> holds(h * w);
-    for (int i = 0; i < holds.size(); ++i) {
-        holds[i] = i;
-    }
-    result = holds;
-}
-
 
 template <typename Dtype>
 void HyperDeployLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
@@ -77,7 +18,13 @@ void HyperDeployLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     // setup layer params. note that the hypercolumns is M * K. where M is the sampled point,
     // K is the feature length.
     // bottom: normal_map, conv1_2, conv2_2, conv3_3, conv4_3, conv5_3, fc-conv7. length of 7
-    // top: top[0] hypercolumns, top[1] the corresponding sampled normal point
+    // top: top[0] hypercolumns, every point of the normal map is sampled
+}
+
+
+template <typename Dtype>
+void HyperDeployLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+        const vector<Blob<Dtype>*>& top) {
     const Blob<Dtype>* normal_map = bottom[0];
     N_ = normal_map->shape(0);
     K_ = normal_map->shape(1);
@@ -89,12 +36,31 @@ void HyperDeployLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
         channel += bottom[i]->shape(1);
     }
     total_channels_ = channel;
-}
-
+    /***
+     * the bilinear interpolation locating the corresponding point of every
+     * output point in each feature map only depends on the shapes, so it is
+     * done once here instead of per point and per forward
+     * */
+    const int num_bottom = bottom.size();
+    row_index_.Reshape(num_bottom, 2, H_, 1);
+    col_index_.Reshape(num_bottom, 2, W_, 1);
+    row_weight_.Reshape(num_bottom, H_, 1, 1);
+    col_weight_.Reshape(num_bottom, W_, 1, 1);
+    for (int b = 0; b < num_bottom; ++b) {
+        const int h = bottom[b]->shape(2);
+        const int w = bottom[b]->shape(3);
+        const int scale = H_ / h;
+        int* row_index = row_index_.mutable_cpu_data() + row_index_.offset(b);
+        int* col_index = col_index_.mutable_cpu_data() + col_index_.offset(b);
+        bilinear_axis_table(H_, h, scale, row_index, row_index + H_,
+            row_weight_.mutable_cpu_data() + row_weight_.offset(b));
+        bilinear_axis_table(W_, w, scale, col_index, col_index + W_,
+            col_weight_.mutable_cpu_data() + col_weight_.offset(b));
+        for (int i = 0; i < 2 * H_; ++i) {
+            row_index[i] *= w;
+        }
+    }
 
-template <typename Dtype>
-void HyperDeployLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
-        const vector<Blob<Dtype>*>& top) {
     // reshape the top
     // top[0] is the hypercolumns, which is M * K, where M = sample_num_ * N, K = channels_
     vector<int> top_shape;
@@ -112,48 +78,49 @@ void HyperDeployLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
         const vector<Blob<Dtype>*>& top) {
     // forward step
     Dtype* top_hypercolumns = top[0]->mutable_cpu_data();
-    vector<int> sampling_list;
-    caffe_set(top[0]->count(), Dtype(0), top_hypercolumns);
+    const int* row_index = row_index_.cpu_data();
+    const int* col_index = col_index_.cpu_data();
+    const Dtype* row_weight = row_weight_.cpu_data();
+    const Dtype* col_weight = col_weight_.cpu_data();
 
-    // for each batch, do the sampling job
+    // for each batch, every point of the normal map is sampled
+    int top_index = 0;
     for (int n = 0; n < N_; ++n) {
-        generate_list(sampling_list, bottom[0], n);
-        // for every sampling point
-        for (int id = 0; id < sampling_list.size(); ++id) {
-            const int index = sampling_list[id];
-            // hyperfeature next
-            int hyper_channel = 0;
-            for (int bottom_id = 0; bottom_id < bottom.size(); ++bottom_id) {
-                const Dtype* bottom_data = bottom[bottom_id]->cpu_data();
-                const int channel = bottom[bottom_id]->shape(1);
-                // get the correponding point in the corresponding bottom
-                vector<int> original_size;
-                original_size.push_back(bottom[bottom_id]->shape(2));
-                original_size.push_back(bottom[bottom_id]->shape(3));
-                std::map<int, double> weights;
-                get_map_point(weights, index, original_size);
-                // for debug usage, output the last and first to check
-                /**
-                LOG(INFO) << "for sample point " << id ;
-                for (std::map<int, double>::iterator iter = weights.begin(); iter != weights.end(); ++iter) {
-                    LOG(INFO) << "the coresponding to bottom " << bottom_id << " point is " << iter->first << " weights is " << iter->second << std::endl;
-                }
-                **/
-                for (int c = 0; c < channel; ++c){
-                    // compute the value, according to the point
-                    double value = 0;
-                    for (std::map<int, double>::iterator iter = weights.begin(); iter != weights.end(); ++iter) {
-                        const int bottom_index = bottom[bottom_id]->offset(n, c) + iter->first;
-                        value += bottom_data[bottom_index] * iter->second;
+        for (int h = 0; h < H_; ++h) {
+            for (int w = 0; w < W_; ++w) {
+                // hyperfeature next
+                for (int bottom_id = 0; bottom_id < bottom.size(); ++bottom_id) {
+                    const int channel = bottom[bottom_id]->shape(1);
+                    const int padding = bottom[bottom_id]->count(2);
+                    const Dtype* bottom_data = bottom[bottom_id]->cpu_data()
+                        + bottom[bottom_id]->offset(n);
+                    // get the correponding point in the corresponding bottom
+                    const int* rows = row_index + bottom_id * 2 * H_;
+                    const int* cols = col_index + bottom_id * 2 * W_;
+                    const Dtype delta_h = row_weight[bottom_id * H_ + h];
+                    const Dtype delta_w = col_weight[bottom_id * W_ + w];
+                    const Dtype weight1 = (1 - delta_h) * (1 - delta_w);
+                    const Dtype weight2 = (1 - delta_h) * delta_w;
+                    const Dtype weight3 = delta_h * (1 - delta_w);
+                    const Dtype weight4 = delta_h * delta_w;
+                    int offset1 = rows[h] + cols[w];
+                    int offset2 = rows[h] + cols[W_ + w];
+                    int offset3 = rows[H_ + h] + cols[w];
+                    int offset4 = rows[H_ + h] + cols[W_ + w];
+                    for (int c = 0; c < channel; ++c) {
+                        // compute the value, according to the point
+                        top_hypercolumns[top_index++] =
+                            bottom_data[offset1] * weight1 + bottom_data[offset2] * weight2 +
+                            bottom_data[offset3] * weight3 + bottom_data[offset4] * weight4;
+                        offset1 += padding;
+                        offset2 += padding;
+                        offset3 += padding;
+                        offset4 += padding;
                     }
-                    const int top_index = top[0]->offset(n * sample_num_  + id, hyper_channel);
-                    top_hypercolumns[top_index] = value;
-                    ++hyper_channel;
                 }
             }
         }
     }
-   // LOG(INFO) << "forward done";
 }
 
 template <typename Dtype>
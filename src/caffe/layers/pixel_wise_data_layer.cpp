@@ -5,8 +5,11 @@
 	> Created Time: 2016年06月03日 星期五 14时07分02秒
  ************************************************************************/
 #ifdef USE_OPENCV
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include <opencv2/core/core.hpp>
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <string>
@@ -20,6 +23,7 @@
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -71,18 +75,54 @@ void PixelWiseDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& botto
     vector<int> top_shape = this->data_transformer_->InferBlobShape(cv_img);
     vector<int> top_label_shape = top_shape;
     top_label_shape[1] = label_channel;
-    top_label_shape[2] = label_height;
-    top_label_shape[3] = label_width;
+    // unresized labels keep the size of their image
+    top_label_shape[2] = label_height > 0 ? label_height : top_shape[2];
+    top_label_shape[3] = label_width > 0 ? label_width : top_shape[3];
+    // crops cut the same window out of the label
+    if (this->layer_param_.transform_param().crop_size() > 0) {
+        top_label_shape[2] = top_shape[2];
+        top_label_shape[3] = top_shape[3];
+    }
+    // image and label of one size share a single transform pass
+    joint_transform_ = top_label_shape[2] == top_shape[2] &&
+        top_label_shape[3] == top_shape[3];
     this->transformed_data_.Reshape(top_shape);
     this->transformed_label_.Reshape(top_label_shape);
+    top_shape_ = top_shape;
+    top_label_shape_ = top_label_shape;
     // reshape prefetch_data and top[0], top[1] according to the batch_size
     const int batch_size = this->layer_param_.pixel_wise_data_param().batch_size();
     CHECK_GT(batch_size, 0) << "Positive batch size required";
+    // the decode workers. each one gets a transformer of its own, since the
+    // transformers keep random and mean state, seeded here from Caffe's RNG
+    const int decode_threads = std::min<int>(batch_size,
+            std::max<int>(1, this->layer_param_.pixel_wise_data_param().decode_threads()));
+    decode_pool_.reset(new ThreadPool(decode_threads));
+    transformers_.clear();
+    worker_data_.clear();
+    worker_label_.clear();
+    for (int i = 0; i < decode_threads; ++i) {
+        if (i == 0) {
+            transformers_.push_back(this->data_transformer_);
+        } else {
+            transformers_.push_back(shared_ptr<DataTransformer<Dtype> >(
+                new DataTransformer<Dtype>(this->transform_param_, this->phase_)));
+            transformers_[i]->InitRand();
+        }
+        worker_data_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(top_shape)));
+        worker_label_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(top_label_shape)));
+    }
+    worker_read_us_.assign(decode_threads, 0);
+    worker_trans_us_.assign(decode_threads, 0);
+    times_mutex_.reset(new boost::mutex());
+    times_.batches = 0;
+    times_.batch_ms = times_.read_ms = times_.transform_ms = 0;
+    LOG(INFO) << "Decoding with " << decode_threads << " threads";
     top_shape[0] = batch_size;
     top_label_shape[0] = batch_size;
-    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-        this->prefetch_[i].data_.Reshape(top_shape);
-        this->prefetch_[i].label_.Reshape(top_label_shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+        this->prefetch_[i]->data_.Reshape(top_shape);
+        this->prefetch_[i]->label_.Reshape(top_label_shape);
     }
     top[0]->Reshape(top_shape);
     top[1]->Reshape(top_label_shape);
@@ -101,88 +141,142 @@ void PixelWiseDataLayer<Dtype>::ShuffleImages() {
     shuffle(lines_.begin(), lines_.end(), prefetch_rng);
 }
 
+template <typename Dtype>
+typename PixelWiseDataLayer<Dtype>::PrefetchTimes
+PixelWiseDataLayer<Dtype>::prefetch_times() const {
+    CHECK(times_mutex_) << "The layer is not set up";
+    boost::mutex::scoped_lock lock(*times_mutex_);
+    return times_;
+}
+
+// runs on the decode pool, called from the prefetch thread
+template <typename Dtype>
+void PixelWiseDataLayer<Dtype>::decode_items(int begin, int end,
+        Batch<Dtype>* batch, Dtype* prefetch_data, Dtype* prefetch_label) {
+    const PixelWiseDataParameter& pixel_wise_data_param = this->layer_param_.pixel_wise_data_param();
+    const int batch_size = pixel_wise_data_param.batch_size();
+    const int new_height = pixel_wise_data_param.new_height();
+    const int new_width = pixel_wise_data_param.new_width();
+    const bool is_color = pixel_wise_data_param.is_color();
+    const int label_channel = pixel_wise_data_param.label_channel();
+    const int label_height = pixel_wise_data_param.label_height() > 0 ? pixel_wise_data_param.label_height() : new_height;
+    const int label_width = pixel_wise_data_param.label_width() > 0 ? pixel_wise_data_param.label_width() : new_width;
+    const string& root_folder = pixel_wise_data_param.root_folder();
+    const int num_workers = transformers_.size();
+    CPUTimer timer;
+    for (int worker = begin; worker < end; ++worker) {
+        DataTransformer<Dtype>* transformer = transformers_[worker].get();
+        Blob<Dtype>* transformed_data = worker_data_[worker].get();
+        Blob<Dtype>* transformed_label = worker_label_[worker].get();
+        double read_time = 0;
+        double trans_time = 0;
+        for (int item_id = batch_size * worker / num_workers;
+                item_id < batch_size * (worker + 1) / num_workers; ++item_id) {
+            const std::pair<std::string, std::string>& line = batch_lines_[item_id];
+            timer.Start();
+            int rows, cols;
+            cv::Mat cv_img = ReadImageToCVMat(root_folder + line.first,
+                    new_height, new_width, is_color, rows, cols);
+            CHECK(cv_img.data) << "Could not load " << line.first;
+            cv::Mat cv_label = ReadLabelToCVMat(root_folder + line.second, rows, cols,
+                    label_height, label_width, label_channel);
+            CHECK(cv_label.data) << "Could not load " << line.second;
+            read_time += timer.MicroSeconds();
+            timer.Start();
+            // Apply transformations to the image and label
+            transformed_data->set_cpu_data(prefetch_data + batch->data_.offset(item_id));
+            transformed_label->set_cpu_data(prefetch_label + batch->label_.offset(item_id));
+            if (joint_transform_) {
+                transformer->TransformImgAndLabel(cv_img, cv_label,
+                        transformed_data, transformed_label);
+            } else {
+                bool do_mirror = transformer->TransformImg(cv_img, transformed_data);
+                transformer->TransformLabel(cv_label, transformed_label, do_mirror);
+            }
+            trans_time += timer.MicroSeconds();
+        }
+        worker_read_us_[worker] = read_time;
+        worker_trans_us_[worker] = trans_time;
+    }
+}
+
 // this function is called on prefetch thread
 template <typename Dtype>
 void PixelWiseDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     CPUTimer batch_timer;
     batch_timer.Start();
-    double read_time = 0;
-    double trans_time = 0;
-    CPUTimer timer;
     CHECK(batch->data_.count());
     CHECK(this->transformed_data_.count());
-    PixelWiseDataParameter pixel_wise_data_param = this->layer_param_.pixel_wise_data_param();
+    const PixelWiseDataParameter& pixel_wise_data_param = this->layer_param_.pixel_wise_data_param();
     const int batch_size = pixel_wise_data_param.batch_size();
-    const int new_height = pixel_wise_data_param.new_height();
-    const int new_width = pixel_wise_data_param.new_width();
-    const bool is_color = pixel_wise_data_param.is_color();
-    const int label_channel = pixel_wise_data_param.label_channel();
-    const int label_height = this->layer_param_.pixel_wise_data_param().label_height() > 0 ? this->layer_param_.pixel_wise_data_param().label_height() : new_height;
-    const int label_width = this->layer_param_.pixel_wise_data_param().label_width() > 0 ? this->layer_param_.pixel_wise_data_param().label_width() : new_width;
-    string root_folder = pixel_wise_data_param.root_folder();
-    //Reshape according to the first image of each batch
-    //on single input btaches allows for inputs of varying dimension.
-    cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-            new_height, new_width, is_color);
-    CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
-    vector<int> top_shape = this->data_transformer_->InferBlobShape(cv_img);
-    vector<int> top_label_shape = top_shape;
-    top_label_shape[1] = label_channel;
-    top_label_shape[2] = label_height;
-    top_label_shape[3] = label_width;	
-    this->transformed_data_.Reshape(top_shape);
-    this->transformed_label_.Reshape(top_label_shape);
+    const string& root_folder = pixel_wise_data_param.root_folder();
+    if (pixel_wise_data_param.variable_size()) {
+        //Reshape according to the first image of each batch
+        //on single input btaches allows for inputs of varying dimension.
+        cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
+                pixel_wise_data_param.new_height(), pixel_wise_data_param.new_width(),
+                pixel_wise_data_param.is_color());
+        CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
+        vector<int> top_shape = this->data_transformer_->InferBlobShape(cv_img);
+        top_shape_[2] = top_shape[2];
+        top_shape_[3] = top_shape[3];
+        if (pixel_wise_data_param.label_height() == 0 && pixel_wise_data_param.new_height() == 0) {
+            top_label_shape_[2] = top_shape[2];
+            top_label_shape_[3] = top_shape[3];
+        }
+        joint_transform_ = top_label_shape_[2] == top_shape_[2] &&
+            top_label_shape_[3] == top_shape_[3];
+    }
+    for (int i = 0; i < worker_data_.size(); ++i) {
+        worker_data_[i]->Reshape(top_shape_);
+        worker_label_[i]->Reshape(top_label_shape_);
+    }
     // Reshape batch according to the batch_size.
+    vector<int> top_shape = top_shape_;
+    vector<int> top_label_shape = top_label_shape_;
     top_shape[0] = batch_size;
     top_label_shape[0] = batch_size;
     batch->data_.Reshape(top_shape);
     batch->label_.Reshape(top_label_shape);
-    Dtype* prefetch_data = batch->data_.mutable_cpu_data();
-    Dtype* prefetch_label = batch->label_.mutable_cpu_data();
 
-    //datum scales
+    // pick the lines here, the shuffling must stay on this thread
     const long lines_size = lines_.size();
+    batch_lines_.clear();
     for (int item_id = 0; item_id < batch_size; ++item_id) {
-        // get a blob
-        timer.Start();
         CHECK_GT(lines_size, lines_id_);
-        int rows, cols;
-        cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-                new_height, new_width, is_color, rows, cols);
-
-	//LOG(INFO) << label_channel;
- 	cv::Mat cv_label = ReadLabelToCVMat(root_folder + lines_[lines_id_].second, rows, cols,
-                label_height, label_width, label_channel);
-	//LOG(INFO) << cv_label.channels();
-       // LOG(INFO) << cv_label.at<cv::Vec3f>(120,213)[1] << " outside";
-        CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
-        CHECK(cv_label.data) << "Could not load " << lines_[lines_id_].second;
-        // for debug
-        //LOG(INFO) << "load image " << lines_[lines_id_].first << " load the label " << lines_[lines_id_].second;
-        read_time += timer.MicroSeconds();
-        timer.Start();
-
-        // Apply transformations to the image and label
-        int offset = batch->data_.offset(item_id);
-        this->transformed_data_.set_cpu_data(prefetch_data + offset);
-        bool do_mirror = this->data_transformer_->TransformImg(cv_img, &(this->transformed_data_));
-
-
-        offset = batch->label_.offset(item_id);
-        this->transformed_label_.set_cpu_data(prefetch_label + offset);
-        this->data_transformer_->TransformLabel(cv_label, &(this->transformed_label_), do_mirror);
-        trans_time += timer.MicroSeconds();
+        batch_lines_.push_back(lines_[lines_id_]);
         // go to the next iter
         lines_id_++;
         if (lines_id_ >= lines_size) {
             DLOG(INFO) << "Restarting data prefetching from start.";
             lines_id_ = 0;
-            if (this->layer_param_.pixel_wise_data_param().shuffle()) {
+            if (pixel_wise_data_param.shuffle()) {
                 ShuffleImages();
             }
         }
     }
+    // the workers only write through these, they must not touch the heads
+    Dtype* prefetch_data = batch->data_.mutable_cpu_data();
+    Dtype* prefetch_label = batch->label_.mutable_cpu_data();
+    const int num_workers = transformers_.size();
+    decode_pool_->ParallelFor(num_workers, boost::bind(
+            &PixelWiseDataLayer<Dtype>::decode_items, this, _1, _2, batch,
+            prefetch_data, prefetch_label), num_workers);
+
     batch_timer.Stop();
+    double read_time = 0;
+    double trans_time = 0;
+    for (int i = 0; i < num_workers; ++i) {
+        read_time += worker_read_us_[i];
+        trans_time += worker_trans_us_[i];
+    }
+    {
+        boost::mutex::scoped_lock lock(*times_mutex_);
+        ++times_.batches;
+        times_.batch_ms += batch_timer.MilliSeconds();
+        times_.read_ms += read_time / 1000;
+        times_.transform_ms += trans_time / 1000;
+    }
     DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
     DLOG(INFO) << " Read time: " << read_time / 1000 << " ms.";
     DLOG(INFO) << "Transform time: " << trans_time / 1000<< " ms.";
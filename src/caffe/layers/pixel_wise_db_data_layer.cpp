@@ -0,0 +1,163 @@
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <vector>
+
+#include "caffe/data_transformer.hpp"
+#include "caffe/layers/pixel_wise_db_data_layer.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/io.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+PixelWiseDBDataLayer<Dtype>::PixelWiseDBDataLayer(const LayerParameter& param)
+  : BasePrefetchingDataLayer<Dtype>(param),
+    reader_(param) {
+}
+
+template <typename Dtype>
+PixelWiseDBDataLayer<Dtype>::~PixelWiseDBDataLayer() {
+  this->StopInternalThread();
+}
+
+template <typename Dtype>
+void PixelWiseDBDataLayer<Dtype>::InferShapes(const Datum& datum,
+    vector<int>* top_shape, vector<int>* top_label_shape) {
+  const PixelWiseDataParameter& param =
+      this->layer_param_.pixel_wise_data_param();
+  const int height = param.new_height() > 0 ? param.new_height()
+      : datum.height();
+  const int width = param.new_width() > 0 ? param.new_width()
+      : datum.width();
+  const int crop_size = this->layer_param_.transform_param().crop_size();
+  top_shape->resize(4);
+  (*top_shape)[0] = 1;
+  (*top_shape)[1] = param.is_color() ? 3 : 1;
+  (*top_shape)[2] = crop_size ? crop_size : height;
+  (*top_shape)[3] = crop_size ? crop_size : width;
+  // the label follows the image unless it has a size of its own
+  *top_label_shape = *top_shape;
+  (*top_label_shape)[1] = param.label_channel();
+  if (param.label_height() > 0 && param.label_width() > 0) {
+    (*top_label_shape)[2] = param.label_height();
+    (*top_label_shape)[3] = param.label_width();
+  }
+}
+
+template <typename Dtype>
+void PixelWiseDBDataLayer<Dtype>::DataLayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const int batch_size = this->layer_param_.data_param().batch_size();
+  CHECK_GT(batch_size, 0) << "Positive batch size required";
+  const PixelWiseDataParameter& param =
+      this->layer_param_.pixel_wise_data_param();
+  CHECK((param.new_height() == 0 && param.new_width() == 0) ||
+      (param.new_height() > 0 && param.new_width() > 0))
+      << "new_height and new_width should be set at the same time";
+  CHECK(this->layer_param_.transform_param().crop_size() == 0 ||
+      param.label_height() == 0) << "Crops need the label to follow the image";
+  // Read a data point, and use it to initialize the top blobs.
+  Datum& datum = reader_.full().peek()->datum;
+  vector<int> top_shape, top_label_shape;
+  InferShapes(datum, &top_shape, &top_label_shape);
+  this->transformed_data_.Reshape(top_shape);
+  this->transformed_label_.Reshape(top_label_shape);
+  // Reshape top and prefetch blobs according to the batch_size.
+  top_shape[0] = batch_size;
+  top_label_shape[0] = batch_size;
+  top[0]->Reshape(top_shape);
+  top[1]->Reshape(top_label_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape);
+    this->prefetch_[i]->label_.Reshape(top_label_shape);
+  }
+  LOG(INFO) << "output image data size: " << top[0]->num() << ","
+      << top[0]->channels() << "," << top[0]->height() << ","
+      << top[0]->width();
+  LOG(INFO) << "output label data size: " << top[1]->num() << ","
+      << top[1]->channels() << "," << top[1]->height() << ","
+      << top[1]->width();
+}
+
+// This function is called on prefetch thread
+template <typename Dtype>
+void PixelWiseDBDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
+  CPUTimer batch_timer;
+  batch_timer.Start();
+  double read_time = 0;
+  double trans_time = 0;
+  CPUTimer timer;
+  CHECK(batch->data_.count());
+  CHECK(this->transformed_data_.count());
+  const PixelWiseDataParameter& param =
+      this->layer_param_.pixel_wise_data_param();
+  const int batch_size = this->layer_param_.data_param().batch_size();
+
+  // Reshape according to the first datum of each batch
+  // on single input batches allows for inputs of varying dimension.
+  vector<int> top_shape, top_label_shape;
+  InferShapes(reader_.full().peek()->datum, &top_shape, &top_label_shape);
+  this->transformed_data_.Reshape(top_shape);
+  this->transformed_label_.Reshape(top_label_shape);
+  top_shape[0] = batch_size;
+  top_label_shape[0] = batch_size;
+  batch->data_.Reshape(top_shape);
+  batch->label_.Reshape(top_label_shape);
+  Dtype* top_data = batch->data_.mutable_cpu_data();
+  Dtype* top_label = batch->label_.mutable_cpu_data();
+  const bool joint = top_label_shape[2] == top_shape[2] &&
+      top_label_shape[3] == top_shape[3];
+
+  cv::Mat cv_img, cv_label, cv_resized;
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    timer.Start();
+    // get a datum, its label is viewed in place until it is handed back.
+    // The image is encoded, so never left in the DB by the reader.
+    DataReader::Item* item = reader_.full().pop("Waiting for data");
+    const Datum& datum = item->datum;
+    CHECK(DecodePixelWiseDatum(datum, param.label_channel(), param.is_color(),
+        &cv_img, &cv_label)) << "Could not decode datum " << item_id;
+    read_time += timer.MicroSeconds();
+    timer.Start();
+    if (param.new_height() > 0 && (cv_img.rows != param.new_height() ||
+        cv_img.cols != param.new_width())) {
+      cv::resize(cv_img, cv_resized,
+          cv::Size(param.new_width(), param.new_height()));
+      cv_img = cv_resized;
+    }
+    // Apply transformations to the image and label
+    this->transformed_data_.set_cpu_data(top_data +
+        batch->data_.offset(item_id));
+    this->transformed_label_.set_cpu_data(top_label +
+        batch->label_.offset(item_id));
+    if (joint) {
+      // the label is mapped onto the image whatever its stored size
+      this->data_transformer_->TransformImgAndLabel(cv_img, cv_label,
+          &(this->transformed_data_), &(this->transformed_label_));
+    } else {
+      cv::Mat label_resized;
+      cv::resize(cv_label, label_resized,
+          cv::Size(top_label_shape[3], top_label_shape[2]));
+      const bool do_mirror = this->data_transformer_->TransformImg(cv_img,
+          &(this->transformed_data_));
+      this->data_transformer_->TransformLabel(label_resized,
+          &(this->transformed_label_), do_mirror);
+    }
+    trans_time += timer.MicroSeconds();
+
+    reader_.free().push(item);
+  }
+  timer.Stop();
+  batch_timer.Stop();
+  DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
+  DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
+  DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+}
+
+INSTANTIATE_CLASS(PixelWiseDBDataLayer);
+REGISTER_LAYER_CLASS(PixelWiseDBData);
+
+}  // namespace caffe
+#endif  // USE_OPENCV
@@ -19,6 +19,8 @@ void SplitLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
         "allow in-place computation.";
     top[i]->ReshapeLike(*bottom[0]);
     CHECK_EQ(count_, top[i]->count());
+    // share already, so that the tops alias the bottom from setup on
+    top[i]->ShareData(*bottom[0]);
   }
 }
 
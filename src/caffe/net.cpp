@@ -1,6 +1,9 @@
 #include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
+#include <iomanip>
 #include <map>
 #include <set>
+#include <sstream>
 #include <string>
 #include <utility>
 #include <vector>
@@ -57,6 +60,8 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   map<string, int> blob_name_to_idx;
   set<string> available_blobs;
   memory_used_ = 0;
+  planned_memory_ = 0;
+  workspace_.reset(new Workspace());
   // For each layer, set up its input and output
   bottom_vecs_.resize(param.layer_size());
   top_vecs_.resize(param.layer_size());
@@ -136,6 +141,7 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
             << layer_param.name();
       }
     } else {
+      layers_[layer_id]->set_workspace(workspace_);
       layers_[layer_id]->SetUp(bottom_vecs_[layer_id], top_vecs_[layer_id]);
     }
     LOG_IF(INFO, Caffe::root_solver())
@@ -179,6 +185,8 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
       }
     }
   }
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Memory required for the shared workspace: " << workspace_->size();
   // Go through the net backwards to determine which blobs contribute to the
   // loss.  We can skip backward computation for blobs that don't contribute
   // to the loss.
@@ -270,10 +278,160 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
   ShareWeights();
+  // Only the training net is updated, and worker nets get the memory of
+  // their params from the parallel Params.
+  if (param.flat_params() && phase_ == TRAIN && Caffe::root_solver()) {
+    FlattenParams();
+  }
   debug_info_ = param.debug_info();
+  profile_ = false;
+  set_profile(param.profile());
+  trace_transfers_ = param.trace_transfers();
+  set_sync_check(param.sync_check());
+  if (param.plan_memory()) {
+    if (phase_ == TEST) {
+      PlanMemory();
+    } else {
+      LOG(WARNING) << "plan_memory is only for TEST nets; ignored.";
+    }
+  }
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
 
+template <typename Dtype>
+void Net<Dtype>::PlanMemory() {
+  // Blobs sharing their data (split, flatten, reshape, in-place layers) are
+  // planned together, as one activation living from its first write to its
+  // last read in the forward pass.
+  map<SyncedMemory*, int> activation_of;
+  vector<vector<int> > activation_blobs;
+  vector<int> first_layer, last_layer;
+  vector<size_t> activation_bytes;
+  vector<bool> pinned;
+  vector<int> activation_of_blob(blobs_.size(), -1);
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    if (blobs_[blob_id]->count() == 0) {
+      continue;
+    }
+    SyncedMemory* memory = blobs_[blob_id]->data().get();
+    if (activation_of.find(memory) == activation_of.end()) {
+      activation_of[memory] = activation_blobs.size();
+      activation_blobs.push_back(vector<int>());
+      first_layer.push_back(layers_.size());
+      last_layer.push_back(-1);
+      activation_bytes.push_back(0);
+      pinned.push_back(false);
+    }
+    const int a = activation_of[memory];
+    activation_of_blob[blob_id] = a;
+    activation_blobs[a].push_back(blob_id);
+    activation_bytes[a] = std::max(activation_bytes[a],
+        blobs_[blob_id]->count() * sizeof(Dtype));
+  }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int a = activation_of_blob[top_id_vecs_[layer_id][i]];
+      if (a < 0) {
+        continue;
+      }
+      first_layer[a] = std::min(first_layer[a], layer_id);
+      last_layer[a] = std::max(last_layer[a], layer_id);
+      // the data and input layers may fill their tops once for all
+      pinned[a] = pinned[a] || bottom_id_vecs_[layer_id].empty();
+    }
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+      const int a = activation_of_blob[bottom_id_vecs_[layer_id][i]];
+      if (a >= 0) {
+        last_layer[a] = std::max(last_layer[a], layer_id);
+      }
+    }
+  }
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    const int a = activation_of_blob[net_input_blob_indices_[i]];
+    if (a >= 0) {
+      pinned[a] = true;
+    }
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    const int a = activation_of_blob[net_output_blob_indices_[i]];
+    if (a >= 0) {
+      pinned[a] = true;
+    }
+  }
+  // Greedy first come assignment: each activation takes the free buffer
+  // closest above its size, or else grows the largest free buffer, or else
+  // gets a new one. A buffer is free once the last reader of its previous
+  // activation has run.
+  vector<pair<int, int> > order;
+  for (int a = 0; a < activation_blobs.size(); ++a) {
+    if (!pinned[a] && first_layer[a] < layers_.size()) {
+      order.push_back(std::make_pair(first_layer[a], a));
+    }
+  }
+  std::sort(order.begin(), order.end());
+  vector<size_t> buffer_bytes;
+  vector<int> buffer_free_after;
+  vector<int> buffer_of(activation_blobs.size(), -1);
+  size_t naive_bytes = 0;
+  for (int i = 0; i < order.size(); ++i) {
+    const int a = order[i].second;
+    const size_t bytes = activation_bytes[a];
+    naive_bytes += bytes;
+    int best = -1;
+    for (int b = 0; b < buffer_bytes.size(); ++b) {
+      if (buffer_free_after[b] >= first_layer[a]) {
+        continue;
+      }
+      if (best < 0) {
+        best = b;
+      } else if (buffer_bytes[best] < bytes) {
+        // grow as little as possible: take the largest
+        if (buffer_bytes[b] > buffer_bytes[best]) {
+          best = b;
+        }
+      } else if (buffer_bytes[b] >= bytes &&
+          buffer_bytes[b] < buffer_bytes[best]) {
+        best = b;
+      }
+    }
+    if (best < 0) {
+      best = buffer_bytes.size();
+      buffer_bytes.push_back(0);
+      buffer_free_after.push_back(-1);
+    }
+    buffer_bytes[best] = std::max(buffer_bytes[best], bytes);
+    buffer_free_after[best] = last_layer[a];
+    buffer_of[a] = best;
+  }
+  memory_arena_.clear();
+  planned_memory_ = 0;
+  for (int b = 0; b < buffer_bytes.size(); ++b) {
+    memory_arena_.push_back(
+        shared_ptr<SyncedMemory>(new SyncedMemory(buffer_bytes[b])));
+    planned_memory_ += buffer_bytes[b];
+  }
+  for (int a = 0; a < activation_blobs.size(); ++a) {
+    if (buffer_of[a] < 0) {
+      continue;
+    }
+    // the blobs of an activation share the one SyncedMemory
+    const shared_ptr<SyncedMemory>& memory =
+        blobs_[activation_blobs[a][0]]->data();
+    if (Caffe::mode() == Caffe::CPU) {
+      memory->set_cpu_data(memory_arena_[buffer_of[a]]->mutable_cpu_data());
+    } else {
+#ifndef CPU_ONLY
+      memory->set_gpu_data(memory_arena_[buffer_of[a]]->mutable_gpu_data());
+#else
+      NO_GPU;
+#endif
+    }
+  }
+  LOG_IF(INFO, Caffe::root_solver()) << "Memory plan: " << order.size()
+      << " activations in " << buffer_bytes.size() << " buffers, "
+      << planned_memory_ << " bytes instead of " << naive_bytes;
+}
+
 template <typename Dtype>
 void Net<Dtype>::FilterNet(const NetParameter& param,
     NetParameter* param_filtered) {
@@ -538,7 +696,11 @@ Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   Dtype loss = 0;
   for (int i = start; i <= end; ++i) {
    // LOG(INFO) << "Forwarding " << layer_names_[i];
+    if (profile_) { ProfileStart(); }
+    if (watch_transfers_) { TransfersStart(i); }
     Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+    if (watch_transfers_) { TransfersStop(i); }
+    if (profile_) { ProfileStop(i, false); }
     loss += layer_loss;
     if (debug_info_) { ForwardDebugInfo(i); }
   }
@@ -583,13 +745,230 @@ void Net<Dtype>::BackwardFromTo(int start, int end) {
   CHECK_LT(start, layers_.size());
   for (int i = start; i >= end; --i) {
     if (layer_need_backward_[i]) {
+      if (profile_) { ProfileStart(); }
+      if (watch_transfers_) { TransfersStart(i); }
       layers_[i]->Backward(
           top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
+      if (watch_transfers_) { TransfersStop(i); }
+      if (profile_) { ProfileStop(i, true); }
       if (debug_info_) { BackwardDebugInfo(i); }
     }
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::set_profile(const bool value) {
+  if (value && !profile_timer_) {
+    profile_timer_.reset(new Timer());
+    ResetProfile();
+  }
+  profile_ = value;
+}
+
+template <typename Dtype>
+void Net<Dtype>::ResetProfile() {
+  layer_profiles_.assign(layers_.size(), LayerProfile());
+  trace_.clear();
+  profile_epoch_ = boost::posix_time::microsec_clock::local_time();
+}
+
+template <typename Dtype>
+void Net<Dtype>::ProfileStart() {
+  profile_stats_ = SyncedMemory::thread_stats();
+  profile_start_us_ = (boost::posix_time::microsec_clock::local_time() -
+      profile_epoch_).total_microseconds();
+  profile_timer_->Start();
+}
+
+template <typename Dtype>
+void Net<Dtype>::ProfileStop(const int layer_id, const bool backward) {
+  // stops the timer, after the GPU is done
+  const double duration_us = profile_timer_->MicroSeconds();
+  LayerProfile& profile = layer_profiles_[layer_id];
+  if (backward) {
+    ++profile.backward_calls;
+    profile.backward_ms += duration_us / 1000;
+  } else {
+    ++profile.forward_calls;
+    profile.forward_ms += duration_us / 1000;
+    profile.forward_flops = layers_[layer_id]->ForwardFlops(
+        bottom_vecs_[layer_id], top_vecs_[layer_id]);
+  }
+  const SyncedMemoryStats& stats = SyncedMemory::thread_stats();
+  profile.malloc_bytes += stats.cpu_malloc_bytes + stats.gpu_malloc_bytes -
+      profile_stats_.cpu_malloc_bytes - profile_stats_.gpu_malloc_bytes;
+  profile.to_gpu_copies += stats.to_gpu_copies - profile_stats_.to_gpu_copies;
+  profile.to_gpu_bytes += stats.to_gpu_bytes - profile_stats_.to_gpu_bytes;
+  profile.to_cpu_copies += stats.to_cpu_copies - profile_stats_.to_cpu_copies;
+  profile.to_cpu_bytes += stats.to_cpu_bytes - profile_stats_.to_cpu_bytes;
+  // bounds the trace of long runs, to about 24MB
+  const size_t kMaxTraceEvents = 1 << 20;
+  if (trace_.size() < kMaxTraceEvents) {
+    TraceEvent event;
+    event.layer_id = layer_id;
+    event.backward = backward;
+    event.start_us = profile_start_us_;
+    event.duration_us = duration_us;
+    trace_.push_back(event);
+    if (trace_.size() == kMaxTraceEvents) {
+      LOG(WARNING) << "The trace of net " << name_ << " is full; the layer "
+          << "profiles go on.";
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::LogProfile() const {
+  LOG(INFO) << "Average layer times of net " << name_ << ":";
+  for (int i = 0; i < layer_profiles_.size(); ++i) {
+    const LayerProfile& profile = layer_profiles_[i];
+    if (profile.forward_calls == 0 && profile.backward_calls == 0) {
+      continue;
+    }
+    const double forward_ms = profile.forward_calls ?
+        profile.forward_ms / profile.forward_calls : 0;
+    const double backward_ms = profile.backward_calls ?
+        profile.backward_ms / profile.backward_calls : 0;
+    LOG(INFO) << std::setfill(' ') << std::setw(10) << layer_names_[i]
+        << "\tforward: " << forward_ms << " ms, "
+        << (forward_ms ? profile.forward_flops / forward_ms / 1e6 : 0)
+        << " GFLOP/s\tbackward: " << backward_ms << " ms\tallocated: "
+        << profile.malloc_bytes << " B\tcopies to GPU: "
+        << profile.to_gpu_copies << " (" << profile.to_gpu_bytes
+        << " B), to CPU: " << profile.to_cpu_copies << " ("
+        << profile.to_cpu_bytes << " B)";
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::set_sync_check(const NetParameter_SyncCheck value) {
+  sync_check_ = value;
+  watch_transfers_ = trace_transfers_ ||
+      sync_check_ != NetParameter_SyncCheck_SYNC_IGNORE;
+}
+
+template <typename Dtype>
+void Net<Dtype>::set_trace_transfers(const bool value) {
+  trace_transfers_ = value;
+  set_sync_check(sync_check_);
+}
+
+template <typename Dtype>
+void Net<Dtype>::TransfersStart(const int layer_id) {
+  // only the GPU mode stalls on the copies
+  SyncedMemory::set_transfer_context(&layer_names_[layer_id],
+      trace_transfers_ ? &layer_transfers_ : NULL,
+      Caffe::mode() == Caffe::GPU ? sync_check_ :
+      NetParameter_SyncCheck_SYNC_IGNORE);
+}
+
+// Names memory after blob if it is its data or diff.
+template <typename Dtype>
+static void NameMemory(const SyncedMemory* memory, const Blob<Dtype>& blob,
+    const string& name, string* memory_name) {
+  if (blob.count() == 0) {
+    return;
+  }
+  if (memory == blob.data().get()) {
+    *memory_name = name;
+  } else if (memory == blob.diff().get()) {
+    *memory_name = name + " diff";
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::TransfersStop(const int layer_id) {
+  SyncedMemory::set_transfer_context(NULL, NULL,
+      NetParameter_SyncCheck_SYNC_IGNORE);
+  for (int i = 0; i < layer_transfers_.size(); ++i) {
+    const SyncedMemoryTransfer& transfer = layer_transfers_[i];
+    // the blobs of the layer, or its own buffers
+    string blob = "(internal)";
+    for (int j = 0; j < bottom_vecs_[layer_id].size(); ++j) {
+      NameMemory(transfer.memory, *bottom_vecs_[layer_id][j],
+          blob_names_[bottom_id_vecs_[layer_id][j]], &blob);
+    }
+    for (int j = 0; j < top_vecs_[layer_id].size(); ++j) {
+      NameMemory(transfer.memory, *top_vecs_[layer_id][j],
+          blob_names_[top_id_vecs_[layer_id][j]], &blob);
+    }
+    const vector<shared_ptr<Blob<Dtype> > >& params =
+        layers_[layer_id]->blobs();
+    for (int j = 0; j < params.size(); ++j) {
+      std::ostringstream name;
+      name << layer_names_[layer_id] << " param " << j;
+      NameMemory(transfer.memory, *params[j], name.str(), &blob);
+    }
+    int k = 0;
+    while (k < transfers_.size() && (transfers_[k].layer !=
+        layer_names_[layer_id] || transfers_[k].blob != blob ||
+        transfers_[k].to_gpu != transfer.to_gpu)) {
+      ++k;
+    }
+    if (k == transfers_.size()) {
+      BlobTransfers transfers;
+      transfers.layer = layer_names_[layer_id];
+      transfers.blob = blob;
+      transfers.to_gpu = transfer.to_gpu;
+      transfers.copies = 0;
+      transfers.bytes = 0;
+      transfers_.push_back(transfers);
+    }
+    ++transfers_[k].copies;
+    transfers_[k].bytes += transfer.bytes;
+  }
+  layer_transfers_.clear();
+}
+
+template <typename Dtype>
+void Net<Dtype>::LogTransfers() const {
+  LOG(INFO) << "Blob copies between host and device in net " << name_ << ":";
+  for (int i = 0; i < transfers_.size(); ++i) {
+    const BlobTransfers& transfers = transfers_[i];
+    LOG(INFO) << std::setfill(' ') << std::setw(10) << transfers.layer
+        << "\t" << transfers.blob << (transfers.to_gpu ? " to GPU: " :
+        " to CPU: ") << transfers.copies << " copies, " << transfers.bytes
+        << " B";
+  }
+  const SyncedMemoryStats stats = SyncedMemory::global_stats();
+  LOG(INFO) << "All copies of the process, to GPU: " << stats.to_gpu_copies
+      << " (" << stats.to_gpu_bytes << " B), to CPU: " << stats.to_cpu_copies
+      << " (" << stats.to_cpu_bytes << " B)";
+}
+
+// Quotes a string for JSON.
+static string JsonString(const string& value) {
+  string quoted = "\"";
+  for (int i = 0; i < value.size(); ++i) {
+    if (value[i] == '"' || value[i] == '\\') {
+      quoted += '\\';
+    }
+    quoted += value[i];
+  }
+  return quoted + "\"";
+}
+
+template <typename Dtype>
+void Net<Dtype>::WriteChromeTrace(const string& filename) const {
+  std::ofstream out(filename.c_str());
+  CHECK(out) << "Unable to write the trace to " << filename;
+  out << std::fixed << std::setprecision(3);
+  out << "{\"traceEvents\":[\n{\"name\":\"process_name\",\"ph\":\"M\","
+      << "\"pid\":0,\"args\":{\"name\":" << JsonString(name_) << "}}";
+  for (int i = 0; i < trace_.size(); ++i) {
+    const TraceEvent& event = trace_[i];
+    out << ",\n{\"name\":" << JsonString(layer_names_[event.layer_id])
+        << ",\"cat\":\"" << (event.backward ? "backward" : "forward")
+        << "\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":" << event.start_us
+        << ",\"dur\":" << event.duration_us << ",\"args\":{\"type\":"
+        << JsonString(layers_[event.layer_id]->type()) << "}}";
+  }
+  out << "\n]}\n";
+  CHECK(out) << "Unable to write the trace to " << filename;
+  LOG(INFO) << "Wrote " << trace_.size() << " layer calls of net " << name_
+      << " to " << filename;
+}
+
 template <typename Dtype>
 void Net<Dtype>::ForwardDebugInfo(const int layer_id) {
   for (int top_id = 0; top_id < top_vecs_[layer_id].size(); ++top_id) {
@@ -856,7 +1235,8 @@ void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
 }
 
 template <typename Dtype>
-void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
+void Net<Dtype>::ToHDF5(const string& filename, bool write_diff,
+    int compression_level) const {
   hid_t file_hid = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
       H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
@@ -892,12 +1272,12 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
       if (param_owners_[net_param_id] == -1) {
         // Only save params that own themselves
         hdf5_save_nd_dataset<Dtype>(layer_data_hid, dataset_name.str(),
-            *params_[net_param_id]);
+            *params_[net_param_id], false, compression_level);
       }
       if (write_diff) {
         // Write diffs regardless of weight-sharing
         hdf5_save_nd_dataset<Dtype>(layer_diff_hid, dataset_name.str(),
-            *params_[net_param_id], true);
+            *params_[net_param_id], true, compression_level);
       }
     }
     H5Gclose(layer_data_hid);
@@ -912,8 +1292,61 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
   H5Fclose(file_hid);
 }
 
+template <typename Dtype>
+void Net<Dtype>::FlattenParams() {
+  int count = 0;
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    count += learnable_params_[i]->count();
+  }
+  if (count == 0) { return; }
+  flat_params_.reset(new Blob<Dtype>(vector<int>(1, count)));
+  Dtype* data = flat_params_->mutable_cpu_data();
+  Dtype* diff = flat_params_->mutable_cpu_diff();
+  caffe_set(count, Dtype(0), diff);
+  // Sharers hold the SyncedMemory of their owner, and follow it.
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    Blob<Dtype>* blob = learnable_params_[i];
+    caffe_copy(blob->count(), blob->cpu_data(), data);
+    blob->data()->set_cpu_data(data);
+    blob->diff()->set_cpu_data(diff);
+    data += blob->count();
+    diff += blob->count();
+  }
+  LOG_IF(INFO, Caffe::root_solver()) << "Flattened "
+      << learnable_params_.size() << " learnable params, " << count
+      << " values";
+}
+
+template <typename Dtype>
+Blob<Dtype>* Net<Dtype>::flat_cpu_params() {
+  if (!flat_params_ || Caffe::mode() != Caffe::CPU) {
+    return NULL;
+  }
+  // Params may since have been given other memory, as by P2PSync, or have a
+  // newer copy on the GPU. Only look, so that the heads are not touched on
+  // every step.
+  const Dtype* data = flat_params_->cpu_data();
+  const Dtype* diff = flat_params_->cpu_diff();
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    Blob<Dtype>* blob = learnable_params_[i];
+    if (blob->data()->head() != SyncedMemory::HEAD_AT_CPU ||
+        blob->diff()->head() != SyncedMemory::HEAD_AT_CPU ||
+        blob->cpu_data() != data || blob->cpu_diff() != diff) {
+      return NULL;
+    }
+    data += blob->count();
+    diff += blob->count();
+  }
+  return flat_params_.get();
+}
+
 template <typename Dtype>
 void Net<Dtype>::Update() {
+  Blob<Dtype>* flat = flat_cpu_params();
+  if (flat) {
+    flat->Update();
+    return;
+  }
   for (int i = 0; i < learnable_params_.size(); ++i) {
     learnable_params_[i]->Update();
   }
@@ -921,6 +1354,11 @@ void Net<Dtype>::Update() {
 
 template <typename Dtype>
 void Net<Dtype>::ClearParamDiffs() {
+  Blob<Dtype>* flat = flat_cpu_params();
+  if (flat) {
+    caffe_set(flat->count(), Dtype(0), flat->mutable_cpu_diff());
+    return;
+  }
   for (int i = 0; i < learnable_params_.size(); ++i) {
     Blob<Dtype>* blob = learnable_params_[i];
     switch (Caffe::mode()) {
@@ -8,9 +8,11 @@
 #include <string>
 #include <vector>
 
+#include "boost/bind.hpp"
 #include "boost/thread.hpp"
 #include "caffe/caffe.hpp"
 #include "caffe/parallel.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -114,6 +116,42 @@ void GPUParams<Dtype>::configure(Solver<Dtype>* solver) const {
   apply_buffers(net, diff_, size_, replace_gpu_diff);
 }
 
+template<typename Dtype>
+CPUParams<Dtype>::CPUParams(shared_ptr<Solver<Dtype> > root_solver,
+                            Dtype* root_data)
+    : Params<Dtype>(root_solver),
+      own_data_(root_data == NULL) {
+  if (own_data_) {
+    CaffeMallocHost(reinterpret_cast<void**>(&data_), size_ * sizeof(Dtype),
+        &use_cuda_);
+    // Copy blob values
+    const vector<Blob<Dtype>*>& net =
+        root_solver->net()->learnable_params();
+    apply_buffers(net, data_, size_, copy);
+  } else {
+    data_ = root_data;
+  }
+  CaffeMallocHost(reinterpret_cast<void**>(&diff_), size_ * sizeof(Dtype),
+      &use_cuda_);
+  caffe_set(size_, Dtype(0), diff_);
+}
+
+template<typename Dtype>
+CPUParams<Dtype>::~CPUParams() {
+  if (own_data_) {
+    CaffeFreeHost(data_, use_cuda_);
+  }
+  CaffeFreeHost(diff_, use_cuda_);
+}
+
+template<typename Dtype>
+void CPUParams<Dtype>::configure(Solver<Dtype>* solver) const {
+  const vector<Blob<Dtype>*>& net =
+      solver->net()->learnable_params();
+  apply_buffers(net, data_, size_, replace_cpu);
+  apply_buffers(net, diff_, size_, replace_cpu_diff);
+}
+
 void DevicePair::compute(const vector<int> devices, vector<DevicePair>* pairs) {
 #ifndef CPU_ONLY
   vector<int> remaining(devices);
@@ -436,8 +474,125 @@ void P2PSync<Dtype>::Run(const vector<int>& gpus) {
   }
 }
 
+//
+
+template<typename Dtype>
+CPUSync<Dtype>::CPUSync(shared_ptr<Solver<Dtype> > root_solver,
+                        CPUSync<Dtype>* root, const SolverParameter& param,
+                        int rank)
+    : CPUParams<Dtype>(root_solver, root ? root->data_ : NULL),
+      root_(root),
+      rank_(rank),
+      solvers_(),
+      queue_(),
+      initial_iter_(root_solver->iter()),
+      solver_() {
+  if (root == NULL) {
+    solver_ = root_solver;
+  } else {
+    Caffe::set_root_solver(false);
+    solver_.reset(new WorkerSolver<Dtype>(param, root_solver.get()));
+    Caffe::set_root_solver(true);
+  }
+  this->configure(solver_.get());
+  solver_->add_callback(this);
+}
+
+template<typename Dtype>
+CPUSync<Dtype>::~CPUSync() {
+  // before solver_ goes away
+  StopInternalThread();
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::InternalThreadEntry() {
+  CHECK(Caffe::root_solver());
+  Caffe::set_root_solver(false);
+  // See if there is a defined seed and reset random state if so, different
+  // for every solver as on GPUs
+  if (solver_->param().random_seed() >= 0) {
+    Caffe::set_random_seed(solver_->param().random_seed() + rank_);
+  }
+  solver_->Step(solver_->param().max_iter() - initial_iter_);
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::on_start() {
+  if (root_) {
+    // Wait for the root to update the weights
+    CPUSync<Dtype>* root = queue_.pop();
+    CHECK(root == root_);
+  } else {
+    for (int i = 0; i < solvers_.size(); ++i) {
+      solvers_[i]->queue_.push(this);
+    }
+  }
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::on_gradients_ready() {
+  if (root_) {
+    root_->queue_.push(this);
+    // Wait for the root to be done with the gradient before it is cleared
+    CPUSync<Dtype>* root = queue_.pop();
+    CHECK(root == root_);
+    return;
+  }
+  for (int i = 0; i < solvers_.size(); ++i) {
+    queue_.pop();
+  }
+  // 64 KB slices of float
+  const int kSliceSize = 16384;
+  ThreadPool::Global().ParallelFor(size_,
+      boost::bind(&CPUSync<Dtype>::Reduce, this, _1, _2),
+      (size_ + kSliceSize - 1) / kSliceSize);
+  for (int i = 0; i < solvers_.size(); ++i) {
+    solvers_[i]->queue_.push(this);
+  }
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::Reduce(int begin, int end) {
+  const int count = end - begin;
+  Dtype* dst = diff_ + begin;
+  for (int i = 0; i < solvers_.size(); ++i) {
+    caffe_add(count, dst, solvers_[i]->diff_ + begin, dst);
+  }
+  // Loss functions divide gradients by the batch size, so to compensate
+  // for split batch, the root solver divides by number of solvers.
+  caffe_scal(count, Dtype(1.0 / (solvers_.size() + 1)), dst);
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::Run(int num_solvers) {
+  CHECK(root_ == NULL) << "Run the root";
+  CHECK_EQ(Caffe::solver_count(), num_solvers)
+      << "Set the solver count before creating the root solver";
+  SolverParameter param(solver_->param());
+  for (int i = 1; i < num_solvers; ++i) {
+    solvers_.push_back(shared_ptr<CPUSync<Dtype> >(
+        new CPUSync<Dtype>(solver_, this, param, i)));
+  }
+
+  LOG(INFO)<< "Starting Optimization on " << num_solvers << " CPU solvers";
+
+  for (int i = 0; i < solvers_.size(); ++i) {
+    solvers_[i]->StartInternalThread();
+  }
+
+  // Run root solver on current thread
+  solver_->Solve();
+
+  for (int i = 0; i < solvers_.size(); ++i) {
+    solvers_[i]->StopInternalThread();
+  }
+  solvers_.clear();
+}
+
 INSTANTIATE_CLASS(Params);
 INSTANTIATE_CLASS(GPUParams);
+INSTANTIATE_CLASS(CPUParams);
 INSTANTIATE_CLASS(P2PSync);
+INSTANTIATE_CLASS(CPUSync);
 
 }  // namespace caffe
@@ -7,6 +7,7 @@
 #include "caffe/util/format.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/snapshot_writer.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 namespace caffe {
@@ -49,7 +50,21 @@ void Solver<Dtype>::Init(const SolverParameter& param) {
     << std::endl << param.DebugString();
   param_ = param;
   CHECK_GE(param_.average_loss(), 1) << "average_loss should be non-negative.";
+  // rejected before training rather than at the first snapshot
+  CHECK_GE(param_.snapshot_compression(), 0)
+      << "snapshot_compression ranges from 0 to 9.";
+  CHECK_LE(param_.snapshot_compression(), 9)
+      << "snapshot_compression ranges from 0 to 9.";
   CheckSnapshotWritePermissions();
+  if (Caffe::root_solver() && param_.async_snapshots() > 0) {
+    if (param_.snapshot_format() ==
+        caffe::SolverParameter_SnapshotFormat_BINARYPROTO) {
+      snapshot_writer_.reset(new SnapshotWriter(param_.async_snapshots()));
+    } else {
+      LOG(WARNING) << "async_snapshots only applies to BINARYPROTO "
+          << "snapshots; HDF5 ones are written before the next iteration.";
+    }
+  }
   if (Caffe::root_solver() && param_.random_seed() >= 0) {
     Caffe::set_random_seed(param_.random_seed());
   }
@@ -297,6 +312,9 @@ void Solver<Dtype>::Solve(const char* resume_file) {
       && (!param_.snapshot() || iter_ % param_.snapshot() != 0)) {
     Snapshot();
   }
+  if (snapshot_writer_) {
+    snapshot_writer_->Flush();
+  }
   if (requested_early_exit_) {
     LOG(INFO) << "Optimization stopped early.";
     return;
@@ -409,6 +427,9 @@ void Solver<Dtype>::Test(const int test_net_id) {
 template <typename Dtype>
 void Solver<Dtype>::Snapshot() {
   CHECK(Caffe::root_solver());
+  if (snapshot_writer_) {
+    snapshot_writer_->Begin();
+  }
   string model_filename;
   switch (param_.snapshot_format()) {
   case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
@@ -422,6 +443,9 @@ void Solver<Dtype>::Snapshot() {
   }
 
   SnapshotSolverState(model_filename);
+  if (snapshot_writer_) {
+    snapshot_writer_->Commit();
+  }
 }
 
 template <typename Dtype>
@@ -452,9 +476,9 @@ template <typename Dtype>
 string Solver<Dtype>::SnapshotToBinaryProto() {
   string model_filename = SnapshotFilename(".caffemodel");
   LOG(INFO) << "Snapshotting to binary proto file " << model_filename;
-  NetParameter net_param;
-  net_->ToProto(&net_param, param_.snapshot_diff());
-  WriteProtoToBinaryFile(net_param, model_filename);
+  shared_ptr<NetParameter> net_param(new NetParameter());
+  net_->ToProto(net_param.get(), param_.snapshot_diff());
+  WriteSnapshot(net_param, model_filename);
   return model_filename;
 }
 
@@ -462,10 +486,23 @@ template <typename Dtype>
 string Solver<Dtype>::SnapshotToHDF5() {
   string model_filename = SnapshotFilename(".caffemodel.h5");
   LOG(INFO) << "Snapshotting to HDF5 file " << model_filename;
-  net_->ToHDF5(model_filename, param_.snapshot_diff());
+  const string temp_filename = model_filename + ".tmp";
+  net_->ToHDF5(temp_filename, param_.snapshot_diff(),
+      param_.snapshot_compression());
+  RenameFileDurably(temp_filename, model_filename);
   return model_filename;
 }
 
+template <typename Dtype>
+void Solver<Dtype>::WriteSnapshot(shared_ptr<google::protobuf::Message> proto,
+    const string& filename) {
+  if (snapshot_writer_) {
+    snapshot_writer_->Add(proto, filename);
+  } else {
+    WriteProtoToBinaryFileAtomic(*proto, filename);
+  }
+}
+
 template <typename Dtype>
 void Solver<Dtype>::Restore(const char* state_file) {
   CHECK(Caffe::root_solver());
@@ -1,9 +1,28 @@
+#include <cmath>
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
 
 namespace caffe {
 
+// Accumulates the squared gradient and scales the gradient by it in a
+// single pass, adding the L2 weight decay of the weights w first.
+template <typename Dtype>
+struct AdaGradCPUUpdate {
+  const Dtype* w;
+  Dtype* g;
+  Dtype* h;
+  Dtype delta, decay, local_rate;
+
+  void operator()(int begin, int end) const {
+    for (int i = begin; i < end; ++i) {
+      const Dtype gi = g[i] + decay * w[i];
+      const Dtype hi = h[i] = h[i] + gi * gi;
+      g[i] = local_rate * gi / (std::sqrt(hi) + delta);
+    }
+  }
+};
+
 #ifndef CPU_ONLY
 template <typename Dtype>
 void adagrad_update_gpu(int N, Dtype* g, Dtype* h, Dtype delta,
@@ -19,34 +38,11 @@ void AdaGradSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   Dtype local_rate = rate * net_params_lr[param_id];
   switch (Caffe::mode()) {
   case Caffe::CPU: {
-    // compute square of gradient in update
-    caffe_powx(net_params[param_id]->count(),
-        net_params[param_id]->cpu_diff(), Dtype(2),
-        this->update_[param_id]->mutable_cpu_data());
-
-    // update history
-    caffe_add(net_params[param_id]->count(),
-        this->update_[param_id]->cpu_data(),
-        this->history_[param_id]->cpu_data(),
-        this->history_[param_id]->mutable_cpu_data());
-
-    // prepare update
-    caffe_powx(net_params[param_id]->count(),
-              this->history_[param_id]->cpu_data(), Dtype(0.5),
-              this->update_[param_id]->mutable_cpu_data());
-
-    caffe_add_scalar(net_params[param_id]->count(),
-              delta, this->update_[param_id]->mutable_cpu_data());
-
-    caffe_div(net_params[param_id]->count(),
-              net_params[param_id]->cpu_diff(),
-              this->update_[param_id]->cpu_data(),
-              this->update_[param_id]->mutable_cpu_data());
-
-    // scale and copy
-    caffe_cpu_axpby(net_params[param_id]->count(), local_rate,
-        this->update_[param_id]->cpu_data(), Dtype(0),
-        net_params[param_id]->mutable_cpu_diff());
+    AdaGradCPUUpdate<Dtype> update = { net_params[param_id]->cpu_data(),
+        net_params[param_id]->mutable_cpu_diff(),
+        this->history_[param_id]->mutable_cpu_data(), delta,
+        this->FusedWeightDecay(param_id), local_rate };
+    this->ParallelUpdate(net_params[param_id]->count(), update);
     break;
   }
   case Caffe::GPU: {
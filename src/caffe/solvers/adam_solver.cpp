@@ -1,3 +1,4 @@
+#include <cmath>
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
@@ -16,6 +17,26 @@ void AdamSolver<Dtype>::AdamPreSolve() {
   }
 }
 
+// Updates m and v and turns the gradient into the step in a single pass,
+// adding the L2 weight decay of the weights w first.
+template <typename Dtype>
+struct AdamCPUUpdate {
+  const Dtype* w;
+  Dtype* g;
+  Dtype* m;
+  Dtype* v;
+  Dtype beta1, beta2, eps_hat, decay, corrected_local_rate;
+
+  void operator()(int begin, int end) const {
+    for (int i = begin; i < end; ++i) {
+      const Dtype gi = g[i] + decay * w[i];
+      const Dtype mi = m[i] = m[i] * beta1 + gi * (1 - beta1);
+      const Dtype vi = v[i] = v[i] * beta2 + gi * gi * (1 - beta2);
+      g[i] = corrected_local_rate * mi / (std::sqrt(vi) + eps_hat);
+    }
+  }
+};
+
 #ifndef CPU_ONLY
 template <typename Dtype>
 void adam_update_gpu(int N, Dtype* g, Dtype* m, Dtype* v, Dtype beta1,
@@ -34,7 +55,6 @@ void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   size_t update_history_offset = net_params.size();
   Blob<Dtype>* val_m = this->history_[param_id].get();
   Blob<Dtype>* val_v = this->history_[param_id + update_history_offset].get();
-  Blob<Dtype>* val_t = this->temp_[param_id].get();
 
   const int t = this->iter_ + 1;
   const Dtype correction = std::sqrt(Dtype(1) - pow(beta2, t)) /
@@ -44,33 +64,11 @@ void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
 
   switch (Caffe::mode()) {
     case Caffe::CPU: {
-    // update m <- \beta_1 m_{t-1} + (1-\beta_1)g_t
-    caffe_cpu_axpby(N, Dtype(1)-beta1,
-        net_params[param_id]->cpu_diff(), beta1,
-        val_m->mutable_cpu_data());
-
-    // update v <- \beta_2 m_{t-1} + (1-\beta_2)g_t^2
-    caffe_mul(N,
-        net_params[param_id]->cpu_diff(),
-        net_params[param_id]->cpu_diff(),
-    val_t->mutable_cpu_data());
-    caffe_cpu_axpby(N, Dtype(1)-beta2,
-        val_t->cpu_data(), beta2,
-        val_v->mutable_cpu_data());
-
-    // set update
-    caffe_powx(N,
-        val_v->cpu_data(), Dtype(0.5),
-        val_t->mutable_cpu_data());
-    caffe_add_scalar(N, eps_hat, val_t->mutable_cpu_data());
-    caffe_div(N,
-        val_m->cpu_data(),
-        val_t->cpu_data(),
-        val_t->mutable_cpu_data());
-
-    caffe_cpu_scale(N, local_rate*correction,
-        val_t->cpu_data(),
-        net_params[param_id]->mutable_cpu_diff());
+    AdamCPUUpdate<Dtype> update = { net_params[param_id]->cpu_data(),
+        net_params[param_id]->mutable_cpu_diff(), val_m->mutable_cpu_data(),
+        val_v->mutable_cpu_data(), beta1, beta2, eps_hat,
+        this->FusedWeightDecay(param_id), local_rate*correction };
+    this->ParallelUpdate(N, update);
     break;
   }
   case Caffe::GPU: {
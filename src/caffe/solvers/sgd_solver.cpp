@@ -82,9 +82,14 @@ void SGDSolver<Dtype>::ClipGradients() {
   const Dtype clip_gradients = this->param_.clip_gradients();
   if (clip_gradients < 0) { return; }
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  Blob<Dtype>* flat = this->net_->flat_cpu_params();
   Dtype sumsq_diff = 0;
-  for (int i = 0; i < net_params.size(); ++i) {
-    sumsq_diff += net_params[i]->sumsq_diff();
+  if (flat) {
+    sumsq_diff = flat->sumsq_diff();
+  } else {
+    for (int i = 0; i < net_params.size(); ++i) {
+      sumsq_diff += net_params[i]->sumsq_diff();
+    }
   }
   const Dtype l2norm_diff = std::sqrt(sumsq_diff);
   if (l2norm_diff > clip_gradients) {
@@ -92,6 +97,10 @@ void SGDSolver<Dtype>::ClipGradients() {
     LOG(INFO) << "Gradient clipping: scaling down gradients (L2 norm "
         << l2norm_diff << " > " << clip_gradients << ") "
         << "by scale factor " << scale_factor;
+    if (flat) {
+      flat->scale_diff(scale_factor);
+      return;
+    }
     for (int i = 0; i < net_params.size(); ++i) {
       net_params[i]->scale_diff(scale_factor);
     }
@@ -153,11 +162,13 @@ void SGDSolver<Dtype>::Regularize(int param_id) {
   case Caffe::CPU: {
     if (local_decay) {
       if (regularization_type == "L2") {
-        // add weight decay
-        caffe_axpy(net_params[param_id]->count(),
-            local_decay,
-            net_params[param_id]->cpu_data(),
-            net_params[param_id]->mutable_cpu_diff());
+        // add weight decay, unless the update adds it in the same pass
+        if (!FusesWeightDecay()) {
+          caffe_axpy(net_params[param_id]->count(),
+              local_decay,
+              net_params[param_id]->cpu_data(),
+              net_params[param_id]->mutable_cpu_diff());
+        }
       } else if (regularization_type == "L1") {
         caffe_cpu_sign(net_params[param_id]->count(),
             net_params[param_id]->cpu_data(),
@@ -209,6 +220,29 @@ void sgd_update_gpu(int N, Dtype* g, Dtype* h, Dtype momentum,
     Dtype local_rate);
 #endif
 
+template <typename Dtype>
+Dtype SGDSolver<Dtype>::FusedWeightDecay(int param_id) const {
+  if (!FusesWeightDecay() || this->param_.regularization_type() != "L2") {
+    return Dtype(0);
+  }
+  return this->param_.weight_decay() *
+      this->net_->params_weight_decay()[param_id];
+}
+
+// Parameters smaller than this are updated by the calling thread alone
+const int kUpdateChunkSize = 1 << 16;
+
+template <typename Dtype>
+void SGDSolver<Dtype>::ParallelUpdate(int count,
+    const ThreadPool::RangeFunction& fn) {
+  if (count <= kUpdateChunkSize) {
+    fn(0, count);
+    return;
+  }
+  ThreadPool::Global().ParallelFor(count, fn,
+      (count + kUpdateChunkSize - 1) / kUpdateChunkSize);
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
@@ -259,20 +293,20 @@ void SGDSolver<Dtype>::SnapshotSolverState(const string& model_filename) {
 template <typename Dtype>
 void SGDSolver<Dtype>::SnapshotSolverStateToBinaryProto(
     const string& model_filename) {
-  SolverState state;
-  state.set_iter(this->iter_);
-  state.set_learned_net(model_filename);
-  state.set_current_step(this->current_step_);
-  state.clear_history();
+  shared_ptr<SolverState> state(new SolverState());
+  state->set_iter(this->iter_);
+  state->set_learned_net(model_filename);
+  state->set_current_step(this->current_step_);
+  state->clear_history();
   for (int i = 0; i < history_.size(); ++i) {
     // Add history
-    BlobProto* history_blob = state.add_history();
+    BlobProto* history_blob = state->add_history();
     history_[i]->ToProto(history_blob);
   }
   string snapshot_filename = Solver<Dtype>::SnapshotFilename(".solverstate");
   LOG(INFO)
     << "Snapshotting solver state to binary proto file " << snapshot_filename;
-  WriteProtoToBinaryFile(state, snapshot_filename.c_str());
+  this->WriteSnapshot(state, snapshot_filename);
 }
 
 template <typename Dtype>
@@ -281,7 +315,8 @@ void SGDSolver<Dtype>::SnapshotSolverStateToHDF5(
   string snapshot_filename =
       Solver<Dtype>::SnapshotFilename(".solverstate.h5");
   LOG(INFO) << "Snapshotting solver state to HDF5 file " << snapshot_filename;
-  hid_t file_hid = H5Fcreate(snapshot_filename.c_str(), H5F_ACC_TRUNC,
+  const string temp_filename = snapshot_filename + ".tmp";
+  hid_t file_hid = H5Fcreate(temp_filename.c_str(), H5F_ACC_TRUNC,
       H5P_DEFAULT, H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
       << "Couldn't open " << snapshot_filename << " to save solver state.";
@@ -295,10 +330,12 @@ void SGDSolver<Dtype>::SnapshotSolverStateToHDF5(
   for (int i = 0; i < history_.size(); ++i) {
     ostringstream oss;
     oss << i;
-    hdf5_save_nd_dataset<Dtype>(history_hid, oss.str(), *history_[i]);
+    hdf5_save_nd_dataset<Dtype>(history_hid, oss.str(), *history_[i], false,
+        this->param_.snapshot_compression());
   }
   H5Gclose(history_hid);
   H5Fclose(file_hid);
+  RenameFileDurably(temp_filename, snapshot_filename);
 }
 
 template <typename Dtype>
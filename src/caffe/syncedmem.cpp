@@ -1,9 +1,98 @@
+#include <boost/thread.hpp>
+#include <sstream>
+#include <string>
+#include <vector>
+
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
+// Make sure each thread can have different counters and context.
+struct SyncedMemoryThreadState {
+  SyncedMemoryThreadState()
+      : layer(NULL), trace(NULL),
+        sync_check(NetParameter_SyncCheck_SYNC_IGNORE) {}
+  SyncedMemoryStats stats;
+  const string* layer;
+  vector<SyncedMemoryTransfer>* trace;
+  NetParameter_SyncCheck sync_check;
+};
+static boost::thread_specific_ptr<SyncedMemoryThreadState> thread_state_;
+
+static SyncedMemoryThreadState& thread_state() {
+  if (!thread_state_.get()) {
+    thread_state_.reset(new SyncedMemoryThreadState());
+  }
+  return *(thread_state_.get());
+}
+
+static boost::mutex global_stats_mutex_;
+static SyncedMemoryStats global_stats_;
+
+SyncedMemoryStats& SyncedMemory::thread_stats() {
+  return thread_state().stats;
+}
+
+SyncedMemoryStats SyncedMemory::global_stats() {
+  boost::mutex::scoped_lock lock(global_stats_mutex_);
+  return global_stats_;
+}
+
+void SyncedMemory::set_transfer_context(const string* layer,
+    vector<SyncedMemoryTransfer>* trace, NetParameter_SyncCheck sync_check) {
+  SyncedMemoryThreadState& state = thread_state();
+  state.layer = layer;
+  state.trace = trace;
+  state.sync_check = sync_check;
+}
+
+void SyncedMemory::CountMalloc(bool gpu) {
+  SyncedMemoryStats& stats = thread_stats();
+  (gpu ? stats.gpu_malloc_bytes : stats.cpu_malloc_bytes) += size_;
+  boost::mutex::scoped_lock lock(global_stats_mutex_);
+  (gpu ? global_stats_.gpu_malloc_bytes : global_stats_.cpu_malloc_bytes) +=
+      size_;
+}
+
+void SyncedMemory::CountTransfer(bool to_gpu) {
+  SyncedMemoryThreadState& state = thread_state();
+  if (to_gpu) {
+    ++state.stats.to_gpu_copies;
+    state.stats.to_gpu_bytes += size_;
+  } else {
+    ++state.stats.to_cpu_copies;
+    state.stats.to_cpu_bytes += size_;
+  }
+  {
+    boost::mutex::scoped_lock lock(global_stats_mutex_);
+    if (to_gpu) {
+      ++global_stats_.to_gpu_copies;
+      global_stats_.to_gpu_bytes += size_;
+    } else {
+      ++global_stats_.to_cpu_copies;
+      global_stats_.to_cpu_bytes += size_;
+    }
+  }
+  if (state.trace) {
+    SyncedMemoryTransfer transfer;
+    transfer.memory = this;
+    transfer.layer = state.layer;
+    transfer.to_gpu = to_gpu;
+    transfer.bytes = size_;
+    state.trace->push_back(transfer);
+  }
+  if (!to_gpu && state.sync_check != NetParameter_SyncCheck_SYNC_IGNORE) {
+    std::ostringstream message;
+    message << "Copy of " << size_ << " bytes to the host in layer "
+        << (state.layer ? *state.layer : "(none)") << " on the GPU";
+    LOG_IF(FATAL, state.sync_check == NetParameter_SyncCheck_SYNC_FATAL)
+        << message.str();
+    LOG(WARNING) << message.str();
+  }
+}
+
 SyncedMemory::~SyncedMemory() {
   if (cpu_ptr_ && own_cpu_data_) {
     CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
@@ -11,13 +100,7 @@ SyncedMemory::~SyncedMemory() {
 
 #ifndef CPU_ONLY
   if (gpu_ptr_ && own_gpu_data_) {
-    int initial_device;
-    cudaGetDevice(&initial_device);
-    if (gpu_device_ != -1) {
-      CUDA_CHECK(cudaSetDevice(gpu_device_));
-    }
-    CUDA_CHECK(cudaFree(gpu_ptr_));
-    cudaSetDevice(initial_device);
+    MemoryPool::Device(gpu_device_).Free(gpu_ptr_);
   }
 #endif  // CPU_ONLY
 }
@@ -26,6 +109,7 @@ inline void SyncedMemory::to_cpu() {
   switch (head_) {
   case UNINITIALIZED:
     CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
+    CountMalloc(false);
     caffe_memset(size_, 0, cpu_ptr_);
     head_ = HEAD_AT_CPU;
     own_cpu_data_ = true;
@@ -34,9 +118,11 @@ inline void SyncedMemory::to_cpu() {
 #ifndef CPU_ONLY
     if (cpu_ptr_ == NULL) {
       CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
+      CountMalloc(false);
       own_cpu_data_ = true;
     }
     caffe_gpu_memcpy(size_, gpu_ptr_, cpu_ptr_);
+    CountTransfer(false);
     head_ = SYNCED;
 #else
     NO_GPU;
@@ -53,7 +139,8 @@ inline void SyncedMemory::to_gpu() {
   switch (head_) {
   case UNINITIALIZED:
     CUDA_CHECK(cudaGetDevice(&gpu_device_));
-    CUDA_CHECK(cudaMalloc(&gpu_ptr_, size_));
+    gpu_ptr_ = MemoryPool::Device(gpu_device_).Allocate(size_);
+    CountMalloc(true);
     caffe_gpu_memset(size_, 0, gpu_ptr_);
     head_ = HEAD_AT_GPU;
     own_gpu_data_ = true;
@@ -61,10 +148,12 @@ inline void SyncedMemory::to_gpu() {
   case HEAD_AT_CPU:
     if (gpu_ptr_ == NULL) {
       CUDA_CHECK(cudaGetDevice(&gpu_device_));
-      CUDA_CHECK(cudaMalloc(&gpu_ptr_, size_));
+      gpu_ptr_ = MemoryPool::Device(gpu_device_).Allocate(size_);
+      CountMalloc(true);
       own_gpu_data_ = true;
     }
     caffe_gpu_memcpy(size_, cpu_ptr_, gpu_ptr_);
+    CountTransfer(true);
     head_ = SYNCED;
     break;
   case HEAD_AT_GPU:
@@ -105,13 +194,7 @@ void SyncedMemory::set_gpu_data(void* data) {
 #ifndef CPU_ONLY
   CHECK(data);
   if (own_gpu_data_) {
-    int initial_device;
-    cudaGetDevice(&initial_device);
-    if (gpu_device_ != -1) {
-      CUDA_CHECK(cudaSetDevice(gpu_device_));
-    }
-    CUDA_CHECK(cudaFree(gpu_ptr_));
-    cudaSetDevice(initial_device);
+    MemoryPool::Device(gpu_device_).Free(gpu_ptr_);
   }
   gpu_ptr_ = data;
   head_ = HEAD_AT_GPU;
@@ -143,11 +226,13 @@ void SyncedMemory::async_gpu_push(const cudaStream_t& stream) {
   CHECK(head_ == HEAD_AT_CPU);
   if (gpu_ptr_ == NULL) {
     CUDA_CHECK(cudaGetDevice(&gpu_device_));
-    CUDA_CHECK(cudaMalloc(&gpu_ptr_, size_));
+    gpu_ptr_ = MemoryPool::Device(gpu_device_).Allocate(size_);
+    CountMalloc(true);
     own_gpu_data_ = true;
   }
   const cudaMemcpyKind put = cudaMemcpyHostToDevice;
   CUDA_CHECK(cudaMemcpyAsync(gpu_ptr_, cpu_ptr_, size_, put, stream));
+  CountTransfer(true);
   // Assume caller will synchronize on the stream before use
   head_ = SYNCED;
 }
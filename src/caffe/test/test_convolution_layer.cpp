@@ -5,7 +5,9 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/layer_factory.hpp"
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/layers/direct_conv_layer.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_conv_layer.hpp"
@@ -811,6 +813,67 @@ TYPED_TEST(ConvolutionLayerTest, TestGradientGroup) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestDirectConvolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> bottom_shape;
+  bottom_shape.push_back(2);
+  bottom_shape.push_back(4);
+  bottom_shape.push_back(9);
+  bottom_shape.push_back(7);
+  this->blob_bottom_->Reshape(bottom_shape);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  // 3x3, 5x5 and dilated 3x3 filters, each unpadded and padded
+  const int kernel[] = {3, 5, 3};
+  const int dilation[] = {1, 1, 2};
+  for (int k = 0; k < 3; ++k) {
+    for (int pad = 0; pad <= 2; pad += 2) {
+      LayerParameter layer_param;
+      layer_param.set_type("Convolution");
+      ConvolutionParameter* convolution_param =
+          layer_param.mutable_convolution_param();
+      convolution_param->add_kernel_size(kernel[k]);
+      convolution_param->add_dilation(dilation[k]);
+      convolution_param->add_pad(pad);
+      convolution_param->set_num_output(12);
+      convolution_param->set_group(1 + k % 2);
+      convolution_param->mutable_weight_filler()->set_type("gaussian");
+      convolution_param->mutable_bias_filler()->set_type("gaussian");
+      convolution_param->set_engine(ConvolutionParameter_Engine_DIRECT);
+      shared_ptr<Layer<Dtype> > layer =
+          LayerRegistry<Dtype>::CreateLayer(layer_param);
+      layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+          this->MakeReferenceTop(this->blob_top_));
+      const Dtype* top_data = this->blob_top_->cpu_data();
+      const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+      for (int i = 0; i < this->blob_top_->count(); ++i) {
+        EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+      }
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestDirectGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  this->blob_bottom_vec_.push_back(this->blob_bottom_2_);
+  this->blob_top_vec_.push_back(this->blob_top_2_);
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  DirectConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
 #ifdef USE_CUDNN
 
 template <typename Dtype>
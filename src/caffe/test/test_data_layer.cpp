@@ -1,4 +1,5 @@
 #ifdef USE_OPENCV
+#include <set>
 #include <string>
 #include <vector>
 
@@ -105,6 +106,63 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     }
   }
 
+  void TestPrefetch() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_prefetch(2);
+
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    std::set<const Dtype*> batches;
+    for (int iter = 0; iter < 10; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      // the tops take the memory of the batches rather than a copy
+      batches.insert(Caffe::mode() == Caffe::CPU ?
+          blob_top_data_->cpu_data() : blob_top_data_->gpu_data());
+      for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(i, blob_top_label_->cpu_data()[i]);
+        EXPECT_EQ(i, blob_top_data_->cpu_data()[i * 24]);
+      }
+    }
+    EXPECT_EQ(2, batches.size());
+    EXPECT_EQ(10, layer.prefetch_stats().batches);
+    EXPECT_LE(layer.prefetch_stats().empty, 10);
+    EXPECT_LE(layer.prefetch_stats().ready, 10 * 2);
+  }
+
+  void TestReadSharded(bool keep_order) {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_reader_threads(2);
+    data_param->set_keep_order(keep_order);
+
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    // the shards read keys [0, 2) and [2, 5) in turn
+    const int expected[] = {0, 2, 1, 3, 0, 4, 1, 2, 0, 3, 1, 4, 0, 2, 1};
+    for (int iter = 0; iter < 3; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      for (int i = 0; i < 5; ++i) {
+        const int label = blob_top_label_->cpu_data()[i];
+        if (keep_order) {
+          EXPECT_EQ(expected[iter * 5 + i], label);
+        } else {
+          EXPECT_GE(label, 0);
+          EXPECT_LT(label, 5);
+        }
+        EXPECT_EQ(label, blob_top_data_->cpu_data()[i * 24]);
+      }
+    }
+  }
+
   void TestReshape(DataParameter_DB backend) {
     const int num_inputs = 5;
     // Save data of varying shapes.
@@ -356,6 +414,24 @@ TYPED_TEST(DataLayerTest, TestReadLevelDB) {
   this->TestRead();
 }
 
+TYPED_TEST(DataLayerTest, TestPrefetchLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestPrefetch();
+}
+
+TYPED_TEST(DataLayerTest, TestReadShardedLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestReadSharded(true);
+}
+
+TYPED_TEST(DataLayerTest, TestReadShardedOutOfOrderLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestReadSharded(false);
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLevelDB) {
   this->TestReshape(DataParameter_DB_LEVELDB);
 }
@@ -396,6 +472,24 @@ TYPED_TEST(DataLayerTest, TestReadLMDB) {
   this->TestRead();
 }
 
+TYPED_TEST(DataLayerTest, TestPrefetchLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestPrefetch();
+}
+
+TYPED_TEST(DataLayerTest, TestReadShardedLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestReadSharded(true);
+}
+
+TYPED_TEST(DataLayerTest, TestReadShardedOutOfOrderLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestReadSharded(false);
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLMDB) {
   this->TestReshape(DataParameter_DB_LMDB);
 }
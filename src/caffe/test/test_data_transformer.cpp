@@ -1,4 +1,7 @@
 #ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+
+#include <cmath>
 #include <string>
 #include <vector>
 
@@ -9,6 +12,7 @@
 #include "caffe/data_transformer.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/io.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -29,6 +33,33 @@ void FillDatum(const int label, const int channels, const int height,
   }
 }
 
+// Writes a mean of channels x height x width values counting up from start
+void MakeMeanFile(const int channels, const int height, const int width,
+    const int start, string* mean_file) {
+  MakeTempFilename(mean_file);
+  BlobProto blob_mean;
+  blob_mean.set_num(1);
+  blob_mean.set_channels(channels);
+  blob_mean.set_height(height);
+  blob_mean.set_width(width);
+  for (int j = 0; j < channels * height * width; ++j) {
+    blob_mean.add_data((start + j) % 256);
+  }
+  WriteProtoToBinaryFile(blob_mean, *mean_file);
+}
+
+// Exposes the generic loop the fast uint8 paths are checked against
+template <typename Dtype>
+class GenericDataTransformer : public DataTransformer<Dtype> {
+ public:
+  GenericDataTransformer(const TransformationParameter& param, Phase phase)
+      : DataTransformer<Dtype>(param, phase) {}
+
+  void TransformPixels(const Datum& datum, Blob<Dtype>* blob, bool generic) {
+    this->Transform(datum, NULL, blob->mutable_cpu_data(), generic);
+  }
+};
+
 template <typename Dtype>
 class DataTransformTest : public ::testing::Test {
  protected:
@@ -69,6 +100,49 @@ class DataTransformTest : public ::testing::Test {
     return num_sequence_matches;
   }
 
+  // Runs the fast and the generic loops num_iter_ times from the same seed
+  void CheckFastMatchesGeneric(const TransformationParameter& transform_param,
+      const Datum& datum, Phase phase) {
+    GenericDataTransformer<Dtype> transformer(transform_param, phase);
+    const int crop_size = transform_param.crop_size();
+    Blob<Dtype> blob(1, datum.channels(),
+        crop_size ? crop_size : datum.height(),
+        crop_size ? crop_size : datum.width());
+    Blob<Dtype> blob_generic(blob.shape());
+    Caffe::set_random_seed(seed_);
+    transformer.InitRand();
+    vector<vector<Dtype> > fast;
+    for (int iter = 0; iter < num_iter_; ++iter) {
+      transformer.TransformPixels(datum, &blob, false);
+      fast.push_back(vector<Dtype>(blob.cpu_data(),
+          blob.cpu_data() + blob.count()));
+    }
+    Caffe::set_random_seed(seed_);
+    transformer.InitRand();
+    for (int iter = 0; iter < num_iter_; ++iter) {
+      transformer.TransformPixels(datum, &blob_generic, true);
+      for (int j = 0; j < blob_generic.count(); ++j) {
+        EXPECT_EQ(fast[iter][j], blob_generic.cpu_data()[j]);
+      }
+    }
+  }
+
+  // The milliseconds per datum of either loop
+  double TimeTransform(const TransformationParameter& transform_param,
+      const Datum& datum, bool generic) {
+    GenericDataTransformer<Dtype> transformer(transform_param, TRAIN);
+    const int crop_size = transform_param.crop_size();
+    Blob<Dtype> blob(1, datum.channels(), crop_size, crop_size);
+    transformer.InitRand();
+    const int kIters = 20;
+    CPUTimer timer;
+    timer.Start();
+    for (int iter = 0; iter < kIters; ++iter) {
+      transformer.TransformPixels(datum, &blob, generic);
+    }
+    return timer.MilliSeconds() / kIters;
+  }
+
   int seed_;
   int num_iter_;
 };
@@ -340,5 +414,205 @@ TYPED_TEST(DataTransformTest, TestMeanFile) {
   }
 }
 
+// A 3 channel image whose pixels count up and a normal like label whose
+// first channel is 1 and others count up, both height x width
+void FillImageAndLabel(const int height, const int width, cv::Mat* cv_img,
+    cv::Mat* cv_label) {
+  *cv_img = cv::Mat(height, width, CV_8UC3);
+  *cv_label = cv::Mat(height, width, CV_32FC3);
+  for (int h = 0; h < height; ++h) {
+    for (int w = 0; w < width; ++w) {
+      for (int c = 0; c < 3; ++c) {
+        const int index = (h * width + w) * 3 + c;
+        cv_img->ptr<uchar>(h)[w * 3 + c] = index;
+        cv_label->ptr<float>(h)[w * 3 + c] = c == 0 ? 1 : index;
+      }
+    }
+  }
+}
+
+TYPED_TEST(DataTransformTest, TestDataApart) {
+  TransformationParameter transform_param;
+  const bool unique_pixels = true;
+  const int label = 0;
+  const int channels = 3;
+  const int height = 4;
+  const int width = 5;
+
+  transform_param.set_crop_size(3);
+  transform_param.add_mean_value(1);
+  Datum datum;
+  FillDatum(label, channels, height, width, unique_pixels, &datum);
+  // the pixels apart, as a DataReader reading in place hands them out
+  const string pixels = datum.data();
+  Datum header(datum);
+  header.clear_data();
+  Blob<TypeParam> blob(1, channels, 3, 3);
+  Blob<TypeParam> blob_apart(1, channels, 3, 3);
+  DataTransformer<TypeParam> transformer(transform_param, TEST);
+  transformer.InitRand();
+  transformer.Transform(datum, &blob);
+  transformer.Transform(header, pixels.data(), &blob_apart);
+  for (int j = 0; j < blob.count(); ++j) {
+    EXPECT_EQ(blob.cpu_data()[j], blob_apart.cpu_data()[j]);
+  }
+}
+
+TYPED_TEST(DataTransformTest, TestFastMatchesGeneric) {
+  const int channels = 3;
+  const int height = 6;
+  const int width = 7;
+  Datum datum;
+  FillDatum(0, channels, height, width, true, &datum);
+  string mean_file;
+  MakeMeanFile(channels, height, width, 5, &mean_file);
+  for (int crop_size = 0; crop_size <= 4; crop_size += 4) {
+    for (int mirror = 0; mirror < 2; ++mirror) {
+      for (int mean = 0; mean < 3; ++mean) {
+        TransformationParameter transform_param;
+        transform_param.set_crop_size(crop_size);
+        transform_param.set_mirror(mirror);
+        transform_param.set_scale(0.5);
+        if (mean == 1) {
+          for (int c = 0; c < channels; ++c) {
+            transform_param.add_mean_value(10 * c + 1);
+          }
+        } else if (mean == 2) {
+          transform_param.set_mean_file(mean_file);
+        }
+        this->CheckFastMatchesGeneric(transform_param, datum, TRAIN);
+        this->CheckFastMatchesGeneric(transform_param, datum, TEST);
+      }
+    }
+  }
+}
+
+TYPED_TEST(DataTransformTest, TestBenchmarkFast) {
+  const int channels = 3;
+  const int size = 256;
+  const int crop_size = 227;
+  Datum datum;
+  FillDatum(0, channels, size, size, true, &datum);
+  string mean_file;
+  MakeMeanFile(channels, size, size, 0, &mean_file);
+  TransformationParameter mean_values;
+  mean_values.set_crop_size(crop_size);
+  mean_values.set_mirror(true);
+  mean_values.add_mean_value(104);
+  mean_values.add_mean_value(117);
+  mean_values.add_mean_value(123);
+  TransformationParameter mean_file_param;
+  mean_file_param.set_crop_size(crop_size);
+  mean_file_param.set_mean_file(mean_file);
+  LOG(INFO) << "crop + mirror + mean values: "
+      << this->TimeTransform(mean_values, datum, true) << " ms generic, "
+      << this->TimeTransform(mean_values, datum, false) << " ms fast";
+  LOG(INFO) << "crop + mean file: "
+      << this->TimeTransform(mean_file_param, datum, true) << " ms generic, "
+      << this->TimeTransform(mean_file_param, datum, false) << " ms fast";
+}
+
+TYPED_TEST(DataTransformTest, TestJointMatchesSeparate) {
+  string mean_file;
+  MakeMeanFile(3, 4, 5, 3, &mean_file);
+  for (int mean = 0; mean < 3; ++mean) {
+    // scale and mean_file are left alone by both paths
+    TransformationParameter transform_param;
+    transform_param.set_scale(0.5);
+    if (mean == 1) {
+      transform_param.add_mean_value(10);
+    } else if (mean == 2) {
+      transform_param.set_mean_file(mean_file);
+    }
+    cv::Mat cv_img, cv_label;
+    FillImageAndLabel(4, 5, &cv_img, &cv_label);
+    Blob<TypeParam> img(1, 3, 4, 5), label(1, 3, 4, 5);
+    Blob<TypeParam> joint_img(1, 3, 4, 5), joint_label(1, 3, 4, 5);
+    DataTransformer<TypeParam> transformer(transform_param, TRAIN);
+    transformer.InitRand();
+    const bool do_mirror = transformer.TransformImg(cv_img, &img);
+    transformer.TransformLabel(cv_label, &label, do_mirror);
+    transformer.TransformImgAndLabel(cv_img, cv_label, &joint_img,
+        &joint_label);
+    for (int h = 0; h < 4; ++h) {
+      for (int w = 0; w < 5; ++w) {
+        for (int c = 0; c < 3; ++c) {
+          const int index = (h * 5 + w) * 3 + c;
+          EXPECT_EQ(index - (mean == 1 ? 10 : 0), img.data_at(0, c, h, w));
+        }
+      }
+    }
+    for (int j = 0; j < img.count(); ++j) {
+      EXPECT_EQ(img.cpu_data()[j], joint_img.cpu_data()[j]);
+      EXPECT_EQ(label.cpu_data()[j], joint_label.cpu_data()[j]);
+    }
+  }
+}
+
+TYPED_TEST(DataTransformTest, TestJointMirrorNormal) {
+  TransformationParameter transform_param;
+  transform_param.set_mirror(true);
+  transform_param.set_normal_label(true);
+  const int height = 4;
+  const int width = 5;
+  cv::Mat cv_img, cv_label;
+  FillImageAndLabel(height, width, &cv_img, &cv_label);
+  Blob<TypeParam> img(1, 3, height, width), label(1, 3, height, width);
+  Caffe::set_random_seed(this->seed_);
+  DataTransformer<TypeParam> transformer(transform_param, TRAIN);
+  transformer.InitRand();
+  int num_mirrored = 0;
+  for (int iter = 0; iter < this->num_iter_; ++iter) {
+    transformer.TransformImgAndLabel(cv_img, cv_label, &img, &label);
+    // the label x component says whether this draw mirrored
+    const bool mirrored = label.cpu_data()[0] < 0;
+    num_mirrored += mirrored;
+    for (int h = 0; h < height; ++h) {
+      for (int w = 0; w < width; ++w) {
+        const int src_w = mirrored ? width - 1 - w : w;
+        for (int c = 0; c < 3; ++c) {
+          const int index = (h * width + src_w) * 3 + c;
+          EXPECT_EQ(index, img.data_at(0, c, h, w));
+          if (c == 0) {
+            EXPECT_EQ(mirrored ? -1 : 1, label.data_at(0, c, h, w));
+          } else {
+            EXPECT_EQ(index, label.data_at(0, c, h, w));
+          }
+        }
+      }
+    }
+  }
+  EXPECT_GT(num_mirrored, 0);
+  EXPECT_LT(num_mirrored, this->num_iter_);
+}
+
+TYPED_TEST(DataTransformTest, TestJointZoomRotate) {
+  TransformationParameter transform_param;
+  transform_param.set_min_zoom(1.5);
+  transform_param.set_max_zoom(2);
+  transform_param.set_max_rotation(30);
+  transform_param.set_normal_label(true);
+  // a constant image and a normal pointing along x, of another size
+  cv::Mat cv_img(8, 8, CV_8UC3, cv::Scalar(7, 7, 7));
+  cv::Mat cv_label(4, 4, CV_32FC3, cv::Scalar(1, 0, 0.5));
+  Blob<TypeParam> img(1, 3, 8, 8), label(1, 3, 8, 8);
+  Caffe::set_random_seed(this->seed_);
+  DataTransformer<TypeParam> transformer(transform_param, TRAIN);
+  transformer.InitRand();
+  for (int iter = 0; iter < this->num_iter_; ++iter) {
+    transformer.TransformImgAndLabel(cv_img, cv_label, &img, &label);
+    // zooming in keeps every output point inside, the normals keep their
+    // length and lean by at most the rotation
+    for (int j = 0; j < 64; ++j) {
+      EXPECT_NEAR(7, img.cpu_data()[j], 1e-4);
+      const TypeParam x = label.cpu_data()[j];
+      const TypeParam y = label.cpu_data()[64 + j];
+      EXPECT_NEAR(1, x * x + y * y, 1e-4);
+      EXPECT_GE(x, std::cos(30 * M_PI / 180) - 1e-4);
+      EXPECT_NEAR(0.5, label.cpu_data()[128 + j], 1e-6);
+    }
+  }
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
@@ -11,7 +11,9 @@
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/sgd_solvers.hpp"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -26,7 +28,8 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
  protected:
   GradientBasedSolverTest() :
       seed_(1701), num_(4), channels_(3), height_(10), width_(10),
-      share_(false) {
+      share_(false), flat_params_(false), async_snapshots_(0),
+      snapshot_compression_(0) {
         input_file_ = new string(
         CMAKE_SOURCE_DIR "caffe/test/test_data/solver_data_list.txt" CMAKE_EXT);
       }
@@ -42,6 +45,9 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
   // TODO this is brittle and the hdf5 file should be checked instead.
   int num_, channels_, height_, width_;
   bool share_;
+  bool flat_params_;
+  int async_snapshots_;
+  int snapshot_compression_;
   Dtype delta_;  // Stability constant for RMSProp, AdaGrad, AdaDelta and Adam
 
   // Test data: check out generate_sample_data.py in the same directory.
@@ -87,6 +93,7 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
        "device_id: " << device_id << " "
        "net_param { "
        "  name: 'TestNetwork' "
+       "  flat_params: " << flat_params_ << " "
        "  layer { "
        "    name: 'data' "
        "    type: 'HDF5Data' "
@@ -181,6 +188,13 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     if (snapshot) {
       proto << "snapshot: " << num_iters << " ";
     }
+    if (async_snapshots_) {
+      proto << "async_snapshots: " << async_snapshots_ << " ";
+    }
+    if (snapshot_compression_) {
+      proto << "snapshot_format: HDF5 "
+            << "snapshot_compression: " << snapshot_compression_ << " ";
+    }
     Caffe::set_random_seed(this->seed_);
     this->InitSolverFromProtoString(proto.str());
     if (from_snapshot != NULL) {
@@ -211,6 +225,9 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
       ostringstream resume_file;
       resume_file << snapshot_prefix_ << "/_iter_" << num_iters
                   << ".solverstate";
+      if (snapshot_compression_) {
+        resume_file << ".h5";
+      }
       string resume_filename = resume_file.str();
       return resume_filename;
     }
@@ -648,6 +665,18 @@ TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverythingShare) {
   }
 }
 
+TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverythingFlat) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.5;
+  const int kNumIters = 4;
+  this->flat_params_ = true;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverythingAccum) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -694,6 +723,30 @@ TYPED_TEST(SGDSolverTest, TestSnapshotShare) {
   }
 }
 
+TYPED_TEST(SGDSolverTest, TestSnapshotAsync) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->async_snapshots_ = 2;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(SGDSolverTest, TestSnapshotCompressed) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->snapshot_compression_ = 1;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 
 template <typename TypeParam>
 class AdaGradSolverTest : public GradientBasedSolverTest<TypeParam> {
@@ -1113,6 +1166,18 @@ TYPED_TEST(AdamSolverTest, TestAdamLeastSquaresUpdateWithEverythingShare) {
   }
 }
 
+TYPED_TEST(AdamSolverTest, TestAdamLeastSquaresUpdateWithEverythingFlat) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->flat_params_ = true;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 TYPED_TEST(AdamSolverTest, TestLeastSquaresUpdateWithEverythingAccum) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -1262,4 +1327,250 @@ TYPED_TEST(RMSPropSolverTest, TestSnapshotShare) {
   }
 }
 
+// Runs the update of a solver on its own, without forward and backward
+template <typename SolverType>
+class UpdateOnlySolver : public SolverType {
+ public:
+  explicit UpdateOnlySolver(const SolverParameter& param)
+      : SolverType(param) {}
+  void Update() { this->ApplyUpdate(); }
+};
+
+template <typename Dtype>
+class FusedUpdateTest : public CPUDeviceTest<Dtype> {
+ protected:
+  // One inner product of inputs x outputs weights, over constant data so
+  // that every forward gives the same gradient
+  SolverParameter MakeParam(const string& type, int inputs, int outputs) {
+    ostringstream proto;
+    proto << "type: '" << type << "' "
+          << "base_lr: 0.01 "
+          << "lr_policy: 'fixed' "
+          << "weight_decay: 0.1 "
+          << "delta: 1e-7 "
+          << "random_seed: 1701 "
+          << "snapshot_after_train: false ";
+    if (type == "AdaDelta" || type == "Adam") {
+      proto << "momentum: 0.9 ";
+    } else if (type == "RMSProp") {
+      proto << "rms_decay: 0.95 ";
+    }
+    proto << "net_param { "
+          << "  name: 'FusedUpdateNetwork' "
+          << "  layer { "
+          << "    name: 'data' "
+          << "    type: 'DummyData' "
+          << "    dummy_data_param { "
+          << "      shape { dim: 2 dim: " << inputs << " } "
+          << "      shape { dim: 2 dim: " << outputs << " } "
+          << "      data_filler { type: 'constant' value: 0.5 } "
+          << "      data_filler { type: 'constant' value: 1 } "
+          << "    } "
+          << "    top: 'data' "
+          << "    top: 'targets' "
+          << "  } "
+          << "  layer { "
+          << "    name: 'innerprod' "
+          << "    type: 'InnerProduct' "
+          << "    inner_product_param { "
+          << "      num_output: " << outputs << " "
+          << "      weight_filler { type: 'gaussian' std: 0.1 } "
+          << "      bias_filler { type: 'gaussian' std: 0.1 } "
+          << "    } "
+          << "    bottom: 'data' "
+          << "    top: 'innerprod' "
+          << "  } "
+          << "  layer { "
+          << "    name: 'loss' "
+          << "    type: 'EuclideanLoss' "
+          << "    bottom: 'innerprod' "
+          << "    bottom: 'targets' "
+          << "  } "
+          << "} ";
+    SolverParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto.str(), &param));
+    return param;
+  }
+
+  // The update of a parameter as the solvers computed it before it was
+  // fused, one vector operation at a time, from the weights w, the gradient
+  // g and the histories h and h2 of iteration t. Leaves the update in g.
+  void UnfusedUpdate(const SolverParameter& param, int t, int count,
+      const Dtype* w, Dtype* g, Dtype* h, Dtype* h2, Dtype* update,
+      Dtype* temp) {
+    const string& type = param.type();
+    const Dtype rate = param.base_lr();
+    const Dtype delta = param.delta();
+    const Dtype momentum = param.momentum();
+    caffe_axpy(count, Dtype(param.weight_decay()), w, g);
+    if (type == "AdaGrad") {
+      caffe_powx(count, g, Dtype(2), update);
+      caffe_add(count, update, h, h);
+      caffe_powx(count, h, Dtype(0.5), update);
+      caffe_add_scalar(count, delta, update);
+      caffe_div(count, g, update, update);
+      caffe_cpu_axpby(count, rate, update, Dtype(0), g);
+    } else if (type == "RMSProp") {
+      const Dtype rms_decay = param.rms_decay();
+      caffe_powx(count, g, Dtype(2), update);
+      caffe_cpu_axpby(count, Dtype(1 - rms_decay), update, rms_decay, h);
+      caffe_powx(count, h, Dtype(0.5), update);
+      caffe_add_scalar(count, delta, update);
+      caffe_div(count, g, update, update);
+      caffe_cpu_axpby(count, rate, update, Dtype(0), g);
+    } else if (type == "AdaDelta") {
+      caffe_powx(count, g, Dtype(2), update);
+      caffe_cpu_axpby(count, Dtype(1 - momentum), update, momentum, h);
+      caffe_set(count, delta, temp);
+      caffe_add(count, temp, h2, update);
+      caffe_add(count, temp, h, temp);
+      caffe_div(count, update, temp, update);
+      caffe_powx(count, update, Dtype(0.5), update);
+      caffe_mul(count, g, update, g);
+      caffe_powx(count, g, Dtype(2), update);
+      caffe_cpu_axpby(count, Dtype(1 - momentum), update, momentum, h2);
+      caffe_cpu_scale(count, rate, g, g);
+    } else if (type == "Adam") {
+      const Dtype beta2 = param.momentum2();
+      const Dtype correction = std::sqrt(Dtype(1) - pow(beta2, t)) /
+          (Dtype(1) - pow(momentum, t));
+      caffe_cpu_axpby(count, Dtype(1 - momentum), g, momentum, h);
+      caffe_mul(count, g, g, update);
+      caffe_cpu_axpby(count, Dtype(1 - beta2), update, beta2, h2);
+      caffe_powx(count, h2, Dtype(0.5), update);
+      caffe_add_scalar(count, delta, update);
+      caffe_div(count, h, update, update);
+      caffe_cpu_scale(count, rate * correction, update, g);
+    } else {
+      LOG(FATAL) << "No unfused update for " << type;
+    }
+  }
+
+  // A copy of the gradients and histories of a solver, and the buffers of
+  // its unfused update
+  struct UpdateState {
+    vector<vector<Dtype> > g, h, h2, update, temp;
+  };
+
+  template <typename SolverType>
+  void CopyState(UpdateOnlySolver<SolverType>* solver, UpdateState* state) {
+    const vector<Blob<Dtype>*>& params = solver->net()->learnable_params();
+    const vector<shared_ptr<Blob<Dtype> > >& history = solver->history();
+    const int num_params = params.size();
+    state->g.resize(num_params);
+    state->h.resize(num_params);
+    state->h2.resize(num_params);
+    state->update.resize(num_params);
+    state->temp.resize(num_params);
+    for (int i = 0; i < num_params; ++i) {
+      const int count = params[i]->count();
+      state->g[i].assign(params[i]->cpu_diff(),
+          params[i]->cpu_diff() + count);
+      state->h[i].assign(history[i]->cpu_data(),
+          history[i]->cpu_data() + count);
+      if (history.size() > num_params) {
+        const Dtype* second = history[num_params + i]->cpu_data();
+        state->h2[i].assign(second, second + count);
+      } else {
+        state->h2[i].assign(count, Dtype(0));
+      }
+      state->update[i].resize(count);
+      state->temp[i].resize(count);
+    }
+  }
+
+  // The unfused update of every parameter of solver on state, leaving the
+  // solver be
+  template <typename SolverType>
+  void UnfusedUpdates(UpdateOnlySolver<SolverType>* solver,
+      UpdateState* state) {
+    const vector<Blob<Dtype>*>& params = solver->net()->learnable_params();
+    for (int i = 0; i < params.size(); ++i) {
+      UnfusedUpdate(solver->param(), solver->iter() + 1, params[i]->count(),
+          params[i]->cpu_data(), &state->g[i][0], &state->h[i][0],
+          &state->h2[i][0], &state->update[i][0], &state->temp[i][0]);
+    }
+  }
+
+  template <typename SolverType>
+  void CheckFusedMatchesUnfused(const string& type) {
+    // 3 chunks of the parallel update for the weights
+    UpdateOnlySolver<SolverType> solver(MakeParam(type, 300, 512));
+    solver.Step(2);
+    Net<Dtype>* net = solver.net().get();
+    const vector<Blob<Dtype>*>& params = net->learnable_params();
+    ASSERT_GT(params[0]->count(), 2 << 16);
+    net->ClearParamDiffs();
+    net->ForwardBackward();
+    UpdateState state;
+    CopyState(&solver, &state);
+    UnfusedUpdates(&solver, &state);
+    vector<vector<Dtype> > expected(params.size());
+    for (int i = 0; i < params.size(); ++i) {
+      expected[i].resize(params[i]->count());
+      caffe_sub(params[i]->count(), params[i]->cpu_data(), &state.g[i][0],
+          &expected[i][0]);
+    }
+    solver.Update();
+    for (int i = 0; i < params.size(); ++i) {
+      for (int j = 0; j < params[i]->count(); ++j) {
+        EXPECT_NEAR(expected[i][j], params[i]->cpu_data()[j], 1e-5);
+      }
+    }
+  }
+
+  template <typename SolverType>
+  void TimeUpdate(const string& type) {
+    const int kIters = 5;
+    // 2M weights, well past the caches like the fully connected layers
+    // that hold most of the 138M parameters of VGG16
+    UpdateOnlySolver<SolverType> solver(MakeParam(type, 1024, 2048));
+    solver.Step(1);
+    UpdateState state;
+    CopyState(&solver, &state);
+    CPUTimer timer;
+    timer.Start();
+    for (int i = 0; i < kIters; ++i) {
+      UnfusedUpdates(&solver, &state);
+    }
+    const float unfused_ms = timer.MilliSeconds() / kIters;
+    timer.Start();
+    for (int i = 0; i < kIters; ++i) {
+      solver.Update();
+    }
+    const float fused_ms = timer.MilliSeconds() / kIters;
+    LOG(INFO) << type << " update of " << solver.net()->learnable_params()[0]
+        ->count() << " weights: " << unfused_ms << " ms unfused, "
+        << fused_ms << " ms fused";
+  }
+};
+
+TYPED_TEST_CASE(FusedUpdateTest, TestDtypes);
+
+TYPED_TEST(FusedUpdateTest, TestAdaGradMatchesUnfused) {
+  this->template CheckFusedMatchesUnfused<AdaGradSolver<TypeParam> >(
+      "AdaGrad");
+}
+
+TYPED_TEST(FusedUpdateTest, TestRMSPropMatchesUnfused) {
+  this->template CheckFusedMatchesUnfused<RMSPropSolver<TypeParam> >(
+      "RMSProp");
+}
+
+TYPED_TEST(FusedUpdateTest, TestAdaDeltaMatchesUnfused) {
+  this->template CheckFusedMatchesUnfused<AdaDeltaSolver<TypeParam> >(
+      "AdaDelta");
+}
+
+TYPED_TEST(FusedUpdateTest, TestAdamMatchesUnfused) {
+  this->template CheckFusedMatchesUnfused<AdamSolver<TypeParam> >("Adam");
+}
+
+TYPED_TEST(FusedUpdateTest, TestBenchmarkUpdate) {
+  this->template TimeUpdate<AdaGradSolver<TypeParam> >("AdaGrad");
+  this->template TimeUpdate<RMSPropSolver<TypeParam> >("RMSProp");
+  this->template TimeUpdate<AdaDeltaSolver<TypeParam> >("AdaDelta");
+  this->template TimeUpdate<AdamSolver<TypeParam> >("Adam");
+}
+
 }  // namespace caffe
@@ -0,0 +1,330 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/hypercolumns_layer.hpp"
+#include "caffe/layers/hyperdeploy_layer.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+// The gpu backward scatters with plain +=, so only the cpu path is covered.
+template <typename Dtype>
+class HyperColumnsLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  HyperColumnsLayerTest()
+      : blob_bottom_normal_(new Blob<Dtype>(2, 3, 8, 8)),
+        blob_bottom_conv1_(new Blob<Dtype>(2, 4, 4, 4)),
+        blob_bottom_conv2_(new Blob<Dtype>(2, 5, 2, 2)),
+        blob_top_hypercolumns_(new Blob<Dtype>()),
+        blob_top_normal_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    filler_param.set_min(0.5);
+    filler_param.set_max(1);
+    UniformFiller<Dtype> normal_filler(filler_param);
+    normal_filler.Fill(blob_bottom_normal_);
+    filler_param.set_std(1);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob_bottom_conv1_);
+    filler.Fill(blob_bottom_conv2_);
+    blob_bottom_vec_.push_back(blob_bottom_normal_);
+    blob_bottom_vec_.push_back(blob_bottom_conv1_);
+    blob_bottom_vec_.push_back(blob_bottom_conv2_);
+    blob_top_vec_.push_back(blob_top_hypercolumns_);
+    blob_top_vec_.push_back(blob_top_normal_);
+  }
+  virtual ~HyperColumnsLayerTest() {
+    delete blob_bottom_normal_;
+    delete blob_bottom_conv1_;
+    delete blob_bottom_conv2_;
+    delete blob_top_hypercolumns_;
+    delete blob_top_normal_;
+  }
+
+  // Reference bilinear sample of bottom at the original pixel (h, w): the
+  // pixel center is mapped into the bottom and clamped to its border.
+  Dtype Sample(const Blob<Dtype>* bottom, int n, int c, int h, int w) {
+    const int scale = blob_bottom_normal_->height() / bottom->height();
+    const Dtype pad = (scale - 1.) / 2;
+    const Dtype y = std::min<Dtype>(std::max<Dtype>((h - pad) / scale, 0),
+                                    bottom->height() - 1);
+    const Dtype x = std::min<Dtype>(std::max<Dtype>((w - pad) / scale, 0),
+                                    bottom->width() - 1);
+    const int y0 = static_cast<int>(floor(y));
+    const int x0 = static_cast<int>(floor(x));
+    const int y1 = std::min(y0 + 1, bottom->height() - 1);
+    const int x1 = std::min(x0 + 1, bottom->width() - 1);
+    const Dtype dy = y - y0;
+    const Dtype dx = x - x0;
+    return (bottom->data_at(n, c, y0, x0) * (1 - dy)
+        + bottom->data_at(n, c, y1, x0) * dy) * (1 - dx)
+        + (bottom->data_at(n, c, y0, x1) * (1 - dy)
+        + bottom->data_at(n, c, y1, x1) * dy) * dx;
+  }
+
+  Blob<Dtype>* const blob_bottom_normal_;
+  Blob<Dtype>* const blob_bottom_conv1_;
+  Blob<Dtype>* const blob_bottom_conv2_;
+  Blob<Dtype>* const blob_top_hypercolumns_;
+  Blob<Dtype>* const blob_top_normal_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(HyperColumnsLayerTest, TestDtypes);
+
+TYPED_TEST(HyperColumnsLayerTest, TestSetUp) {
+  LayerParameter layer_param;
+  layer_param.mutable_hypercolumns_param()->set_is_train(false);
+  layer_param.mutable_hypercolumns_param()->set_skip_ratio(2);
+  HyperColumnsLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(2 * 32, this->blob_top_hypercolumns_->num());
+  EXPECT_EQ(4 + 5, this->blob_top_hypercolumns_->channels());
+  EXPECT_EQ(2 * 32, this->blob_top_normal_->shape(0));
+  EXPECT_EQ(3, this->blob_top_normal_->shape(1));
+}
+
+TYPED_TEST(HyperColumnsLayerTest, TestForwardTest) {
+  LayerParameter layer_param;
+  layer_param.mutable_hypercolumns_param()->set_is_train(false);
+  HyperColumnsLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const TypeParam* hypercolumns = this->blob_top_hypercolumns_->cpu_data();
+  const TypeParam* normal = this->blob_top_normal_->cpu_data();
+  for (int n = 0; n < 2; ++n) {
+    for (int h = 0; h < 8; ++h) {
+      for (int w = 0; w < 8; ++w) {
+        const int point = n * 64 + h * 8 + w;
+        for (int k = 0; k < 3; ++k) {
+          EXPECT_EQ(this->blob_bottom_normal_->data_at(n, k, h, w),
+                    normal[point * 3 + k]);
+        }
+        for (int c = 0; c < 4; ++c) {
+          EXPECT_NEAR(this->Sample(this->blob_bottom_conv1_, n, c, h, w),
+                      hypercolumns[point * 9 + c], 1e-5);
+        }
+        for (int c = 0; c < 5; ++c) {
+          EXPECT_NEAR(this->Sample(this->blob_bottom_conv2_, n, c, h, w),
+                      hypercolumns[point * 9 + 4 + c], 1e-5);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(HyperColumnsLayerTest, TestForwardReshape) {
+  LayerParameter layer_param;
+  layer_param.mutable_hypercolumns_param()->set_is_train(false);
+  HyperColumnsLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // the sampling tables follow the new bottom shapes
+  this->blob_bottom_normal_->Reshape(1, 3, 4, 4);
+  this->blob_bottom_conv1_->Reshape(1, 4, 2, 2);
+  this->blob_bottom_conv2_->Reshape(1, 5, 1, 1);
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->blob_bottom_conv1_);
+  filler.Fill(this->blob_bottom_conv2_);
+  layer.Reshape(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(16, this->blob_top_hypercolumns_->num());
+  const TypeParam* hypercolumns = this->blob_top_hypercolumns_->cpu_data();
+  for (int h = 0; h < 4; ++h) {
+    for (int w = 0; w < 4; ++w) {
+      for (int c = 0; c < 4; ++c) {
+        EXPECT_NEAR(this->Sample(this->blob_bottom_conv1_, 0, c, h, w),
+                    hypercolumns[(h * 4 + w) * 9 + c], 1e-5);
+      }
+      for (int c = 0; c < 5; ++c) {
+        EXPECT_NEAR(this->blob_bottom_conv2_->data_at(0, c, 0, 0),
+                    hypercolumns[(h * 4 + w) * 9 + 4 + c], 1e-5);
+      }
+    }
+  }
+}
+
+TYPED_TEST(HyperColumnsLayerTest, TestForwardTrain) {
+  // blank out the left half of the first image, it must never be sampled
+  for (int k = 0; k < 3; ++k) {
+    for (int h = 0; h < 8; ++h) {
+      for (int w = 0; w < 4; ++w) {
+        this->blob_bottom_normal_->mutable_cpu_data()[
+            this->blob_bottom_normal_->offset(0, k, h, w)] = 0;
+      }
+    }
+  }
+  LayerParameter layer_param;
+  layer_param.mutable_hypercolumns_param()->set_sample_num(16);
+  HyperColumnsLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(2 * 16, this->blob_top_normal_->shape(0));
+  const TypeParam* normal = this->blob_top_normal_->cpu_data();
+  for (int i = 0; i < this->blob_top_normal_->count(); ++i) {
+    EXPECT_GE(normal[i], 0.5);
+  }
+}
+
+TYPED_TEST(HyperColumnsLayerTest, TestForwardTrainFewValid) {
+  // leave three valid points in the first image and poison one more with a
+  // nan, every one of its rows must still come from the three
+  TypeParam* data = this->blob_bottom_normal_->mutable_cpu_data();
+  for (int k = 0; k < 3; ++k) {
+    for (int i = 3; i < 64; ++i) {
+      data[this->blob_bottom_normal_->offset(0, k) + i] = 0;
+    }
+  }
+  data[this->blob_bottom_normal_->offset(0, 1) + 10] = NAN;
+  LayerParameter layer_param;
+  layer_param.mutable_hypercolumns_param()->set_sample_num(16);
+  HyperColumnsLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(2 * 16, this->blob_top_normal_->shape(0));
+  const TypeParam* normal = this->blob_top_normal_->cpu_data();
+  for (int i = 0; i < this->blob_top_normal_->count(); ++i) {
+    EXPECT_GE(normal[i], 0.5);
+  }
+}
+
+TYPED_TEST(HyperColumnsLayerTest, TestForwardTrainSeeded) {
+  LayerParameter layer_param;
+  layer_param.mutable_hypercolumns_param()->set_sample_num(16);
+  layer_param.mutable_hypercolumns_param()->set_random_seed(1701);
+  HyperColumnsLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<TypeParam> hypercolumns;
+  hypercolumns.CopyFrom(*this->blob_top_hypercolumns_, false, true);
+  HyperColumnsLayer<TypeParam> layer_again(layer_param);
+  layer_again.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer_again.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < hypercolumns.count(); ++i) {
+    EXPECT_EQ(hypercolumns.cpu_data()[i],
+        this->blob_top_hypercolumns_->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(HyperColumnsLayerTest, TestThreadsMatchSerial) {
+  typedef TypeParam Dtype;
+  const int num_threads = ThreadPool::Global().num_threads();
+  LayerParameter layer_param;
+  layer_param.mutable_hypercolumns_param()->set_is_train(false);
+  HyperColumnsLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_top_hypercolumns_);
+  Blob<Dtype> top_diff;
+  top_diff.CopyFrom(*this->blob_top_hypercolumns_, false, true);
+  vector<bool> propagate_down(3, true);
+  // serial reference
+  ThreadPool::SetGlobalThreads(1);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  caffe_copy(top_diff.count(), top_diff.cpu_data(),
+             this->blob_top_hypercolumns_->mutable_cpu_diff());
+  layer.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  Blob<Dtype> top_ref, conv1_ref, conv2_ref;
+  top_ref.CopyFrom(*this->blob_top_hypercolumns_, false, true);
+  conv1_ref.CopyFrom(*this->blob_bottom_conv1_, true, true);
+  conv2_ref.CopyFrom(*this->blob_bottom_conv2_, true, true);
+  // the partitioning keeps the accumulation order, results are bit exact
+  for (int threads = 2; threads <= 4; ++threads) {
+    ThreadPool::SetGlobalThreads(threads);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+               this->blob_top_hypercolumns_->mutable_cpu_diff());
+    layer.Backward(this->blob_top_vec_, propagate_down,
+                   this->blob_bottom_vec_);
+    for (int i = 0; i < top_ref.count(); ++i) {
+      EXPECT_EQ(top_ref.cpu_data()[i],
+                this->blob_top_hypercolumns_->cpu_data()[i]);
+    }
+    for (int i = 0; i < conv1_ref.count(); ++i) {
+      EXPECT_EQ(conv1_ref.cpu_diff()[i],
+                this->blob_bottom_conv1_->cpu_diff()[i]);
+    }
+    for (int i = 0; i < conv2_ref.count(); ++i) {
+      EXPECT_EQ(conv2_ref.cpu_diff()[i],
+                this->blob_bottom_conv2_->cpu_diff()[i]);
+    }
+  }
+  ThreadPool::SetGlobalThreads(num_threads);
+}
+
+TYPED_TEST(HyperColumnsLayerTest, TestForwardChannelsLast) {
+  typedef TypeParam Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_hypercolumns_param()->set_is_train(false);
+  HyperColumnsLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> top_ref;
+  top_ref.CopyFrom(*this->blob_top_hypercolumns_, false, true);
+  // same arithmetic on transposed bottoms, results are bit exact
+  layer_param.mutable_hypercolumns_param()->set_channels_last(true);
+  HyperColumnsLayer<Dtype> layer_channels_last(layer_param);
+  layer_channels_last.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer_channels_last.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < top_ref.count(); ++i) {
+    EXPECT_EQ(top_ref.cpu_data()[i],
+              this->blob_top_hypercolumns_->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(HyperColumnsLayerTest, TestGradient) {
+  LayerParameter layer_param;
+  layer_param.mutable_hypercolumns_param()->set_is_train(false);
+  layer_param.mutable_hypercolumns_param()->set_skip_ratio(2);
+  HyperColumnsLayer<TypeParam> layer(layer_param);
+  GradientChecker<TypeParam> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 1);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 2);
+}
+
+TYPED_TEST(HyperColumnsLayerTest, TestDeployForward) {
+  LayerParameter layer_param;
+  HyperDeployLayer<TypeParam> layer(layer_param);
+  vector<Blob<TypeParam>*> top_vec(1, this->blob_top_hypercolumns_);
+  layer.SetUp(this->blob_bottom_vec_, top_vec);
+  EXPECT_EQ(2 * 64, this->blob_top_hypercolumns_->num());
+  EXPECT_EQ(3 + 4 + 5, this->blob_top_hypercolumns_->channels());
+  layer.Forward(this->blob_bottom_vec_, top_vec);
+  const TypeParam* hypercolumns = this->blob_top_hypercolumns_->cpu_data();
+  for (int n = 0; n < 2; ++n) {
+    for (int h = 0; h < 8; ++h) {
+      for (int w = 0; w < 8; ++w) {
+        const TypeParam* column = hypercolumns + (n * 64 + h * 8 + w) * 12;
+        for (int c = 0; c < 3; ++c) {
+          EXPECT_NEAR(this->blob_bottom_normal_->data_at(n, c, h, w),
+                      column[c], 1e-5);
+        }
+        for (int c = 0; c < 4; ++c) {
+          EXPECT_NEAR(this->Sample(this->blob_bottom_conv1_, n, c, h, w),
+                      column[3 + c], 1e-5);
+        }
+        for (int c = 0; c < 5; ++c) {
+          EXPECT_NEAR(this->Sample(this->blob_bottom_conv2_, n, c, h, w),
+                      column[7 + c], 1e-5);
+        }
+      }
+    }
+  }
+}
+
+}  // namespace caffe
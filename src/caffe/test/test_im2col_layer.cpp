@@ -6,6 +6,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/im2col_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -175,4 +176,52 @@ TYPED_TEST(Im2colLayerTest, TestRectGradient) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(Im2colLayerTest, TestFastPathsMatchND) {
+  typedef typename TypeParam::Dtype Dtype;
+  // large enough for the CPU im2col to split the channels over threads
+  vector<int> bottom_shape;
+  bottom_shape.push_back(2);
+  bottom_shape.push_back(16);
+  bottom_shape.push_back(40);
+  bottom_shape.push_back(37);
+  this->blob_bottom_->Reshape(bottom_shape);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  // 1x1, 3x3 same padding and a generic kernel
+  const int kernel[] = {1, 3, 3};
+  const int pad[] = {0, 1, 0};
+  for (int i = 0; i < 3; ++i) {
+    Blob<Dtype> top_nd, bottom_diff_nd;
+    for (int force_nd = 1; force_nd >= 0; --force_nd) {
+      LayerParameter layer_param;
+      ConvolutionParameter* convolution_param =
+          layer_param.mutable_convolution_param();
+      convolution_param->add_kernel_size(kernel[i]);
+      convolution_param->add_pad(pad[i]);
+      convolution_param->set_force_nd_im2col(force_nd);
+      Im2colLayer<Dtype> layer(layer_param);
+      layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      caffe_copy(this->blob_top_->count(), this->blob_top_->cpu_data(),
+          this->blob_top_->mutable_cpu_diff());
+      vector<bool> propagate_down(1, true);
+      layer.Backward(this->blob_top_vec_, propagate_down,
+          this->blob_bottom_vec_);
+      if (force_nd) {
+        top_nd.CopyFrom(*this->blob_top_, false, true);
+        bottom_diff_nd.CopyFrom(*this->blob_bottom_, true, true);
+        continue;
+      }
+      for (int j = 0; j < top_nd.count(); ++j) {
+        EXPECT_EQ(top_nd.cpu_data()[j], this->blob_top_->cpu_data()[j]);
+      }
+      for (int j = 0; j < bottom_diff_nd.count(); ++j) {
+        EXPECT_NEAR(bottom_diff_nd.cpu_diff()[j],
+            this->blob_bottom_->cpu_diff()[j], 1e-4);
+      }
+    }
+  }
+}
+
 }  // namespace caffe
@@ -0,0 +1,132 @@
+#include <boost/thread.hpp>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/inference_engine.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+static const int kClients = 4;
+static const int kRequests = 5;
+
+template <typename TypeParam>
+class InferenceEngineTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  InferenceEngineTest() {
+    const string proto =
+        "name: 'EngineNet' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { "
+        "  shape: { dim: 1 dim: 2 dim: 5 dim: 5 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv' "
+        "  convolution_param { "
+        "    num_output: 3 "
+        "    kernel_size: 3 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "    } "
+        "    bias_filler { "
+        "      type: 'gaussian' "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'conv' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 4 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "    } "
+        "  } "
+        "} ";
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param_));
+    // one input per client thread and request
+    inputs_.Reshape(kClients * kRequests, 2, 5, 5);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(&inputs_);
+    outputs_.resize(kClients * kRequests);
+  }
+
+  void Client(InferenceEngine<Dtype>* engine, int client) {
+    for (int i = client * kRequests; i < (client + 1) * kRequests; ++i) {
+      engine->Infer(inputs_.cpu_data() + inputs_.offset(i), &outputs_[i]);
+    }
+  }
+
+  void RunClients(InferenceEngine<Dtype>* engine, int clients) {
+    vector<shared_ptr<boost::thread> > threads;
+    for (int c = 0; c < clients; ++c) {
+      threads.push_back(shared_ptr<boost::thread>(new boost::thread(
+          &InferenceEngineTest::Client, this, engine, c)));
+    }
+    for (int c = 0; c < clients; ++c) {
+      threads[c]->join();
+    }
+  }
+
+  NetParameter param_;
+  Blob<Dtype> inputs_;
+  vector<vector<Dtype> > outputs_;
+};
+
+TYPED_TEST_CASE(InferenceEngineTest, TestDtypesAndDevices);
+
+TYPED_TEST(InferenceEngineTest, TestMatchesNet) {
+  typedef typename TypeParam::Dtype Dtype;
+  InferenceEngine<Dtype> engine(this->param_, "", 2, 3, 1000);
+  EXPECT_EQ(2 * 5 * 5, engine.input_count());
+  EXPECT_EQ(4, engine.output_count());
+  this->RunClients(&engine, kClients);
+  EXPECT_EQ(kClients * kRequests, static_cast<int>(engine.samples()));
+  // one sample at a time through a net sharing the weights
+  Net<Dtype> net(this->param_);
+  net.ShareTrainedLayersWith(engine.net().get());
+  Blob<Dtype>* input = net.input_blobs()[0];
+  for (int i = 0; i < this->outputs_.size(); ++i) {
+    caffe_copy(input->count(), this->inputs_.cpu_data() +
+        this->inputs_.offset(i), input->mutable_cpu_data());
+    net.Forward();
+    const Blob<Dtype>* output = net.output_blobs()[0];
+    ASSERT_EQ(output->count(), static_cast<int>(this->outputs_[i].size()));
+    for (int j = 0; j < output->count(); ++j) {
+      EXPECT_NEAR(output->cpu_data()[j], this->outputs_[i][j], 1e-4);
+    }
+  }
+}
+
+TYPED_TEST(InferenceEngineTest, TestBatching) {
+  typedef typename TypeParam::Dtype Dtype;
+  // long enough a wait for the requests of all the clients to meet
+  InferenceEngine<Dtype> engine(this->param_, "", 1, kClients,
+      10000000);
+  this->RunClients(&engine, kClients);
+  EXPECT_EQ(kClients * kRequests, static_cast<int>(engine.samples()));
+  EXPECT_EQ(kRequests, static_cast<int>(engine.batches()));
+}
+
+}  // namespace caffe
@@ -420,5 +420,74 @@ TEST_F(IOTest, TestDecodeDatumToCVMatContentNative) {
   }
 }
 
+TEST_F(IOTest, TestParseDatumInPlace) {
+  Datum datum_ref;
+  datum_ref.set_channels(2);
+  datum_ref.set_height(3);
+  datum_ref.set_width(4);
+  datum_ref.set_data(string("abcdefghijklmnopqrstuvwx"));
+  datum_ref.set_label(7);
+  datum_ref.add_float_data(0.5);
+  string value;
+  datum_ref.SerializeToString(&value);
+  Datum datum;
+  const char* data;
+  size_t data_size;
+  EXPECT_TRUE(ParseDatumInPlace(value.data(), value.size(), &datum, &data,
+      &data_size));
+  EXPECT_EQ(datum.channels(), 2);
+  EXPECT_EQ(datum.height(), 3);
+  EXPECT_EQ(datum.width(), 4);
+  EXPECT_EQ(datum.label(), 7);
+  ASSERT_EQ(datum.float_data_size(), 1);
+  EXPECT_EQ(datum.float_data(0), 0.5);
+  // the pixels are left in the buffer
+  EXPECT_TRUE(datum.data().empty());
+  EXPECT_GE(data, value.data());
+  EXPECT_LE(data + data_size, value.data() + value.size());
+  EXPECT_EQ(string(data, data_size), datum_ref.data());
+  // truncated
+  EXPECT_FALSE(ParseDatumInPlace(value.data(), value.size() - 1, &datum,
+      &data, &data_size));
+}
+
+TEST_F(IOTest, TestParseDatumInPlaceEmptyData) {
+  Datum datum_ref;
+  datum_ref.set_channels(1);
+  datum_ref.set_height(1);
+  datum_ref.set_width(2);
+  datum_ref.set_data(string());
+  datum_ref.add_float_data(0.5);
+  datum_ref.add_float_data(1.5);
+  string value;
+  datum_ref.SerializeToString(&value);
+  Datum datum;
+  const char* data;
+  size_t data_size;
+  EXPECT_TRUE(ParseDatumInPlace(value.data(), value.size(), &datum, &data,
+      &data_size));
+  // the pixels are in float_data
+  EXPECT_TRUE(data == NULL);
+  EXPECT_EQ(data_size, 0u);
+  ASSERT_EQ(datum.float_data_size(), 2);
+  EXPECT_EQ(datum.float_data(1), 1.5);
+}
+
+TEST_F(IOTest, TestParseDatumInPlaceEncoded) {
+  string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
+  Datum datum_ref;
+  EXPECT_TRUE(ReadFileToDatum(filename, &datum_ref));
+  string value;
+  datum_ref.SerializeToString(&value);
+  Datum datum;
+  const char* data;
+  size_t data_size;
+  EXPECT_TRUE(ParseDatumInPlace(value.data(), value.size(), &datum, &data,
+      &data_size));
+  EXPECT_TRUE(datum.encoded());
+  EXPECT_TRUE(data == NULL);
+  EXPECT_EQ(datum.data(), datum_ref.data());
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
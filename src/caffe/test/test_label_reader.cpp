@@ -0,0 +1,116 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/mapped_file.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class LabelReaderTest : public ::testing::Test {
+ public:
+  // Writes channels planes of column major rows x cols values, the value
+  // of (r, c, k) being r * 10000 + c * 10 + k
+  void WriteLabel(const string& filename, int rows, int cols, int channels) {
+    vector<float> data;
+    for (int k = 0; k < channels; ++k) {
+      for (int c = 0; c < cols; ++c) {
+        for (int r = 0; r < rows; ++r) {
+          data.push_back(r * 10000 + c * 10 + k);
+        }
+      }
+    }
+    FILE* fid = fopen(filename.c_str(), "wb");
+    ASSERT_TRUE(fid != NULL);
+    fwrite(&data[0], sizeof(float), data.size(), fid);
+    fclose(fid);
+  }
+
+  // The fread and per element scatter the label reader used to do
+  void ReadLabelReference(const string& filename, int rows, int cols,
+      int channels, float* dst) {
+    vector<float> buffer(rows * cols * channels);
+    FILE* fid = fopen(filename.c_str(), "rb");
+    ASSERT_TRUE(fid != NULL);
+    ASSERT_EQ(buffer.size(),
+        fread(&buffer[0], sizeof(float), buffer.size(), fid));
+    fclose(fid);
+    int count = 0;
+    for (int k = 0; k < channels; ++k) {
+      for (int c = 0; c < cols; ++c) {
+        for (int r = 0; r < rows; ++r) {
+          dst[(r * cols + c) * channels + k] = buffer[count++];
+        }
+      }
+    }
+  }
+};
+
+TEST_F(LabelReaderTest, TestMappedFile) {
+  string filename;
+  MakeTempFilename(&filename);
+  WriteLabel(filename, 3, 5, 2);
+  MappedFile file;
+  ASSERT_TRUE(file.Open(filename));
+  EXPECT_EQ(3 * 5 * 2 * sizeof(float), file.size());
+  const float* data = reinterpret_cast<const float*>(file.data());
+  EXPECT_EQ(10000 * 2 + 10 * 1 + 0, data[5]);
+  file.Close();
+  EXPECT_TRUE(file.data() == NULL);
+  EXPECT_FALSE(file.Open(filename + ".missing"));
+}
+
+TEST_F(LabelReaderTest, TestReadLabel) {
+  // sizes that are not multiples of the tile
+  const int rows = 37, cols = 45, channels = 3;
+  string filename;
+  MakeTempFilename(&filename);
+  WriteLabel(filename, rows, cols, channels);
+  vector<float> label(rows * cols * channels);
+  ASSERT_TRUE(ReadLabelToBuffer(filename, rows, cols, channels, &label[0]));
+  for (int r = 0; r < rows; ++r) {
+    for (int c = 0; c < cols; ++c) {
+      for (int k = 0; k < channels; ++k) {
+        EXPECT_EQ(r * 10000 + c * 10 + k,
+            label[(r * cols + c) * channels + k]);
+      }
+    }
+  }
+  EXPECT_FALSE(ReadLabelToBuffer(filename, rows, cols + 1, channels,
+      &label[0]));
+}
+
+TEST_F(LabelReaderTest, TestReadLabelBenchmark) {
+  // a surface normal label of a 640 x 480 image
+  const int rows = 480, cols = 640, channels = 3;
+  const int iterations = 10;
+  string filename;
+  MakeTempFilename(&filename);
+  WriteLabel(filename, rows, cols, channels);
+  vector<float> reference(rows * cols * channels);
+  vector<float> label(rows * cols * channels);
+  CPUTimer timer;
+  timer.Start();
+  for (int i = 0; i < iterations; ++i) {
+    ReadLabelReference(filename, rows, cols, channels, &reference[0]);
+  }
+  const float reference_ms = timer.MilliSeconds() / iterations;
+  timer.Start();
+  for (int i = 0; i < iterations; ++i) {
+    ASSERT_TRUE(ReadLabelToBuffer(filename, rows, cols, channels, &label[0]));
+  }
+  const float mapped_ms = timer.MilliSeconds() / iterations;
+  LOG(INFO) << "fread label: " << reference_ms << " ms, mapped label: "
+      << mapped_ms << " ms";
+  for (int i = 0; i < label.size(); ++i) {
+    EXPECT_EQ(reference[i], label[i]);
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,113 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/memory_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+static int system_blocks = 0;
+
+static void* CountingMalloc(size_t size) {
+  ++system_blocks;
+  return malloc(size);
+}
+
+static void CountingFree(void* ptr) {
+  --system_blocks;
+  free(ptr);
+}
+
+class MemoryPoolTest : public ::testing::Test {
+ protected:
+  MemoryPoolTest() : pool_(&CountingMalloc, &CountingFree) {
+    system_blocks = 0;
+  }
+
+  MemoryPool pool_;
+};
+
+TEST_F(MemoryPoolTest, TestSizeClass) {
+  EXPECT_EQ(256, MemoryPool::SizeClass(0));
+  EXPECT_EQ(256, MemoryPool::SizeClass(256));
+  EXPECT_EQ(320, MemoryPool::SizeClass(257));
+  EXPECT_EQ(1024, MemoryPool::SizeClass(1024));
+  EXPECT_EQ(1280, MemoryPool::SizeClass(1025));
+  EXPECT_EQ(1792, MemoryPool::SizeClass(1700));
+  // never more than a quarter lost
+  for (size_t size = 1000; size < 100000; size += 77) {
+    EXPECT_GE(MemoryPool::SizeClass(size), size);
+    EXPECT_LE(MemoryPool::SizeClass(size), size * 5 / 4);
+  }
+}
+
+TEST_F(MemoryPoolTest, TestReuse) {
+  void* ptr = pool_.Allocate(1000);
+  pool_.Free(ptr);
+  // the same class
+  EXPECT_EQ(ptr, pool_.Allocate(1010));
+  void* other = pool_.Allocate(5000);
+  EXPECT_NE(ptr, other);
+  EXPECT_EQ(2, system_blocks);
+  MemoryPoolStats stats = pool_.stats();
+  EXPECT_EQ(1, stats.hits);
+  EXPECT_EQ(2, stats.misses);
+  EXPECT_EQ(1010 + 5000, stats.requested_bytes);
+  EXPECT_EQ(1024 + 5120, stats.allocated_bytes);
+  EXPECT_EQ(0, stats.cached_bytes);
+  EXPECT_NEAR(1. - 6010. / 6144., stats.fragmentation(), 1e-9);
+  pool_.Free(ptr);
+  pool_.Free(other);
+}
+
+TEST_F(MemoryPoolTest, TestRelease) {
+  void* ptr = pool_.Allocate(1000);
+  void* other = pool_.Allocate(3000);
+  pool_.Free(ptr);
+  pool_.Free(other);
+  MemoryPoolStats stats = pool_.stats();
+  EXPECT_EQ(0, stats.allocated_bytes);
+  EXPECT_EQ(1024 + 3072, stats.cached_bytes);
+  EXPECT_EQ(1024 + 3072, stats.peak_bytes);
+  EXPECT_EQ(2, system_blocks);
+  pool_.Release();
+  stats = pool_.stats();
+  EXPECT_EQ(0, stats.cached_bytes);
+  EXPECT_EQ(2, stats.releases);
+  EXPECT_EQ(0, system_blocks);
+  ptr = pool_.Allocate(1000);
+  EXPECT_EQ(3, pool_.stats().misses);
+  pool_.Free(ptr);
+}
+
+TEST_F(MemoryPoolTest, TestSyncedMemory) {
+  Caffe::set_mode(Caffe::CPU);
+  MemoryPool& host = MemoryPool::Host(false);
+  // a size no other test caches
+  const size_t size = 123457;
+  {
+    SyncedMemory mem(size);
+    memset(mem.mutable_cpu_data(), 1, size);
+  }
+  const MemoryPoolStats stats = host.stats();
+  EXPECT_GE(stats.cached_bytes, MemoryPool::SizeClass(size));
+  {
+    SyncedMemory mem(size);
+    const char* data = static_cast<const char*>(mem.cpu_data());
+    // zeroed again
+    for (int i = 0; i < size; ++i) {
+      EXPECT_EQ(0, data[i]);
+    }
+  }
+  EXPECT_EQ(stats.hits + 1, host.stats().hits);
+  EXPECT_EQ(stats.misses, host.stats().misses);
+  MemoryPool::ReleaseAll();
+  EXPECT_EQ(0, host.stats().cached_bytes);
+}
+
+}  // namespace caffe
@@ -1,14 +1,21 @@
+#include <fstream>  // NOLINT(readability/streams)
+#include <sstream>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "google/protobuf/text_format.h"
 
+#include "hdf5.h"
+
 #include "gtest/gtest.h"
 
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/layers/conv_layer.hpp"
 #include "caffe/net.hpp"
+#include "caffe/util/hdf5.hpp"
+#include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -617,6 +624,161 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoString(proto);
   }
 
+  virtual void InitPlannedNet(const bool plan_memory,
+                              const bool direct_conv = false) {
+    string proto =
+        "name: 'PlannedNetwork' "
+        "state { phase: TEST } "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { "
+        "  shape: { dim: 2 dim: 3 dim: 10 dim: 10 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'conv2' "
+        "  type: 'Convolution' "
+        "  bottom: 'conv1' "
+        "  top: 'conv2' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'flatten' "
+        "  type: 'Flatten' "
+        "  bottom: 'conv2' "
+        "  top: 'flatten' "
+        "} "
+        "layer { "
+        "  name: 'ip_a' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'flatten' "
+        "  top: 'ip_a' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'ip_b' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'flatten' "
+        "  top: 'ip_b' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'sum' "
+        "  type: 'Eltwise' "
+        "  bottom: 'ip_a' "
+        "  bottom: 'ip_b' "
+        "  top: 'sum' "
+        "} ";
+    if (plan_memory) {
+      proto += "plan_memory: true ";
+    }
+    if (direct_conv) {
+      const string kernel = "kernel_size: 3 ";
+      for (size_t pos = proto.find(kernel); pos != string::npos;
+           pos = proto.find(kernel, pos + 1)) {
+        proto.insert(pos, "engine: DIRECT ");
+        pos += kernel.size();
+      }
+    }
+    InitNetFromProtoString(proto);
+  }
+
+  virtual void InitFlatNet(const bool flat_params) {
+    string proto =
+        "name: 'FlatNetwork' "
+        "state { phase: TRAIN } "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 5 dim: 2 dim: 3 dim: 4 } "
+        "    data_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.01 "
+        "    } "
+        "  } "
+        "  top: 'data' "
+        "} "
+        "layer { "
+        "  name: 'innerproduct1' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 10 "
+        "    } "
+        "  } "
+        "  param { name: 'sharedweights' } "
+        "  param { lr_mult: 2 } "
+        "  bottom: 'data' "
+        "  top: 'innerproduct1' "
+        "} "
+        "layer { "
+        "  name: 'innerproduct2' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 10 "
+        "    } "
+        "  } "
+        "  param { name: 'sharedweights' } "
+        "  param { lr_mult: 2 } "
+        "  bottom: 'data' "
+        "  top: 'innerproduct2' "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'innerproduct1' "
+        "  bottom: 'innerproduct2' "
+        "} ";
+    if (flat_params) {
+      proto += "flat_params: true ";
+    }
+    InitNetFromProtoString(proto);
+  }
+
   virtual void InitSkipPropNet(bool test_skip_true) {
     string proto =
       "name: 'SkipPropTestNetwork' "
@@ -2473,4 +2635,251 @@ TYPED_TEST(NetTest, TestForcePropagateDown) {
   }
 }
 
+TYPED_TEST(NetTest, TestPlanMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> data(2, 3, 10, 10);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&data);
+  Blob<Dtype> output;
+  for (int plan_memory = 0; plan_memory <= 1; ++plan_memory) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitPlannedNet(plan_memory);
+    caffe_copy(data.count(), data.cpu_data(),
+        this->net_->blob_by_name("data")->mutable_cpu_data());
+    // twice, as the shared buffers are dirty the second time
+    for (int iter = 0; iter < 2; ++iter) {
+      this->net_->Forward();
+      const Blob<Dtype>* sum = this->net_->blob_by_name("sum").get();
+      if (!plan_memory) {
+        output.CopyFrom(*sum, false, true);
+        continue;
+      }
+      for (int i = 0; i < output.count(); ++i) {
+        EXPECT_EQ(output.cpu_data()[i], sum->cpu_data()[i]);
+      }
+    }
+  }
+  // conv1 and ip_a, used one after the other, share a buffer
+  const size_t naive = sizeof(Dtype) *
+      (this->net_->blob_by_name("conv1")->count() +
+       this->net_->blob_by_name("conv2")->count() +
+       this->net_->blob_by_name("ip_a")->count() +
+       this->net_->blob_by_name("ip_b")->count());
+  EXPECT_EQ(naive - sizeof(Dtype) * this->net_->blob_by_name("ip_a")->count(),
+      this->net_->planned_memory());
+}
+
+TYPED_TEST(NetTest, TestFlatParams) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<shared_ptr<Blob<Dtype> > > expected;
+  for (int flat_params = 0; flat_params <= 1; ++flat_params) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitFlatNet(flat_params);
+    const vector<Blob<Dtype>*>& params = this->net_->learnable_params();
+    // the shared weights and the two biases
+    ASSERT_EQ(3, params.size());
+    Blob<Dtype>* flat = this->net_->flat_cpu_params();
+    if (!flat_params || Caffe::mode() != Caffe::CPU) {
+      EXPECT_TRUE(flat == NULL);
+    } else {
+      ASSERT_TRUE(flat != NULL);
+      int offset = 0;
+      for (int i = 0; i < params.size(); ++i) {
+        EXPECT_EQ(flat->cpu_data() + offset, params[i]->cpu_data());
+        EXPECT_EQ(flat->cpu_diff() + offset, params[i]->cpu_diff());
+        offset += params[i]->count();
+      }
+      EXPECT_EQ(flat->count(), offset);
+      const vector<shared_ptr<Blob<Dtype> > >& layer_params =
+          this->net_->layers()[2]->blobs();
+      EXPECT_EQ(params[0]->cpu_data(), layer_params[0]->cpu_data());
+    }
+    this->net_->Forward();
+    this->net_->Backward();
+    this->net_->Update();
+    if (!flat_params) {
+      this->CopyNetParams(false, &expected);
+    } else {
+      // the same initial values and the same update
+      const vector<shared_ptr<Blob<Dtype> > >& actual = this->net_->params();
+      ASSERT_EQ(expected.size(), actual.size());
+      for (int i = 0; i < actual.size(); ++i) {
+        for (int j = 0; j < actual[i]->count(); ++j) {
+          EXPECT_EQ(expected[i]->cpu_data()[j], actual[i]->cpu_data()[j]);
+        }
+      }
+    }
+    this->net_->ClearParamDiffs();
+    for (int i = 0; i < params.size(); ++i) {
+      for (int j = 0; j < params[i]->count(); ++j) {
+        EXPECT_EQ(0, params[i]->cpu_diff()[j]);
+      }
+    }
+  }
+  // params given other memory leave the flat layout
+  Blob<Dtype> other(this->net_->learnable_params()[1]->shape());
+  this->net_->learnable_params()[1]->data()->set_cpu_data(
+      other.mutable_cpu_data());
+  EXPECT_TRUE(this->net_->flat_cpu_params() == NULL);
+}
+
+TYPED_TEST(NetTest, TestSharedWorkspace) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitPlannedNet(false);
+  // the largest column buffer, that of conv2: 4 channels x 3 x 3 x 8 x 8
+  EXPECT_EQ(4 * 3 * 3 * 8 * 8 * sizeof(Dtype),
+      this->net_->workspace()->size());
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->net_->blob_by_name("data").get());
+  this->net_->Forward();
+  // conv2, run after conv1 dirtied the workspace, matches a layer with its
+  // own column buffer
+  const shared_ptr<Layer<Dtype> > conv2 = this->net_->layer_by_name("conv2");
+  ConvolutionLayer<Dtype> layer(conv2->layer_param());
+  vector<Blob<Dtype>*> bottom(1, this->net_->blob_by_name("conv1").get());
+  Blob<Dtype> top_blob;
+  vector<Blob<Dtype>*> top(1, &top_blob);
+  layer.SetUp(bottom, top);
+  for (int i = 0; i < layer.blobs().size(); ++i) {
+    layer.blobs()[i]->CopyFrom(*conv2->blobs()[i]);
+  }
+  layer.Forward(bottom, top);
+  const Blob<Dtype>* net_top = this->net_->blob_by_name("conv2").get();
+  ASSERT_EQ(top_blob.count(), net_top->count());
+  for (int i = 0; i < top_blob.count(); ++i) {
+    EXPECT_EQ(top_blob.cpu_data()[i], net_top->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(NetTest, TestSharedWorkspaceDirect) {
+  typedef typename TypeParam::Dtype Dtype;
+  const bool kDirectConv = true;
+  this->InitPlannedNet(false, kDirectConv);
+  // the padded buffers of conv2, not its columns: 4 x 10 x 10 in and out
+  // and the 2 x 10 + 2 values its furthest taps read past the input
+  EXPECT_EQ((4 * 10 * 10 + 22 + 4 * 10 * 10) * sizeof(Dtype),
+      this->net_->workspace()->size());
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->net_->blob_by_name("data").get());
+  this->net_->Forward();
+  // matches the columns of a layer of the default engine
+  const shared_ptr<Layer<Dtype> > conv2 = this->net_->layer_by_name("conv2");
+  LayerParameter layer_param(conv2->layer_param());
+  layer_param.mutable_convolution_param()->clear_engine();
+  ConvolutionLayer<Dtype> layer(layer_param);
+  vector<Blob<Dtype>*> bottom(1, this->net_->blob_by_name("conv1").get());
+  Blob<Dtype> top_blob;
+  vector<Blob<Dtype>*> top(1, &top_blob);
+  layer.SetUp(bottom, top);
+  for (int i = 0; i < layer.blobs().size(); ++i) {
+    layer.blobs()[i]->CopyFrom(*conv2->blobs()[i]);
+  }
+  layer.Forward(bottom, top);
+  const Blob<Dtype>* net_top = this->net_->blob_by_name("conv2").get();
+  ASSERT_EQ(top_blob.count(), net_top->count());
+  for (int i = 0; i < top_blob.count(); ++i) {
+    EXPECT_NEAR(top_blob.cpu_data()[i], net_top->cpu_data()[i], 1e-4);
+  }
+}
+
+TYPED_TEST(NetTest, TestProfile) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitTinyNet();
+  this->net_->set_profile(true);
+  for (int i = 0; i < 2; ++i) {
+    this->net_->ForwardBackward();
+  }
+  const vector<LayerProfile>& profiles = this->net_->layer_profiles();
+  ASSERT_EQ(3, profiles.size());
+  // the data layer needs no backward
+  EXPECT_EQ(2, profiles[0].forward_calls);
+  EXPECT_EQ(0, profiles[0].backward_calls);
+  const LayerProfile& ip = profiles[1];
+  EXPECT_EQ(2, ip.forward_calls);
+  EXPECT_EQ(2, ip.backward_calls);
+  EXPECT_GE(ip.forward_ms, 0);
+  EXPECT_GE(ip.backward_ms, 0);
+  EXPECT_EQ(2. * 5 * 24 * 1000, ip.forward_flops);
+  // the top, allocated in the first Forward
+  EXPECT_GE(ip.malloc_bytes, 5 * 1000 * sizeof(Dtype));
+  EXPECT_EQ(2, profiles[2].backward_calls);
+  // one event per layer call
+  string filename;
+  MakeTempFilename(&filename);
+  this->net_->WriteChromeTrace(filename);
+  std::ifstream file(filename.c_str());
+  std::stringstream trace;
+  trace << file.rdbuf();
+  int events = 0;
+  for (size_t pos = trace.str().find("\"ph\":\"X\""); pos != string::npos;
+       pos = trace.str().find("\"ph\":\"X\"", pos + 1)) {
+    ++events;
+  }
+  EXPECT_EQ(2 * 3 + 2 * 2, events);
+  EXPECT_NE(string::npos, trace.str().find("\"name\":\"innerproduct\""));
+  this->net_->ResetProfile();
+  EXPECT_EQ(0, this->net_->layer_profiles()[1].forward_calls);
+}
+
+TYPED_TEST(NetTest, TestTraceTransfers) {
+  this->InitTinyNet();
+  this->net_->set_trace_transfers(true);
+  this->net_->ForwardBackward();
+  const vector<BlobTransfers>& transfers = this->net_->transfers();
+  if (Caffe::mode() == Caffe::CPU) {
+    EXPECT_EQ(0, transfers.size());
+  } else {
+    // the data layer fills its tops on the host
+    bool found = false;
+    for (int i = 0; i < transfers.size(); ++i) {
+      found |= transfers[i].layer == "innerproduct" &&
+          transfers[i].blob == "data" && transfers[i].to_gpu;
+    }
+    EXPECT_TRUE(found);
+  }
+  this->net_->ClearTransfers();
+  EXPECT_EQ(0, this->net_->transfers().size());
+}
+
+TYPED_TEST(NetTest, TestHDF5Compression) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitTinyNet();
+  const vector<Blob<Dtype>*>& params = this->net_->learnable_params();
+  vector<Dtype> expected;
+  for (int i = 0; i < params.size(); ++i) {
+    expected.insert(expected.end(), params[i]->cpu_data(),
+        params[i]->cpu_data() + params[i]->count());
+  }
+  string filename;
+  MakeTempFilename(&filename);
+  filename += ".h5";
+  this->net_->ToHDF5(filename, false, 1);
+  // the weights are stored chunked and deflated
+  hid_t file_hid = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  ASSERT_GE(file_hid, 0);
+  hid_t dataset_hid = H5Dopen2(file_hid, "data/innerproduct/0", H5P_DEFAULT);
+  ASSERT_GE(dataset_hid, 0);
+  hid_t plist_hid = H5Dget_create_plist(dataset_hid);
+  EXPECT_EQ(H5D_CHUNKED, H5Pget_layout(plist_hid));
+  EXPECT_GE(H5Pget_filter_by_id2(plist_hid, H5Z_FILTER_DEFLATE, NULL, NULL,
+      NULL, 0, NULL, NULL), 0);
+  H5Pclose(plist_hid);
+  H5Dclose(dataset_hid);
+  H5Fclose(file_hid);
+  // and read back as they were written
+  for (int i = 0; i < params.size(); ++i) {
+    caffe_set(params[i]->count(), Dtype(0), params[i]->mutable_cpu_data());
+  }
+  this->net_->CopyTrainedLayersFrom(filename);
+  int k = 0;
+  for (int i = 0; i < params.size(); ++i) {
+    for (int j = 0; j < params[i]->count(); ++j, ++k) {
+      EXPECT_EQ(expected[k], params[i]->cpu_data()[j]);
+    }
+  }
+}
+
 }  // namespace caffe
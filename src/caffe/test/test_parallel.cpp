@@ -0,0 +1,138 @@
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/parallel.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/sgd_solvers.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class CPUSyncTest : public CPUDeviceTest<Dtype> {
+ protected:
+  CPUSyncTest() {
+    // The same batch for every solver, so that training on any number of
+    // them follows the path of a single solver. The data layer is shared
+    // with the worker nets, which only see what it refills on every forward,
+    // hence uniform fillers of a single value rather than constant ones.
+    const string proto =
+        "max_iter: 6 "
+        "base_lr: 0.1 "
+        "lr_policy: 'fixed' "
+        "momentum: 0.9 "
+        "weight_decay: 0.01 "
+        "random_seed: 1701 "
+        "solver_mode: CPU "
+        "snapshot_after_train: false "
+        "net_param { "
+        "  name: 'TestNetwork' "
+        "  layer { "
+        "    name: 'data' "
+        "    type: 'DummyData' "
+        "    dummy_data_param { "
+        "      shape { dim: 4 dim: 3 dim: 2 dim: 2 } "
+        "      shape { dim: 4 dim: 2 } "
+        "      data_filler { type: 'uniform' min: 0.5 max: 0.5 } "
+        "      data_filler { type: 'uniform' min: 1 max: 1 } "
+        "    } "
+        "    top: 'data' "
+        "    top: 'targets' "
+        "  } "
+        "  layer { "
+        "    name: 'innerprod' "
+        "    type: 'InnerProduct' "
+        "    inner_product_param { "
+        "      num_output: 2 "
+        "      weight_filler { "
+        "        type: 'gaussian' "
+        "        std: 1.0 "
+        "      } "
+        "      bias_filler { "
+        "        type: 'gaussian' "
+        "        std: 1.0 "
+        "      } "
+        "    } "
+        "    bottom: 'data' "
+        "    top: 'innerprod' "
+        "  } "
+        "  layer { "
+        "    name: 'loss' "
+        "    type: 'EuclideanLoss' "
+        "    bottom: 'innerprod' "
+        "    bottom: 'targets' "
+        "  } "
+        "} ";
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param_));
+  }
+
+  // Trains on num_solvers solvers and returns the learned parameters
+  vector<Dtype> Train(int num_solvers) {
+    Caffe::set_solver_count(num_solvers);
+    shared_ptr<Solver<Dtype> > solver(new SGDSolver<Dtype>(param_));
+    vector<Dtype> params;
+    {
+      // the parameters live in the sync while it does
+      shared_ptr<CPUSync<Dtype> > sync;
+      if (num_solvers > 1) {
+        sync.reset(new CPUSync<Dtype>(solver, NULL, solver->param(), 0));
+        sync->Run(num_solvers);
+      } else {
+        solver->Solve();
+      }
+      EXPECT_EQ(param_.max_iter(), solver->iter());
+      const vector<Blob<Dtype>*>& blobs = solver->net()->learnable_params();
+      for (int i = 0; i < blobs.size(); ++i) {
+        params.insert(params.end(), blobs[i]->cpu_data(),
+            blobs[i]->cpu_data() + blobs[i]->count());
+      }
+    }
+    Caffe::set_solver_count(1);
+    return params;
+  }
+
+  SolverParameter param_;
+};
+
+TYPED_TEST_CASE(CPUSyncTest, TestDtypes);
+
+TYPED_TEST(CPUSyncTest, TestMatchesSingleSolver) {
+  const vector<TypeParam> expected = this->Train(1);
+  for (int num_solvers = 2; num_solvers <= 4; ++num_solvers) {
+    const vector<TypeParam> params = this->Train(num_solvers);
+    ASSERT_EQ(expected.size(), params.size());
+    for (int i = 0; i < params.size(); ++i) {
+      EXPECT_NEAR(expected[i], params[i], 1e-4);
+    }
+  }
+}
+
+TYPED_TEST(CPUSyncTest, TestTrainsFromCurrentIter) {
+  // a solver restored from a snapshot starts every solver there
+  this->param_.set_max_iter(3);
+  const vector<TypeParam> expected = this->Train(1);
+  Caffe::set_solver_count(3);
+  shared_ptr<Solver<TypeParam> > solver(
+      new SGDSolver<TypeParam>(this->param_));
+  solver->Step(1);
+  CPUSync<TypeParam> sync(solver, NULL, solver->param(), 0);
+  EXPECT_EQ(1, sync.initial_iter());
+  sync.Run(3);
+  Caffe::set_solver_count(1);
+  EXPECT_EQ(3, solver->iter());
+  const vector<Blob<TypeParam>*>& blobs = solver->net()->learnable_params();
+  int k = 0;
+  for (int i = 0; i < blobs.size(); ++i) {
+    for (int j = 0; j < blobs[i]->count(); ++j, ++k) {
+      EXPECT_NEAR(expected[k], blobs[i]->cpu_data()[j], 1e-4);
+    }
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,202 @@
+#ifdef USE_OPENCV
+#include <cstdio>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "boost/scoped_ptr.hpp"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/pixel_wise_data_layer.hpp"
+#include "caffe/layers/pixel_wise_db_data_layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/db.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+using boost::scoped_ptr;
+
+template <typename Dtype>
+class PixelWiseDataLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  PixelWiseDataLayerTest()
+      : blob_top_data_(new Blob<Dtype>()),
+        blob_top_label_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    blob_top_vec_.push_back(blob_top_data_);
+    blob_top_vec_.push_back(blob_top_label_);
+    Caffe::set_random_seed(1701);
+    // a 3 channel label of the size of cat.jpg, stored as matlab does
+    const int rows = 360, cols = 480, channels = 3;
+    MakeTempFilename(&label_filename_);
+    vector<float> label;
+    for (int k = 0; k < channels; ++k) {
+      for (int c = 0; c < cols; ++c) {
+        for (int r = 0; r < rows; ++r) {
+          label.push_back(k + 1);
+        }
+      }
+    }
+    FILE* fid = fopen(label_filename_.c_str(), "wb");
+    fwrite(&label[0], sizeof(float), label.size(), fid);
+    fclose(fid);
+    MakeTempFilename(&filename_);
+    std::ofstream outfile(filename_.c_str(), std::ofstream::out);
+    for (int i = 0; i < 5; ++i) {
+      outfile << EXAMPLES_SOURCE_DIR "images/cat.jpg " << label_filename_
+              << std::endl;
+    }
+    outfile.close();
+  }
+
+  virtual ~PixelWiseDataLayerTest() {
+    delete blob_top_data_;
+    delete blob_top_label_;
+  }
+
+  void FillParam(LayerParameter* param, int decode_threads) {
+    PixelWiseDataParameter* pixel_wise_data_param =
+        param->mutable_pixel_wise_data_param();
+    pixel_wise_data_param->set_batch_size(5);
+    pixel_wise_data_param->set_source(filename_.c_str());
+    pixel_wise_data_param->set_new_height(36);
+    pixel_wise_data_param->set_new_width(48);
+    pixel_wise_data_param->set_label_channel(3);
+    pixel_wise_data_param->set_decode_threads(decode_threads);
+  }
+
+  // Packs the list into a db as convert_pixelwise_imageset does, and reads
+  // it back, expecting the batch the file based layer produces
+  void TestReadDB(DataParameter_DB backend) {
+    LayerParameter file_param;
+    FillParam(&file_param, 1);
+    PixelWiseDataLayer<Dtype> file_layer(file_param);
+    file_layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    file_layer.Forward(blob_bottom_vec_, blob_top_vec_);
+    Blob<Dtype> data, label;
+    data.CopyFrom(*blob_top_data_, false, true);
+    label.CopyFrom(*blob_top_label_, false, true);
+
+    string db_name;
+    MakeTempDir(&db_name);
+    db_name += "/db";
+    scoped_ptr<db::DB> db(db::GetDB(backend));
+    db->Open(db_name, db::NEW);
+    scoped_ptr<db::Transaction> txn(db->NewTransaction());
+    for (int i = 0; i < 5; ++i) {
+      Datum datum;
+      ASSERT_TRUE(ReadPixelWiseToDatum(EXAMPLES_SOURCE_DIR "images/cat.jpg",
+          label_filename_, 3, 36, 48, true, "png", &datum));
+      EXPECT_EQ(36 * 48 * 3, datum.float_data_size());
+      string out;
+      CHECK(datum.SerializeToString(&out));
+      txn->Put(caffe::format_int(i, 8), out);
+    }
+    txn->Commit();
+    db->Close();
+
+    LayerParameter param;
+    param.mutable_pixel_wise_data_param()->set_label_channel(3);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(db_name.c_str());
+    data_param->set_backend(backend);
+    PixelWiseDBDataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    EXPECT_EQ(5, blob_top_data_->num());
+    EXPECT_EQ(3, blob_top_data_->channels());
+    EXPECT_EQ(36, blob_top_data_->height());
+    EXPECT_EQ(48, blob_top_data_->width());
+    EXPECT_EQ(3, blob_top_label_->channels());
+    EXPECT_EQ(36, blob_top_label_->height());
+    EXPECT_EQ(48, blob_top_label_->width());
+    layer.Forward(blob_bottom_vec_, blob_top_vec_);
+    for (int i = 0; i < data.count(); ++i) {
+      EXPECT_EQ(data.cpu_data()[i], blob_top_data_->cpu_data()[i]);
+    }
+    for (int i = 0; i < label.count(); ++i) {
+      EXPECT_EQ(label.cpu_data()[i], blob_top_label_->cpu_data()[i]);
+    }
+  }
+
+  string filename_;
+  string label_filename_;
+  Blob<Dtype>* const blob_top_data_;
+  Blob<Dtype>* const blob_top_label_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(PixelWiseDataLayerTest, TestDtypes);
+
+TYPED_TEST(PixelWiseDataLayerTest, TestRead) {
+  LayerParameter param;
+  this->FillParam(&param, 2);
+  PixelWiseDataLayer<TypeParam> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(5, this->blob_top_data_->num());
+  EXPECT_EQ(3, this->blob_top_data_->channels());
+  EXPECT_EQ(36, this->blob_top_data_->height());
+  EXPECT_EQ(48, this->blob_top_data_->width());
+  EXPECT_EQ(5, this->blob_top_label_->num());
+  EXPECT_EQ(3, this->blob_top_label_->channels());
+  EXPECT_EQ(36, this->blob_top_label_->height());
+  EXPECT_EQ(48, this->blob_top_label_->width());
+  for (int iter = 0; iter < 2; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int n = 0; n < 5; ++n) {
+      for (int k = 0; k < 3; ++k) {
+        const TypeParam* label = this->blob_top_label_->cpu_data() +
+            this->blob_top_label_->offset(n, k);
+        for (int i = 0; i < 36 * 48; ++i) {
+          EXPECT_NEAR(k + 1, label[i], 1e-5);
+        }
+      }
+    }
+  }
+  typename PixelWiseDataLayer<TypeParam>::PrefetchTimes times =
+      layer.prefetch_times();
+  EXPECT_GE(times.batches, 2);
+}
+
+TYPED_TEST(PixelWiseDataLayerTest, TestThreadsMatchSerial) {
+  LayerParameter serial_param;
+  this->FillParam(&serial_param, 1);
+  PixelWiseDataLayer<TypeParam> serial_layer(serial_param);
+  serial_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  serial_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<TypeParam> data, label;
+  data.CopyFrom(*this->blob_top_data_, false, true);
+  label.CopyFrom(*this->blob_top_label_, false, true);
+  LayerParameter param;
+  this->FillParam(&param, 3);
+  PixelWiseDataLayer<TypeParam> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < data.count(); ++i) {
+    EXPECT_EQ(data.cpu_data()[i], this->blob_top_data_->cpu_data()[i]);
+  }
+  for (int i = 0; i < label.count(); ++i) {
+    EXPECT_EQ(label.cpu_data()[i], this->blob_top_label_->cpu_data()[i]);
+  }
+}
+
+#ifdef USE_LEVELDB
+TYPED_TEST(PixelWiseDataLayerTest, TestReadLevelDB) {
+  this->TestReadDB(DataParameter_DB_LEVELDB);
+}
+#endif  // USE_LEVELDB
+
+#ifdef USE_LMDB
+TYPED_TEST(PixelWiseDataLayerTest, TestReadLMDB) {
+  this->TestReadDB(DataParameter_DB_LMDB);
+}
+#endif  // USE_LMDB
+
+}  // namespace caffe
+#endif  // USE_OPENCV
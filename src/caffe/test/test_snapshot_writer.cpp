@@ -0,0 +1,116 @@
+#include <boost/filesystem.hpp>
+#include <signal.h>
+#include <sys/resource.h>
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/format.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/snapshot_writer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class SnapshotWriterTest : public ::testing::Test {
+ protected:
+  SnapshotWriterTest() {
+    MakeTempDir(&dirname_);
+  }
+
+  string Filename(int snapshot, const string& extension) {
+    return dirname_ + "/_iter_" + format_int(snapshot) + extension;
+  }
+
+  // Writes num_snapshots snapshots of a net and a solver state each
+  void WriteSnapshots(SnapshotWriter* writer, int num_snapshots) {
+    for (int i = 0; i < num_snapshots; ++i) {
+      writer->Begin();
+      shared_ptr<NetParameter> net(new NetParameter());
+      net->set_name("net" + format_int(i));
+      writer->Add(net, Filename(i, ".caffemodel"));
+      shared_ptr<SolverState> state(new SolverState());
+      state->set_iter(i);
+      state->set_learned_net(Filename(i, ".caffemodel"));
+      writer->Add(state, Filename(i, ".solverstate"));
+      writer->Commit();
+    }
+  }
+
+  void CheckSnapshots(int num_snapshots) {
+    for (int i = 0; i < num_snapshots; ++i) {
+      NetParameter net;
+      ASSERT_TRUE(ReadProtoFromBinaryFile(Filename(i, ".caffemodel"), &net));
+      EXPECT_EQ("net" + format_int(i), net.name());
+      SolverState state;
+      ASSERT_TRUE(ReadProtoFromBinaryFile(Filename(i, ".solverstate"),
+          &state));
+      EXPECT_EQ(i, state.iter());
+      EXPECT_EQ(Filename(i, ".caffemodel"), state.learned_net());
+      // nothing left half written
+      EXPECT_FALSE(boost::filesystem::exists(
+          Filename(i, ".caffemodel.tmp")));
+      EXPECT_FALSE(boost::filesystem::exists(
+          Filename(i, ".solverstate.tmp")));
+    }
+  }
+
+  string dirname_;
+};
+
+TEST_F(SnapshotWriterTest, TestWriteOneInFlight) {
+  SnapshotWriter writer(1);
+  EXPECT_EQ(1, writer.max_in_flight());
+  this->WriteSnapshots(&writer, 3);
+  writer.Flush();
+  this->CheckSnapshots(3);
+}
+
+TEST_F(SnapshotWriterTest, TestWriteManyInFlight) {
+  {
+    SnapshotWriter writer(2);
+    this->WriteSnapshots(&writer, 5);
+    // the destructor writes what is left
+  }
+  this->CheckSnapshots(5);
+}
+
+TEST_F(SnapshotWriterTest, TestWriteAtomic) {
+  const string filename = Filename(0, ".caffemodel");
+  NetParameter net;
+  net.set_name("old");
+  WriteProtoToBinaryFileAtomic(net, filename);
+  net.set_name("new");
+  WriteProtoToBinaryFileAtomic(net, filename);
+  NetParameter read;
+  ASSERT_TRUE(ReadProtoFromBinaryFile(filename, &read));
+  EXPECT_EQ("new", read.name());
+  EXPECT_FALSE(boost::filesystem::exists(filename + ".tmp"));
+}
+
+TEST_F(SnapshotWriterTest, TestWriteFailureKeepsOld) {
+  const string filename = Filename(0, ".caffemodel");
+  NetParameter net;
+  net.set_name("old");
+  WriteProtoToBinaryFileAtomic(net, filename);
+  // The new file runs out of room when the stream is closed: it is small
+  // enough to stay in the stream buffer while serializing, but not to fit
+  // under the limit, which leaves room for the message of the failure.
+  net.set_name(string(900, 'x'));
+  EXPECT_DEATH({
+    signal(SIGXFSZ, SIG_IGN);
+    struct rlimit limit;
+    limit.rlim_cur = limit.rlim_max = 512;
+    setrlimit(RLIMIT_FSIZE, &limit);
+    WriteProtoToBinaryFileAtomic(net, filename);
+  }, "Unable to write");
+  NetParameter read;
+  ASSERT_TRUE(ReadProtoFromBinaryFile(filename, &read));
+  EXPECT_EQ("old", read.name());
+}
+
+}  // namespace caffe
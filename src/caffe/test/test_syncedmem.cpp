@@ -1,3 +1,5 @@
+#include <boost/thread.hpp>
+#include <string>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -40,6 +42,23 @@ TEST_F(SyncedMemoryTest, TestAllocationCPU) {
   EXPECT_TRUE(mem.mutable_cpu_data());
 }
 
+static void AllocateCPU(SyncedMemory* mem) {
+  mem->mutable_cpu_data();
+}
+
+TEST_F(SyncedMemoryTest, TestGlobalStats) {
+  const SyncedMemoryStats thread_stats = SyncedMemory::thread_stats();
+  const SyncedMemoryStats global_stats = SyncedMemory::global_stats();
+  SyncedMemory mem(10);
+  boost::thread thread(&AllocateCPU, &mem);
+  thread.join();
+  // counted for the process, but not for this thread
+  EXPECT_EQ(thread_stats.cpu_malloc_bytes,
+      SyncedMemory::thread_stats().cpu_malloc_bytes);
+  EXPECT_GE(SyncedMemory::global_stats().cpu_malloc_bytes,
+      global_stats.cpu_malloc_bytes + 10);
+}
+
 #ifndef CPU_ONLY  // GPU test
 
 TEST_F(SyncedMemoryTest, TestAllocationGPU) {
@@ -120,6 +139,29 @@ TEST_F(SyncedMemoryTest, TestGPUWrite) {
   EXPECT_EQ(mem.head(), SyncedMemory::SYNCED);
 }
 
+TEST_F(SyncedMemoryTest, TestTransferTrace) {
+  SyncedMemory mem(10);
+  const string layer = "layer";
+  vector<SyncedMemoryTransfer> trace;
+  SyncedMemory::set_transfer_context(&layer, &trace,
+      NetParameter_SyncCheck_SYNC_WARN);
+  mem.mutable_cpu_data();
+  mem.gpu_data();
+  mem.mutable_gpu_data();
+  mem.cpu_data();
+  SyncedMemory::set_transfer_context(NULL, NULL,
+      NetParameter_SyncCheck_SYNC_IGNORE);
+  mem.mutable_gpu_data();
+  mem.cpu_data();
+  // the copies until the context was reset
+  ASSERT_EQ(2, trace.size());
+  EXPECT_EQ(&mem, trace[0].memory);
+  EXPECT_EQ(&layer, trace[0].layer);
+  EXPECT_TRUE(trace[0].to_gpu);
+  EXPECT_EQ(10, trace[0].bytes);
+  EXPECT_FALSE(trace[1].to_gpu);
+}
+
 #endif
 
 }  // namespace caffe
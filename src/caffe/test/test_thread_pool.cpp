@@ -0,0 +1,80 @@
+#include <boost/bind.hpp>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ThreadPoolTest : public ::testing::Test {
+ public:
+  // Marks every visited index, nested loops visit a second range
+  void Visit(int begin, int end, vector<int>* counts) {
+    for (int i = begin; i < end; ++i) {
+      ++(*counts)[i];
+    }
+  }
+
+  void VisitNested(int begin, int end, ThreadPool* pool,
+      vector<vector<int> >* counts) {
+    for (int i = begin; i < end; ++i) {
+      pool->ParallelFor((*counts)[i].size(),
+          boost::bind(&ThreadPoolTest::Visit, this, _1, _2, &(*counts)[i]));
+    }
+  }
+};
+
+TEST_F(ThreadPoolTest, TestSingleThread) {
+  ThreadPool pool(1);
+  EXPECT_EQ(1, pool.num_threads());
+  vector<int> counts(100, 0);
+  pool.ParallelFor(counts.size(),
+      boost::bind(&ThreadPoolTest::Visit, this, _1, _2, &counts));
+  for (int i = 0; i < counts.size(); ++i) {
+    EXPECT_EQ(1, counts[i]);
+  }
+}
+
+TEST_F(ThreadPoolTest, TestCoverage) {
+  ThreadPool pool(4);
+  EXPECT_EQ(4, pool.num_threads());
+  const int sizes[] = {0, 1, 3, 4, 7, 1000};
+  for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    for (int chunks = 0; chunks < 9; ++chunks) {
+      vector<int> counts(sizes[s], 0);
+      pool.ParallelFor(counts.size(),
+          boost::bind(&ThreadPoolTest::Visit, this, _1, _2, &counts), chunks);
+      for (int i = 0; i < counts.size(); ++i) {
+        EXPECT_EQ(1, counts[i]);
+      }
+    }
+  }
+}
+
+TEST_F(ThreadPoolTest, TestNested) {
+  ThreadPool pool(3);
+  vector<vector<int> > counts(16, vector<int>(50, 0));
+  pool.ParallelFor(counts.size(), boost::bind(&ThreadPoolTest::VisitNested,
+      this, _1, _2, &pool, &counts));
+  for (int i = 0; i < counts.size(); ++i) {
+    for (int j = 0; j < counts[i].size(); ++j) {
+      EXPECT_EQ(1, counts[i][j]);
+    }
+  }
+}
+
+TEST_F(ThreadPoolTest, TestGlobal) {
+  const int num_threads = ThreadPool::Global().num_threads();
+  EXPECT_GE(num_threads, 1);
+  ThreadPool::SetGlobalThreads(2);
+  EXPECT_EQ(2, ThreadPool::Global().num_threads());
+  ThreadPool::SetGlobalThreads(num_threads);
+  EXPECT_EQ(num_threads, ThreadPool::Global().num_threads());
+}
+
+}  // namespace caffe
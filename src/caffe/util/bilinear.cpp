@@ -0,0 +1,34 @@
+#include <algorithm>
+#include <cmath>
+
+#include "caffe/util/bilinear.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void bilinear_axis_table(const int length, const int bottom_length,
+    const int scale, int* lo, int* hi, Dtype* weight) {
+  const Dtype pad = (scale - 1.0) / 2;
+  for (int i = 0; i < length; ++i) {
+    const Dtype t = (i - pad) / scale;
+    int floor_t = static_cast<int>(floor(t));
+    int ceil_t = static_cast<int>(ceil(t));
+    floor_t = std::min(std::max(floor_t, 0), bottom_length - 1);
+    ceil_t = std::max(ceil_t, 0);
+    if (ceil_t >= bottom_length) {
+      ceil_t = floor_t;
+    }
+    lo[i] = floor_t;
+    hi[i] = ceil_t;
+    weight[i] = (floor_t == ceil_t) ? Dtype(0) : t - floor_t;
+  }
+}
+
+template void bilinear_axis_table<float>(const int length,
+    const int bottom_length, const int scale, int* lo, int* hi,
+    float* weight);
+template void bilinear_axis_table<double>(const int length,
+    const int bottom_length, const int scale, int* lo, int* hi,
+    double* weight);
+
+}  // namespace caffe
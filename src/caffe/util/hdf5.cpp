@@ -1,5 +1,6 @@
 #include "caffe/util/hdf5.hpp"
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -81,46 +82,77 @@ void hdf5_load_nd_dataset<double>(hid_t file_id, const char* dataset_name_,
   CHECK_GE(status, 0) << "Failed to read double dataset " << dataset_name_;
 }
 
-template <>
-void hdf5_save_nd_dataset<float>(
-    const hid_t file_id, const string& dataset_name, const Blob<float>& blob,
-    bool write_diff) {
-  int num_axes = blob.num_axes();
-  hsize_t *dims = new hsize_t[num_axes];
+// Largest chunk of a compressed dataset, in bytes. Chunks of about a megabyte
+// keep the deflate ratio up without reading much past a partial selection.
+const hsize_t kChunkBytes = 1 << 20;
+
+// Writes the data or diff of blob to a new dataset of type_id. A positive
+// compression_level stores it chunked, byte-shuffled and deflated at that
+// level; otherwise it is stored contiguous and uncompressed.
+template <typename Dtype>
+static void hdf5_save_nd_dataset_helper(
+    hid_t file_id, const string& dataset_name, const Blob<Dtype>& blob,
+    bool write_diff, int compression_level, hid_t type_id) {
+  CHECK_GE(compression_level, 0) << "Deflate levels range from 0 to 9";
+  CHECK_LE(compression_level, 9) << "Deflate levels range from 0 to 9";
+  const int num_axes = blob.num_axes();
+  vector<hsize_t> dims(num_axes);
   for (int i = 0; i < num_axes; ++i) {
     dims[i] = blob.shape(i);
   }
-  const float* data;
-  if (write_diff) {
-    data = blob.cpu_diff();
-  } else {
-    data = blob.cpu_data();
+  const Dtype* data = write_diff ? blob.cpu_diff() : blob.cpu_data();
+  hid_t space_id = H5Screate_simple(num_axes, dims.data(), NULL);
+  CHECK_GE(space_id, 0) << "Failed to make dataspace for " << dataset_name;
+  hid_t plist_id = H5Pcreate(H5P_DATASET_CREATE);
+  CHECK_GE(plist_id, 0) << "Failed to make dataset properties for "
+      << dataset_name;
+  // Scalars and empty blobs cannot be chunked, and are tiny anyway.
+  if (compression_level > 0 && num_axes > 0 && blob.count() > 0) {
+    if (H5Zfilter_avail(H5Z_FILTER_DEFLATE) > 0) {
+      // Take whole innermost axes first, so that a chunk is a contiguous
+      // slab of the blob.
+      vector<hsize_t> chunk(num_axes);
+      hsize_t bytes = sizeof(Dtype);
+      for (int i = num_axes - 1; i >= 0; --i) {
+        chunk[i] = std::min(dims[i], std::max<hsize_t>(1, kChunkBytes / bytes));
+        bytes *= chunk[i];
+      }
+      CHECK_GE(H5Pset_chunk(plist_id, num_axes, chunk.data()), 0)
+          << "Failed to set chunks of " << dataset_name;
+      CHECK_GE(H5Pset_shuffle(plist_id), 0)
+          << "Failed to set shuffle filter of " << dataset_name;
+      CHECK_GE(H5Pset_deflate(plist_id, compression_level), 0)
+          << "Failed to set deflate filter of " << dataset_name;
+    } else {
+      LOG_FIRST_N(WARNING, 1) << "HDF5 lacks the deflate filter; "
+          << "writing uncompressed datasets";
+    }
   }
-  herr_t status = H5LTmake_dataset_float(
-      file_id, dataset_name.c_str(), num_axes, dims, data);
-  CHECK_GE(status, 0) << "Failed to make float dataset " << dataset_name;
-  delete[] dims;
+  hid_t dataset_id = H5Dcreate2(file_id, dataset_name.c_str(), type_id,
+      space_id, H5P_DEFAULT, plist_id, H5P_DEFAULT);
+  CHECK_GE(dataset_id, 0) << "Failed to make dataset " << dataset_name;
+  herr_t status = H5Dwrite(dataset_id, type_id, H5S_ALL, H5S_ALL,
+      H5P_DEFAULT, data);
+  CHECK_GE(status, 0) << "Failed to write dataset " << dataset_name;
+  H5Dclose(dataset_id);
+  H5Pclose(plist_id);
+  H5Sclose(space_id);
+}
+
+template <>
+void hdf5_save_nd_dataset<float>(
+    const hid_t file_id, const string& dataset_name, const Blob<float>& blob,
+    bool write_diff, int compression_level) {
+  hdf5_save_nd_dataset_helper(file_id, dataset_name, blob, write_diff,
+      compression_level, H5T_NATIVE_FLOAT);
 }
 
 template <>
 void hdf5_save_nd_dataset<double>(
     hid_t file_id, const string& dataset_name, const Blob<double>& blob,
-    bool write_diff) {
-  int num_axes = blob.num_axes();
-  hsize_t *dims = new hsize_t[num_axes];
-  for (int i = 0; i < num_axes; ++i) {
-    dims[i] = blob.shape(i);
-  }
-  const double* data;
-  if (write_diff) {
-    data = blob.cpu_diff();
-  } else {
-    data = blob.cpu_data();
-  }
-  herr_t status = H5LTmake_dataset_double(
-      file_id, dataset_name.c_str(), num_axes, dims, data);
-  CHECK_GE(status, 0) << "Failed to make double dataset " << dataset_name;
-  delete[] dims;
+    bool write_diff, int compression_level) {
+  hdf5_save_nd_dataset_helper(file_id, dataset_name, blob, write_diff,
+      compression_level, H5T_NATIVE_DOUBLE);
 }
 
 string hdf5_load_string(hid_t loc_id, const string& dataset_name) {
@@ -1,7 +1,11 @@
+#include <boost/bind.hpp>
+
+#include <algorithm>
 #include <vector>
 
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -15,32 +19,128 @@ inline bool is_a_ge_zero_and_a_lt_b(int a, int b) {
   return static_cast<unsigned>(a) < static_cast<unsigned>(b);
 }
 
-template <typename Dtype>
-void im2col_cpu(const Dtype* data_im, const int channels,
-    const int height, const int width, const int kernel_h, const int kernel_w,
-    const int pad_h, const int pad_w,
+// The shape of one im2col/col2im call, passed to the workers
+struct ConvGeometry {
+  int height, width;
+  int kernel_h, kernel_w;
+  int pad_h, pad_w;
+  int stride_h, stride_w;
+  int dilation_h, dilation_w;
+  int output_h, output_w;
+};
+
+inline ConvGeometry conv_geometry(const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
     const int stride_h, const int stride_w,
-    const int dilation_h, const int dilation_w,
-    Dtype* data_col) {
-  const int output_h = (height + 2 * pad_h -
+    const int dilation_h, const int dilation_w) {
+  ConvGeometry g;
+  g.height = height;
+  g.width = width;
+  g.kernel_h = kernel_h;
+  g.kernel_w = kernel_w;
+  g.pad_h = pad_h;
+  g.pad_w = pad_w;
+  g.stride_h = stride_h;
+  g.stride_w = stride_w;
+  g.dilation_h = dilation_h;
+  g.dilation_w = dilation_w;
+  g.output_h = (height + 2 * pad_h -
     (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
-  const int output_w = (width + 2 * pad_w -
+  g.output_w = (width + 2 * pad_w -
     (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
+  return g;
+}
+
+inline bool is_1x1(const ConvGeometry& g) {
+  return g.kernel_h == 1 && g.kernel_w == 1 && g.pad_h == 0 &&
+      g.pad_w == 0 && g.stride_h == 1 && g.stride_w == 1;
+}
+
+inline bool is_3x3_same(const ConvGeometry& g) {
+  return g.kernel_h == 3 && g.kernel_w == 3 && g.pad_h == 1 &&
+      g.pad_w == 1 && g.stride_h == 1 && g.stride_w == 1 &&
+      g.dilation_h == 1 && g.dilation_w == 1;
+}
+
+// Column buffers smaller than this are not worth waking the pool for
+const int kParallelMinCount = 1 << 16;
+
+// Runs fn over the channels, split across the global thread pool when
+// the build enables it and the column buffer is large enough. Channels own
+// disjoint image planes and column rows, so the workers never share output.
+inline void for_each_channel_range(const int channels, const int col_count,
+    const ThreadPool::RangeFunction& fn) {
+#ifdef USE_PARALLEL_IM2COL
+  if (channels > 1 && col_count >= kParallelMinCount) {
+    ThreadPool::Global().ParallelFor(channels, fn);
+    return;
+  }
+#endif
+  fn(0, channels);
+}
+
+// im2col of the channels [begin, end)
+template <typename Dtype>
+void im2col_channels(int begin, int end, const ConvGeometry& g,
+    const Dtype* data_im, Dtype* data_col) {
+  const int height = g.height;
+  const int width = g.width;
+  const int output_h = g.output_h;
+  const int output_w = g.output_w;
   const int channel_size = height * width;
+  const int col_channel_size = g.kernel_h * g.kernel_w * output_h * output_w;
+  data_im += begin * channel_size;
+  data_col += begin * col_channel_size;
+  if (is_1x1(g)) {
+    // the column buffer is the image, up to the dilation which a single
+    // tap does not see. caffe_copy would look up the mode of this pool
+    // thread, so copy directly
+    std::copy(data_im, data_im + (end - begin) * channel_size, data_col);
+    return;
+  }
+  if (is_3x3_same(g)) {
+    // every column row is an image row shifted by one pixel at most
+    for (int channel = begin; channel < end; ++channel,
+        data_im += channel_size) {
+      for (int kernel_row = 0; kernel_row < 3; ++kernel_row) {
+        for (int kernel_col = 0; kernel_col < 3; ++kernel_col) {
+          for (int h = 0; h < height; ++h, data_col += width) {
+            const int input_row = h + kernel_row - 1;
+            if (!is_a_ge_zero_and_a_lt_b(input_row, height)) {
+              caffe_set(width, Dtype(0), data_col);
+              continue;
+            }
+            const Dtype* row = data_im + input_row * width;
+            if (kernel_col == 0) {
+              data_col[0] = 0;
+              std::copy(row, row + width - 1, data_col + 1);
+            } else if (kernel_col == 1) {
+              std::copy(row, row + width, data_col);
+            } else {
+              std::copy(row + 1, row + width, data_col);
+              data_col[width - 1] = 0;
+            }
+          }
+        }
+      }
+    }
+    return;
+  }
   // do it by rows actually. permutate the convolve step
   // and followed the data store stratery of caffe(N, C, H, W)
   // do it for every row to generate a matrix with (C * H * W) rows,
   // every row will have (output_h * output_w) items
   // the channel
-  for (int channel = channels; channel--; data_im += channel_size) {
+  for (int channel = begin; channel < end; ++channel,
+      data_im += channel_size) {
     // for every kernel h
-    for (int kernel_row = 0; kernel_row < kernel_h; kernel_row++) {
+    for (int kernel_row = 0; kernel_row < g.kernel_h; kernel_row++) {
       // for every kernel w, below is the specific doing for a row
-      for (int kernel_col = 0; kernel_col < kernel_w; kernel_col++) {
+      for (int kernel_col = 0; kernel_col < g.kernel_w; kernel_col++) {
 
         // inner loop begin, start_H location. every output_h * output_w 
         // corresponds to a kernel location convolve. this ouput a single line
-        int input_row = -pad_h + kernel_row * dilation_h;
+        int input_row = -g.pad_h + kernel_row * g.dilation_h;
         for (int output_rows = output_h; output_rows; output_rows--) {
           // judge the start_H, and decide to do the thing
           // if start_H > hegiht, then the w walker should be all zeros
@@ -51,7 +151,7 @@ void im2col_cpu(const Dtype* data_im, const int channels,
             } // else we should permute the convovle step and get im value
           } else {
             // get the input_col stater, this will be init every time to the begin
-            int input_col = -pad_w + kernel_col * dilation_w;
+            int input_col = -g.pad_w + kernel_col * g.dilation_w;
             for (int output_col = output_w; output_col; output_col--) {
               // another judge if it hold start_W < width
               if (is_a_ge_zero_and_a_lt_b(input_col, width)) {
@@ -59,11 +159,11 @@ void im2col_cpu(const Dtype* data_im, const int channels,
               } else {
                 *(data_col++) = 0;
               }
-              input_col += stride_w;
+              input_col += g.stride_w;
             } // convolve with a row to the input
 
           } // end for a W permutation for input
-          input_row += stride_h;
+          input_row += g.stride_h;
         } // end of an single output row. it do the actual job for a generated matrix
 
       } // end of kernel w
@@ -71,10 +171,20 @@ void im2col_cpu(const Dtype* data_im, const int channels,
   } // end of channel
 }
 
-
-
-
-
+template <typename Dtype>
+void im2col_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w,
+    Dtype* data_col) {
+  const ConvGeometry g = conv_geometry(height, width, kernel_h, kernel_w,
+      pad_h, pad_w, stride_h, stride_w, dilation_h, dilation_w);
+  for_each_channel_range(channels,
+      channels * kernel_h * kernel_w * g.output_h * g.output_w,
+      boost::bind(&im2col_channels<Dtype>, _1, _2, boost::cref(g), data_im,
+          data_col));
+}
 
 // Explicit instantiation
 template void im2col_cpu<float>(const float* data_im, const int channels,
@@ -88,26 +198,40 @@ template void im2col_cpu<double>(const double* data_im, const int channels,
     const int stride_w, const int dilation_h, const int dilation_w,
     double* data_col);
 
+// The shape of one N-D im2col/col2im call, passed to the workers
+struct ConvGeometryND {
+  bool im2col;
+  int num_spatial_axes;
+  const int* im_shape;
+  const int* col_shape;
+  const int* kernel_shape;
+  const int* pad;
+  const int* stride;
+  const int* dilation;
+  int kernel_size;
+};
+
+// N-D im2col or col2im of the image channels [begin, end), which own the
+// column channels [begin * kernel_size, end * kernel_size)
 template <typename Dtype>
-inline void im2col_nd_core_cpu(const Dtype* data_input, const bool im2col,
-    const int num_spatial_axes, const int* im_shape, const int* col_shape,
-    const int* kernel_shape, const int* pad, const int* stride,
-    const int* dilation, Dtype* data_output) {
-  if (!im2col) {
-    int im_size = im_shape[0];
+void im2col_nd_channels(int begin, int end, const ConvGeometryND& g,
+    const Dtype* data_input, Dtype* data_output) {
+  const int num_spatial_axes = g.num_spatial_axes;
+  const int* im_shape = g.im_shape;
+  const int* col_shape = g.col_shape;
+  const int* kernel_shape = g.kernel_shape;
+  const int kernel_size = g.kernel_size;
+  if (!g.im2col) {
+    int im_size = 1;
     for (int i = 0; i < num_spatial_axes; ++i) {
       im_size *= im_shape[1 + i];
     }
-    caffe_set(im_size, Dtype(0), data_output);
-  }
-  int kernel_size = 1;
-  for (int i = 0; i < num_spatial_axes; ++i) {
-    kernel_size *= kernel_shape[i];
+    caffe_set((end - begin) * im_size, Dtype(0),
+        data_output + begin * im_size);
   }
-  const int channels_col = col_shape[0];
   vector<int> d_offset(num_spatial_axes, 0);
   vector<int> d_iter(num_spatial_axes, 0);
-  for (int c_col = 0; c_col < channels_col; ++c_col) {
+  for (int c_col = begin * kernel_size; c_col < end * kernel_size; ++c_col) {
     // Loop over spatial axes in reverse order to compute a per-axis offset.
     int offset = c_col;
     for (int d_i = num_spatial_axes - 1; d_i >= 0; --d_i) {
@@ -124,15 +248,15 @@ inline void im2col_nd_core_cpu(const Dtype* data_input, const bool im2col,
       bool is_padding = false;
       for (int d_i = 0; d_i < num_spatial_axes; ++d_i) {
         const int d = d_iter[d_i];
-        const int d_im = d * stride[d_i] - pad[d_i] +
-            d_offset[d_i] * dilation[d_i];
+        const int d_im = d * g.stride[d_i] - g.pad[d_i] +
+            d_offset[d_i] * g.dilation[d_i];
         is_padding |= d_im < 0 || d_im >= im_shape[d_i + 1];
         index_col *= col_shape[d_i + 1];
         index_col += d;
         index_im *= im_shape[d_i + 1];
         index_im += d_im;
       }
-      if (im2col) {
+      if (g.im2col) {
         if (is_padding) {
           data_output[index_col] = 0;
         } else {
@@ -159,6 +283,31 @@ inline void im2col_nd_core_cpu(const Dtype* data_input, const bool im2col,
   }  // for (int c = 0; c < channels_col; ++c) {
 }
 
+template <typename Dtype>
+inline void im2col_nd_core_cpu(const Dtype* data_input, const bool im2col,
+    const int num_spatial_axes, const int* im_shape, const int* col_shape,
+    const int* kernel_shape, const int* pad, const int* stride,
+    const int* dilation, Dtype* data_output) {
+  ConvGeometryND g;
+  g.im2col = im2col;
+  g.num_spatial_axes = num_spatial_axes;
+  g.im_shape = im_shape;
+  g.col_shape = col_shape;
+  g.kernel_shape = kernel_shape;
+  g.pad = pad;
+  g.stride = stride;
+  g.dilation = dilation;
+  g.kernel_size = 1;
+  int col_count = col_shape[0];
+  for (int i = 0; i < num_spatial_axes; ++i) {
+    g.kernel_size *= kernel_shape[i];
+    col_count *= col_shape[i + 1];
+  }
+  for_each_channel_range(im_shape[0], col_count,
+      boost::bind(&im2col_nd_channels<Dtype>, _1, _2, boost::cref(g),
+          data_input, data_output));
+}
+
 template <typename Dtype>
 void im2col_nd_cpu(const Dtype* data_im, const int num_spatial_axes,
     const int* im_shape, const int* col_shape,
@@ -181,43 +330,93 @@ template void im2col_nd_cpu<double>(const double* data_im,
     const int* kernel_shape, const int* pad, const int* stride,
     const int* dilation, double* data_col);
 
+// col2im of the channels [begin, end)
 template <typename Dtype>
-void col2im_cpu(const Dtype* data_col, const int channels,
-    const int height, const int width, const int kernel_h, const int kernel_w,
-    const int pad_h, const int pad_w,
-    const int stride_h, const int stride_w,
-    const int dilation_h, const int dilation_w,
-    Dtype* data_im) {
-  caffe_set(height * width * channels, Dtype(0), data_im);
-  const int output_h = (height + 2 * pad_h -
-    (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
-  const int output_w = (width + 2 * pad_w -
-    (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
+void col2im_channels(int begin, int end, const ConvGeometry& g,
+    const Dtype* data_col, Dtype* data_im) {
+  const int height = g.height;
+  const int width = g.width;
+  const int output_h = g.output_h;
+  const int output_w = g.output_w;
   const int channel_size = height * width;
-  for (int channel = channels; channel--; data_im += channel_size) {
-    for (int kernel_row = 0; kernel_row < kernel_h; kernel_row++) {
-      for (int kernel_col = 0; kernel_col < kernel_w; kernel_col++) {
-        int input_row = -pad_h + kernel_row * dilation_h;
+  const int col_channel_size = g.kernel_h * g.kernel_w * output_h * output_w;
+  data_im += begin * channel_size;
+  data_col += begin * col_channel_size;
+  if (is_1x1(g)) {
+    std::copy(data_col, data_col + (end - begin) * channel_size, data_im);
+    return;
+  }
+  caffe_set((end - begin) * channel_size, Dtype(0), data_im);
+  if (is_3x3_same(g)) {
+    for (int channel = begin; channel < end; ++channel,
+        data_im += channel_size) {
+      for (int kernel_row = 0; kernel_row < 3; ++kernel_row) {
+        for (int kernel_col = 0; kernel_col < 3; ++kernel_col) {
+          for (int h = 0; h < height; ++h, data_col += width) {
+            const int input_row = h + kernel_row - 1;
+            if (!is_a_ge_zero_and_a_lt_b(input_row, height)) {
+              continue;
+            }
+            Dtype* row = data_im + input_row * width;
+            if (kernel_col == 0) {
+              for (int w = 1; w < width; ++w) {
+                row[w - 1] += data_col[w];
+              }
+            } else if (kernel_col == 1) {
+              for (int w = 0; w < width; ++w) {
+                row[w] += data_col[w];
+              }
+            } else {
+              for (int w = 0; w < width - 1; ++w) {
+                row[w + 1] += data_col[w];
+              }
+            }
+          }
+        }
+      }
+    }
+    return;
+  }
+  for (int channel = begin; channel < end; ++channel,
+      data_im += channel_size) {
+    for (int kernel_row = 0; kernel_row < g.kernel_h; kernel_row++) {
+      for (int kernel_col = 0; kernel_col < g.kernel_w; kernel_col++) {
+        int input_row = -g.pad_h + kernel_row * g.dilation_h;
         for (int output_rows = output_h; output_rows; output_rows--) {
           if (!is_a_ge_zero_and_a_lt_b(input_row, height)) {
             data_col += output_w;
           } else {
-            int input_col = -pad_w + kernel_col * dilation_w;
+            int input_col = -g.pad_w + kernel_col * g.dilation_w;
             for (int output_col = output_w; output_col; output_col--) {
               if (is_a_ge_zero_and_a_lt_b(input_col, width)) {
                 data_im[input_row * width + input_col] += *data_col;
               }
               data_col++;
-              input_col += stride_w;
+              input_col += g.stride_w;
             }
           }
-          input_row += stride_h;
+          input_row += g.stride_h;
         }
       }
     }
   }
 }
 
+template <typename Dtype>
+void col2im_cpu(const Dtype* data_col, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w,
+    Dtype* data_im) {
+  const ConvGeometry g = conv_geometry(height, width, kernel_h, kernel_w,
+      pad_h, pad_w, stride_h, stride_w, dilation_h, dilation_w);
+  for_each_channel_range(channels,
+      channels * kernel_h * kernel_w * g.output_h * g.output_w,
+      boost::bind(&col2im_channels<Dtype>, _1, _2, boost::cref(g), data_col,
+          data_im));
+}
+
 // Explicit instantiation
 template void col2im_cpu<float>(const float* data_col, const int channels,
     const int height, const int width, const int kernel_h, const int kernel_w,
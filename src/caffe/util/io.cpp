@@ -2,6 +2,7 @@
 #include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <google/protobuf/text_format.h>
+#include <google/protobuf/wire_format_lite.h>
 #ifdef USE_OPENCV
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
@@ -9,8 +10,10 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #endif  // USE_OPENCV
 #include <stdint.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <cstring>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <vector>
@@ -21,6 +24,7 @@
 #include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/io.hpp"
+#include "caffe/util/mapped_file.hpp"
 
 const int kProtoReadBytesLimit = INT_MAX;  // Max size of 2 GB minus 1 byte.
 
@@ -33,6 +37,7 @@ using google::protobuf::io::CodedInputStream;
 using google::protobuf::io::ZeroCopyOutputStream;
 using google::protobuf::io::CodedOutputStream;
 using google::protobuf::Message;
+using google::protobuf::internal::WireFormatLite;
 
 bool ReadProtoFromTextFile(const char* filename, Message* proto) {
   int fd = open(filename, O_RDONLY);
@@ -72,58 +77,154 @@ void WriteProtoToBinaryFile(const Message& proto, const char* filename) {
   CHECK(proto.SerializeToOstream(&output));
 }
 
+void WriteProtoToBinaryFileAtomic(const Message& proto,
+    const string& filename) {
+  const string temp_filename = filename + ".tmp";
+  {
+    fstream output(temp_filename.c_str(), ios::out | ios::trunc | ios::binary);
+    CHECK(proto.SerializeToOstream(&output))
+        << "Unable to write " << temp_filename;
+    // The last of the buffer only reaches the file here, which may still
+    // run out of space
+    output.close();
+    CHECK(!output.fail()) << "Unable to write " << temp_filename;
+  }
+  RenameFileDurably(temp_filename, filename);
+}
+
+void RenameFileDurably(const string& temp_filename, const string& filename) {
+  int fd = open(temp_filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "File not found: " << temp_filename;
+  CHECK_EQ(fsync(fd), 0) << "Unable to sync " << temp_filename;
+  close(fd);
+  CHECK_EQ(rename(temp_filename.c_str(), filename.c_str()), 0)
+      << "Unable to rename " << temp_filename << " to " << filename;
+  // The rename itself lives in the directory
+  const size_t slash = filename.rfind('/');
+  const string dirname = slash == string::npos ? "." :
+      filename.substr(0, slash + 1);
+  fd = open(dirname.c_str(), O_RDONLY);
+  if (fd == -1) {
+    LOG(WARNING) << "Unable to open " << dirname << " to sync the rename of "
+        << filename;
+    return;
+  }
+  if (fsync(fd) != 0) {
+    LOG(WARNING) << "Unable to sync the rename of " << filename;
+  }
+  close(fd);
+}
+
+bool ParseDatumInPlace(const char* buffer, size_t size, Datum* datum,
+    const char** data, size_t* data_size) {
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(buffer);
+  const uint32_t data_tag = WireFormatLite::MakeTag(Datum::kDataFieldNumber,
+      WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+  // Find the pixels among the fields, the last ones win as when parsing
+  CodedInputStream input(bytes, size);
+  int field_begin = 0, data_begin = -1, data_end = -1;
+  uint32_t data_length = 0;
+  for (uint32_t tag = input.ReadTag(); tag; tag = input.ReadTag()) {
+    if (tag == data_tag) {
+      if (!input.ReadVarint32(&data_length)) {
+        return false;
+      }
+      data_begin = field_begin;
+      data_end = input.CurrentPosition() + data_length;
+      if (!input.Skip(data_length)) {
+        return false;
+      }
+    } else if (!WireFormatLite::SkipField(&input, tag)) {
+      return false;
+    }
+    field_begin = input.CurrentPosition();
+  }
+  if (static_cast<size_t>(field_begin) != size) {
+    return false;
+  }
+  *data = NULL;
+  *data_size = 0;
+  if (data_begin < 0) {
+    return datum->ParseFromArray(buffer, size);
+  }
+  // Parse the fields around the pixels
+  CodedInputStream after(bytes + data_end, size - data_end);
+  if (!datum->ParseFromArray(buffer, data_begin) ||
+      !datum->MergeFromCodedStream(&after)) {
+    return false;
+  }
+  const char* pixels = buffer + data_end - data_length;
+  if (datum->encoded()) {
+    datum->set_data(pixels, data_length);
+  } else {
+    datum->clear_data();
+    // an empty data field leaves the pixels to float_data
+    if (data_length > 0) {
+      *data = pixels;
+      *data_size = data_length;
+    }
+  }
+  return true;
+}
+
+void LabelToInterleaved(const float* src, const int rows, const int cols,
+    const int channels, float* dst) {
+  // src[(k * cols + c) * rows + r] goes to dst[(r * cols + c) * channels + k].
+  // walk tiles small enough for the channels planes they read from to stay
+  // in cache while the writes run contiguously
+  const int kTile = 32;
+  const int plane = rows * cols;
+  for (int r0 = 0; r0 < rows; r0 += kTile) {
+    const int r1 = std::min(r0 + kTile, rows);
+    for (int c0 = 0; c0 < cols; c0 += kTile) {
+      const int c1 = std::min(c0 + kTile, cols);
+      for (int r = r0; r < r1; ++r) {
+        float* to = dst + (r * cols + c0) * channels;
+        const float* from = src + c0 * rows + r;
+        for (int c = c0; c < c1; ++c) {
+          for (int k = 0; k < channels; ++k) {
+            to[k] = from[k * plane];
+          }
+          to += channels;
+          from += rows;
+        }
+      }
+    }
+  }
+}
+
+bool ReadLabelToBuffer(const string& filename, const int rows,
+    const int cols, const int channels, float* dst) {
+  MappedFile file;
+  if (!file.Open(filename)) {
+    return false;
+  }
+  if (file.size() != sizeof(float) * rows * cols * channels) {
+    LOG(ERROR) << "label file " << filename << " does not agree with the "
+        << "given row, col and channel";
+    return false;
+  }
+  LabelToInterleaved(reinterpret_cast<const float*>(file.data()), rows, cols,
+      channels, dst);
+  return true;
+}
+
 #ifdef USE_OPENCV
 // self define read normal to cv
 cv::Mat ReadLabelToCVMat(const string& filename,
         const int rows, const int cols, const int height,
         const int width, const int label_channel) {
-
-    FILE *fid;
-    fid = fopen(filename.c_str(), "rb");
-    if (fid == NULL)
-        LOG(ERROR) << "can not open file" << filename;
-    // get the Size
-    fseek(fid, 0, SEEK_END);
-    long lsize = ftell(fid);
-    rewind(fid);
-    // read the data
-    int channels = label_channel;
-    float buffer[rows * cols * channels];
-    long size = fread(buffer, sizeof(float), lsize/sizeof(float), fid);
-    fclose(fid);
-    if (size != rows * cols * channels) {
-      LOG(ERROR) << "label file does not agree with the given row, col and channel";
+    cv::Mat normal(rows, cols, CV_32FC(label_channel));
+    if (!ReadLabelToBuffer(filename, rows, cols, label_channel,
+            normal.ptr<float>())) {
       exit(2);
     }
-        
-    //map the data to cv Mat
-    int count = 0;
-    cv::Mat normal;
-    normal.create(rows, cols, CV_32FC(channels));
-    for (int k = 0; k < channels; ++k) {
-        for ( int c = 0; c < cols; ++c ) {
-            for ( int r = 0; r < rows; ++r ) {
-             //   float value = (float)buffer[count];
-                normal.at<float>(r, c, k) = buffer[count];
-              //  if ( r == 100 && c == 121) {
-              //    LOG(INFO) << " before " << value;
-               //   LOG(INFO) << " after " << normal.at<cv::Vec3f>(r, c)[k];
-               // } debug
-                ++count;
-            }
-        }
-    }
-   // LOG(INFO) << "inside the data " << normal.channels();
-    // for debug
-//    cv::namedWindow("Test", cv::WINDOW_AUTOSIZE);
- //   cv::imshow("Test", normal);
     cv::Mat normal_resize;
     if (height > 0 && width > 0) {
       cv::resize(normal, normal_resize, cv::Size(width, height));
     } else {
       normal_resize = normal;
     }
-    //LOG(INFO) << normal_resize.at<cv::Vec3f>(120,213)[1] << " inside";
     return normal_resize;
 }
 
@@ -316,5 +417,70 @@ void CVMatToDatum(const cv::Mat& cv_img, Datum* datum) {
   }
   datum->set_data(buffer);
 }
+
+bool ReadPixelWiseToDatum(const string& image_filename,
+    const string& label_filename, const int label_channel,
+    const int height, const int width, const bool is_color,
+    const string& encoding, Datum* datum) {
+  int rows, cols;
+  cv::Mat cv_img = ReadImageToCVMat(image_filename, height, width, is_color,
+      rows, cols);
+  if (!cv_img.data) {
+    return false;
+  }
+  cv::Mat cv_label(rows, cols, CV_32FC(label_channel));
+  if (!ReadLabelToBuffer(label_filename, rows, cols, label_channel,
+      cv_label.ptr<float>())) {
+    return false;
+  }
+  if (height > 0 && width > 0) {
+    cv::Mat cv_label_resized;
+    cv::resize(cv_label, cv_label_resized, cv::Size(width, height));
+    cv_label = cv_label_resized;
+  }
+  // keep the file as it is unless it had to be converted
+  const bool unchanged = (cv_img.channels() == 3) == is_color &&
+      !height && !width &&
+      (encoding.empty() || matchExt(image_filename, encoding));
+  if (unchanged) {
+    if (!ReadFileToDatum(image_filename, 0, datum)) {
+      return false;
+    }
+  } else {
+    std::vector<uchar> buf;
+    cv::imencode("." + (encoding.empty() ? string("png") : encoding), cv_img,
+        buf);
+    datum->set_data(std::string(reinterpret_cast<char*>(&buf[0]),
+                    buf.size()));
+    datum->set_encoded(true);
+  }
+  datum->set_label(0);
+  datum->set_channels(cv_img.channels());
+  datum->set_height(cv_img.rows);
+  datum->set_width(cv_img.cols);
+  const int label_size = cv_img.rows * cv_img.cols * label_channel;
+  datum->clear_float_data();
+  datum->mutable_float_data()->Resize(label_size, 0);
+  memcpy(datum->mutable_float_data()->mutable_data(),
+      cv_label.ptr<float>(), label_size * sizeof(float));
+  return true;
+}
+
+bool DecodePixelWiseDatum(const Datum& datum, const int label_channel,
+    const bool is_color, cv::Mat* cv_img, cv::Mat* cv_label) {
+  *cv_img = DecodeDatumToCVMat(datum, is_color);
+  if (!cv_img->data) {
+    return false;
+  }
+  if (datum.float_data_size() !=
+      cv_img->rows * cv_img->cols * label_channel) {
+    LOG(ERROR) << "Datum label does not agree with the image size and "
+        << label_channel << " label channels";
+    return false;
+  }
+  *cv_label = cv::Mat(cv_img->rows, cv_img->cols, CV_32FC(label_channel),
+      const_cast<float*>(datum.float_data().data()));
+  return true;
+}
 #endif  // USE_OPENCV
 }  // namespace caffe
@@ -0,0 +1,51 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "caffe/util/mapped_file.hpp"
+
+namespace caffe {
+
+bool MappedFile::Open(const string& filename) {
+  Close();
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    LOG(ERROR) << "Could not open file " << filename;
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    LOG(ERROR) << "Could not stat file " << filename;
+    close(fd);
+    return false;
+  }
+  size_ = st.st_size;
+  if (size_ > 0) {
+    void* addr = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      LOG(ERROR) << "Could not map file " << filename;
+      size_ = 0;
+      close(fd);
+      return false;
+    }
+    // the readers walk the file front to back
+    madvise(addr, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<char*>(addr);
+  }
+  // the mapping keeps its own reference to the file
+  close(fd);
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data_) {
+    munmap(data_, size_);
+  }
+  data_ = NULL;
+  size_ = 0;
+}
+
+}  // namespace caffe
@@ -0,0 +1,202 @@
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+#include "caffe/util/memory_pool.hpp"
+
+namespace caffe {
+
+class MemoryPool::sync {
+ public:
+  mutable boost::mutex mutex_;
+};
+
+MemoryPool::MemoryPool(AllocateFunction allocate, FreeFunction free)
+    : allocate_(allocate), free_(free), sync_(new sync()) {
+}
+
+MemoryPool::~MemoryPool() {
+  Release();
+}
+
+size_t MemoryPool::SizeClass(size_t size) {
+  // the smallest class, which keeps the blocks aligned
+  const size_t kMinClass = 256;
+  if (size <= kMinClass) {
+    return kMinClass;
+  }
+  size_t power = kMinClass;
+  while (power * 2 <= size) {
+    power *= 2;
+  }
+  const size_t step = power / 4;
+  return (size + step - 1) / step * step;
+}
+
+void* MemoryPool::Allocate(size_t size) {
+  const size_t block = SizeClass(size);
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  void* ptr = NULL;
+  std::map<size_t, vector<void*> >::iterator cached = cached_.find(block);
+  if (cached != cached_.end() && !cached->second.empty()) {
+    ptr = cached->second.back();
+    cached->second.pop_back();
+    stats_.cached_bytes -= block;
+    ++stats_.hits;
+  } else {
+    ptr = allocate_(block);
+    if (!ptr && stats_.cached_bytes) {
+      LOG(INFO) << "Out of memory for " << block << " bytes, releasing "
+          << stats_.cached_bytes << " cached bytes";
+      ReleaseCached();
+      ptr = allocate_(block);
+    }
+    CHECK(ptr) << "allocation of size " << size << " failed";
+    ++stats_.misses;
+  }
+  in_use_[ptr] = size;
+  stats_.requested_bytes += size;
+  stats_.allocated_bytes += block;
+  stats_.peak_bytes = std::max(stats_.peak_bytes,
+      stats_.allocated_bytes + stats_.cached_bytes);
+  return ptr;
+}
+
+void MemoryPool::Free(void* ptr) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  std::map<void*, size_t>::iterator in_use = in_use_.find(ptr);
+  CHECK(in_use != in_use_.end()) << "freeing a block not from the pool";
+  const size_t size = in_use->second;
+  const size_t block = SizeClass(size);
+  in_use_.erase(in_use);
+  stats_.requested_bytes -= size;
+  stats_.allocated_bytes -= block;
+  cached_[block].push_back(ptr);
+  stats_.cached_bytes += block;
+}
+
+void MemoryPool::Release() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  ReleaseCached();
+}
+
+void MemoryPool::ReleaseCached() {
+  for (std::map<size_t, vector<void*> >::iterator cached = cached_.begin();
+       cached != cached_.end(); ++cached) {
+    for (int i = 0; i < cached->second.size(); ++i) {
+      free_(cached->second[i]);
+    }
+    stats_.releases += cached->second.size();
+  }
+  cached_.clear();
+  stats_.cached_bytes = 0;
+}
+
+MemoryPoolStats MemoryPool::stats() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return stats_;
+}
+
+static void* MallocHost(size_t size) {
+  return malloc(size);
+}
+
+static void FreeHost(void* ptr) {
+  free(ptr);
+}
+
+#ifndef CPU_ONLY
+// Failures are left to the pool, to release its cache and retry.
+static void* MallocPinned(size_t size) {
+  void* ptr = NULL;
+  if (cudaMallocHost(&ptr, size) != cudaSuccess) {
+    cudaGetLastError();
+    return NULL;
+  }
+  return ptr;
+}
+
+static void FreePinned(void* ptr) {
+  CUDA_CHECK(cudaFreeHost(ptr));
+}
+
+static void* MallocDevice(size_t size) {
+  void* ptr = NULL;
+  if (cudaMalloc(&ptr, size) != cudaSuccess) {
+    cudaGetLastError();
+    return NULL;
+  }
+  return ptr;
+}
+
+static void FreeDevice(void* ptr) {
+  CUDA_CHECK(cudaFree(ptr));
+}
+#endif
+
+// The pools live as long as the process, for the blobs of static objects.
+static boost::mutex pools_mutex_;
+static MemoryPool* host_pool_ = NULL;
+static MemoryPool* pinned_pool_ = NULL;
+static vector<MemoryPool*> device_pools_;
+
+MemoryPool& MemoryPool::Host(bool pinned) {
+  boost::mutex::scoped_lock lock(pools_mutex_);
+  if (!pinned) {
+    if (!host_pool_) {
+      host_pool_ = new MemoryPool(&MallocHost, &FreeHost);
+    }
+    return *host_pool_;
+  }
+#ifndef CPU_ONLY
+  if (!pinned_pool_) {
+    pinned_pool_ = new MemoryPool(&MallocPinned, &FreePinned);
+  }
+#else
+  NO_GPU;
+#endif
+  return *pinned_pool_;
+}
+
+MemoryPool& MemoryPool::Device(int device) {
+#ifndef CPU_ONLY
+  CHECK_GE(device, 0);
+  boost::mutex::scoped_lock lock(pools_mutex_);
+  if (device >= device_pools_.size()) {
+    device_pools_.resize(device + 1, NULL);
+  }
+  if (!device_pools_[device]) {
+    device_pools_[device] = new MemoryPool(&MallocDevice, &FreeDevice);
+  }
+  return *device_pools_[device];
+#else
+  NO_GPU;
+  return Host(false);
+#endif
+}
+
+void MemoryPool::ReleaseAll() {
+  boost::mutex::scoped_lock lock(pools_mutex_);
+  if (host_pool_) {
+    host_pool_->Release();
+  }
+  if (pinned_pool_) {
+    pinned_pool_->Release();
+  }
+#ifndef CPU_ONLY
+  int initial_device;
+  CUDA_CHECK(cudaGetDevice(&initial_device));
+  for (int i = 0; i < device_pools_.size(); ++i) {
+    if (device_pools_[i]) {
+      CUDA_CHECK(cudaSetDevice(i));
+      device_pools_[i]->Release();
+    }
+  }
+  CUDA_CHECK(cudaSetDevice(initial_device));
+#endif
+}
+
+}  // namespace caffe
@@ -0,0 +1,72 @@
+#include <boost/thread.hpp>
+#include <string>
+#include <vector>
+
+#include "caffe/util/io.hpp"
+#include "caffe/util/snapshot_writer.hpp"
+
+namespace caffe {
+
+SnapshotWriter::SnapshotWriter(int max_in_flight)
+    : max_in_flight_(max_in_flight),
+      staged_(NULL) {
+  CHECK_GT(max_in_flight_, 0);
+  for (int i = 0; i < max_in_flight_; ++i) {
+    snapshots_.push_back(shared_ptr<Snapshot>(new Snapshot()));
+    free_.push(snapshots_[i].get());
+  }
+  StartInternalThread();
+}
+
+SnapshotWriter::~SnapshotWriter() {
+  CHECK(staged_ == NULL) << "Snapshot begun but never committed";
+  Flush();
+  StopInternalThread();
+}
+
+void SnapshotWriter::Begin() {
+  CHECK(staged_ == NULL) << "Snapshot already begun";
+  staged_ = free_.pop("Waiting for an earlier snapshot to be written");
+}
+
+void SnapshotWriter::Add(shared_ptr<Message> proto, const string& filename) {
+  CHECK(staged_) << "Begin the snapshot first";
+  staged_->push_back(make_pair(proto, filename));
+}
+
+void SnapshotWriter::Commit() {
+  CHECK(staged_) << "Begin the snapshot first";
+  full_.push(staged_);
+  staged_ = NULL;
+}
+
+void SnapshotWriter::Flush() {
+  // Every snapshot is back once all of them have been written
+  vector<Snapshot*> snapshots;
+  for (int i = 0; i < max_in_flight_; ++i) {
+    snapshots.push_back(free_.pop());
+  }
+  for (int i = 0; i < snapshots.size(); ++i) {
+    free_.push(snapshots[i]);
+  }
+}
+
+void SnapshotWriter::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      Snapshot* snapshot = full_.pop();
+      for (int i = 0; i < snapshot->size(); ++i) {
+        WriteProtoToBinaryFileAtomic(*(*snapshot)[i].first,
+            (*snapshot)[i].second);
+        LOG(INFO) << "Wrote snapshot file " << (*snapshot)[i].second;
+      }
+      // Free the staged copies before the solver stages the next ones
+      snapshot->clear();
+      free_.push(snapshot);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+}  // namespace caffe
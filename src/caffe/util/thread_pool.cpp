@@ -0,0 +1,147 @@
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <deque>
+
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+namespace {
+
+// One ParallelFor call; lives on the caller's stack until pending hits 0.
+struct Job {
+  const ThreadPool::RangeFunction* fn;
+  int pending;
+};
+
+struct Task {
+  Job* job;
+  int begin;
+  int end;
+};
+
+}  // namespace
+
+class ThreadPool::sync {
+ public:
+  sync() : stop_(false) {}
+
+  // Pops a queued chunk, runs it unlocked and accounts for it. The lock
+  // must be held on entry and is held again on return.
+  void RunOne(boost::mutex::scoped_lock* lock) {
+    Task task = tasks_.front();
+    tasks_.pop_front();
+    lock->unlock();
+    (*task.job->fn)(task.begin, task.end);
+    lock->lock();
+    if (--task.job->pending == 0) {
+      done_.notify_all();
+    }
+  }
+
+  boost::mutex mutex_;
+  boost::condition_variable work_;
+  boost::condition_variable done_;
+  std::deque<Task> tasks_;
+  bool stop_;
+};
+
+ThreadPool::ThreadPool(int num_threads)
+    : num_threads_(std::max(num_threads, 1)), sync_(new sync()) {
+  for (int i = 1; i < num_threads_; ++i) {
+    try {
+      threads_.push_back(shared_ptr<boost::thread>(
+          new boost::thread(&ThreadPool::WorkerEntry, this)));
+    } catch (std::exception& e) {
+      LOG(FATAL) << "Thread exception: " << e.what();
+    }
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    sync_->stop_ = true;
+  }
+  sync_->work_.notify_all();
+  for (int i = 0; i < threads_.size(); ++i) {
+    threads_[i]->join();
+  }
+}
+
+void ThreadPool::WorkerEntry() {
+  boost::this_thread::disable_interruption no_interrupt;
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (true) {
+    while (!sync_->stop_ && sync_->tasks_.empty()) {
+      sync_->work_.wait(lock);
+    }
+    if (sync_->tasks_.empty()) {
+      return;
+    }
+    sync_->RunOne(&lock);
+  }
+}
+
+void ThreadPool::ParallelFor(int n, const RangeFunction& fn, int num_chunks) {
+  if (num_chunks <= 0) {
+    num_chunks = num_threads_;
+  }
+  num_chunks = std::min(num_chunks, n);
+  if (num_chunks <= 1 || num_threads_ == 1) {
+    if (n > 0) {
+      fn(0, n);
+    }
+    return;
+  }
+  // The job lives on this stack frame, so an interrupted prefetch thread
+  // must not unwind out of here while workers still reference it.
+  boost::this_thread::disable_interruption no_interrupt;
+  Job job;
+  job.fn = &fn;
+  job.pending = num_chunks;
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  for (int i = 1; i < num_chunks; ++i) {
+    Task task;
+    task.job = &job;
+    task.begin = static_cast<int64_t>(n) * i / num_chunks;
+    task.end = static_cast<int64_t>(n) * (i + 1) / num_chunks;
+    sync_->tasks_.push_back(task);
+  }
+  lock.unlock();
+  sync_->work_.notify_all();
+  fn(0, n / num_chunks);
+  lock.lock();
+  --job.pending;
+  while (job.pending > 0) {
+    if (!sync_->tasks_.empty()) {
+      sync_->RunOne(&lock);
+    } else {
+      sync_->done_.wait(lock);
+    }
+  }
+}
+
+static boost::mutex global_pool_mutex_;
+static shared_ptr<ThreadPool> global_pool_;
+
+ThreadPool& ThreadPool::Global() {
+  boost::mutex::scoped_lock lock(global_pool_mutex_);
+  if (!global_pool_) {
+    global_pool_.reset(
+        new ThreadPool(boost::thread::hardware_concurrency()));
+  }
+  return *global_pool_;
+}
+
+void ThreadPool::SetGlobalThreads(int num_threads) {
+  boost::mutex::scoped_lock lock(global_pool_mutex_);
+  if (global_pool_ && global_pool_->num_threads() == num_threads) {
+    return;
+  }
+  global_pool_.reset();
+  global_pool_.reset(new ThreadPool(num_threads));
+}
+
+}  // namespace caffe
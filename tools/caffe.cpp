@@ -14,6 +14,7 @@ namespace bp = boost::python;
 #include "boost/algorithm/string.hpp"
 #include "caffe/caffe.hpp"
 #include "caffe/util/signal_handler.h"
+#include "caffe/util/thread_pool.hpp"
 
 using caffe::Blob;
 using caffe::Caffe;
@@ -47,6 +48,16 @@ DEFINE_string(sigint_effect, "stop",
 DEFINE_string(sighup_effect, "snapshot",
              "Optional; action to take when a SIGHUP signal is received: "
              "snapshot, stop or none.");
+DEFINE_string(profile, "",
+    "Optional; profile the layers of the training net, log their average "
+    "times and write the trace of every layer call to the given file, "
+    "to load in chrome://tracing.");
+DEFINE_int32(cpu_threads, 0,
+    "Optional; the number of threads used by the multithreaded CPU layers. "
+    "Defaults to the number of hardware threads.");
+DEFINE_int32(cpu_solvers, 1,
+    "Optional; in CPU mode, train with as many solvers in parallel threads. "
+    "The effective training batch size is multiplied by it.");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -174,9 +185,13 @@ int train() {
 
   vector<int> gpus;
   get_gpus(&gpus);
+  CHECK_GE(FLAGS_cpu_solvers, 1);
+  CHECK(gpus.size() == 0 || FLAGS_cpu_solvers == 1)
+      << "cpu_solvers only applies to CPU mode.";
   if (gpus.size() == 0) {
     LOG(INFO) << "Use CPU.";
     Caffe::set_mode(Caffe::CPU);
+    Caffe::set_solver_count(FLAGS_cpu_solvers);
   } else {
     ostringstream s;
     for (int i = 0; i < gpus.size(); ++i) {
@@ -211,15 +226,28 @@ int train() {
   } else if (FLAGS_weights.size()) {
     CopyLayers(solver.get(), FLAGS_weights);
   }
+  if (FLAGS_profile.size()) {
+    solver->net()->set_profile(true);
+  }
 
   if (gpus.size() > 1) {
     caffe::P2PSync<float> sync(solver, NULL, solver->param());
     sync.Run(gpus);
+  } else if (FLAGS_cpu_solvers > 1) {
+    caffe::CPUSync<float> sync(solver, NULL, solver->param(), 0);
+    sync.Run(FLAGS_cpu_solvers);
   } else {
     LOG(INFO) << "Starting Optimization";
     solver->Solve();
   }
   LOG(INFO) << "Optimization Done.";
+  if (FLAGS_profile.size()) {
+    solver->net()->LogProfile();
+    solver->net()->WriteChromeTrace(FLAGS_profile);
+  }
+  if (solver->net()->trace_transfers()) {
+    solver->net()->LogTransfers();
+  }
   return 0;
 }
 RegisterBrewFunction(train);
@@ -401,6 +429,9 @@ int main(int argc, char** argv) {
       "  time            benchmark model execution time");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
+  if (FLAGS_cpu_threads > 0) {
+    caffe::ThreadPool::SetGlobalThreads(FLAGS_cpu_threads);
+  }
   if (argc == 2) {
 #ifdef WITH_PYTHON_LAYER
     try {
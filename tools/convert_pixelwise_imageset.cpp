@@ -0,0 +1,130 @@
+// This program packs images and their dense float labels (e.g. surface
+// normals) into a lmdb/leveldb, one Datum per pair, to be read by the
+// PixelWiseDBData layer.
+// Usage:
+//   convert_pixelwise_imageset [FLAGS] ROOTFOLDER/ LISTFILE DB_NAME
+//
+// where ROOTFOLDER is the root folder that holds all the images and labels,
+// and LISTFILE should be a list of image files and their raw float label
+// files, as read by the PixelWiseData layer, in the format as
+//   subfolder1/file1.png subfolder1/file1.bin
+//   ....
+
+#include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "boost/scoped_ptr.hpp"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/db.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/rng.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+using std::pair;
+using boost::scoped_ptr;
+
+DEFINE_bool(gray, false,
+    "When this option is on, treat images as grayscale ones");
+DEFINE_bool(shuffle, false,
+    "Randomly shuffle the order of the pairs");
+DEFINE_string(backend, "lmdb",
+        "The backend {lmdb, leveldb} for storing the result");
+DEFINE_int32(resize_width, 0, "Width images and labels are resized to");
+DEFINE_int32(resize_height, 0, "Height images and labels are resized to");
+DEFINE_int32(label_channel, 3, "Number of channels of the labels");
+DEFINE_string(encode_type, "",
+    "Optional: What type should we encode converted images as "
+    "('png','jpg',...). Unconverted images keep their file encoding.");
+
+int main(int argc, char** argv) {
+#ifdef USE_OPENCV
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Pack images and their dense labels into the\n"
+        "leveldb/lmdb format read by the PixelWiseDBData layer.\n"
+        "Usage:\n"
+        "    convert_pixelwise_imageset [FLAGS] ROOTFOLDER/ LISTFILE DB_NAME\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc < 4) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0],
+        "tools/convert_pixelwise_imageset");
+    return 1;
+  }
+
+  const bool is_color = !FLAGS_gray;
+  const string encode_type = FLAGS_encode_type;
+
+  std::ifstream infile(argv[2]);
+  std::vector<std::pair<std::string, std::string> > lines;
+  std::string line;
+  size_t pos;
+  while (std::getline(infile, line)) {
+    pos = line.find_last_of(' ');
+    lines.push_back(std::make_pair(line.substr(0, pos), line.substr(pos + 1)));
+  }
+  if (FLAGS_shuffle) {
+    // randomly shuffle data
+    LOG(INFO) << "Shuffling data";
+    shuffle(lines.begin(), lines.end());
+  }
+  LOG(INFO) << "A total of " << lines.size() << " pairs.";
+
+  int resize_height = std::max<int>(0, FLAGS_resize_height);
+  int resize_width = std::max<int>(0, FLAGS_resize_width);
+
+  // Create new DB
+  scoped_ptr<db::DB> db(db::GetDB(FLAGS_backend));
+  db->Open(argv[3], db::NEW);
+  scoped_ptr<db::Transaction> txn(db->NewTransaction());
+
+  // Storing to db
+  std::string root_folder(argv[1]);
+  Datum datum;
+  int count = 0;
+
+  for (int line_id = 0; line_id < lines.size(); ++line_id) {
+    if (!ReadPixelWiseToDatum(root_folder + lines[line_id].first,
+        root_folder + lines[line_id].second, FLAGS_label_channel,
+        resize_height, resize_width, is_color, encode_type, &datum)) {
+      LOG(WARNING) << "Skipping " << lines[line_id].first;
+      continue;
+    }
+    // sequential
+    string key_str = caffe::format_int(line_id, 8) + "_" + lines[line_id].first;
+
+    // Put in db
+    string out;
+    CHECK(datum.SerializeToString(&out));
+    txn->Put(key_str, out);
+
+    if (++count % 1000 == 0) {
+      // Commit db
+      txn->Commit();
+      txn.reset(db->NewTransaction());
+      LOG(INFO) << "Processed " << count << " files.";
+    }
+  }
+  // write the last batch
+  if (count % 1000 != 0) {
+    txn->Commit();
+    LOG(INFO) << "Processed " << count << " files.";
+  }
+#else
+  LOG(FATAL) << "This tool requires OpenCV; compile with USE_OPENCV.";
+#endif  // USE_OPENCV
+  return 0;
+}
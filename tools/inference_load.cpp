@@ -0,0 +1,113 @@
+// This program drives an InferenceEngine with a number of concurrent clients
+// and reports the latency percentiles and the throughput.
+// Usage:
+//   inference_load [FLAGS] DEPLOY_PROTOTXT [WEIGHTS]
+//
+// where every client sends a fixed random sample to the engine, waits for
+// the answer and sends it again, -requests times.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "boost/thread.hpp"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/common.hpp"
+#include "caffe/inference_engine.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_int32(gpu, -1,
+    "Optional; run in GPU mode on the given device ID.");
+DEFINE_int32(contexts, 2,
+    "The number of forward contexts, each a net sharing the weights.");
+DEFINE_int32(max_batch, 8,
+    "The largest batch a context runs.");
+DEFINE_int32(max_latency_us, 2000,
+    "How long a sample may wait for its batch to fill up.");
+DEFINE_int32(clients, 8,
+    "The number of concurrent client threads.");
+DEFINE_int32(requests, 100,
+    "The number of requests of every client.");
+
+static void Client(InferenceEngine<float>* engine, const vector<float>* input,
+    vector<float>* latencies) {
+  vector<float> output;
+  CPUTimer timer;
+  for (int i = 0; i < FLAGS_requests; ++i) {
+    timer.Start();
+    engine->Infer(&(*input)[0], &output);
+    latencies->push_back(timer.MilliSeconds());
+  }
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Measure the latency and throughput of the\n"
+        "batched inference engine under concurrent load.\n"
+        "Usage:\n"
+        "    inference_load [FLAGS] DEPLOY_PROTOTXT [WEIGHTS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc < 2) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/inference_load");
+    return 1;
+  }
+  if (FLAGS_gpu >= 0) {
+    Caffe::SetDevice(FLAGS_gpu);
+    Caffe::set_mode(Caffe::GPU);
+  } else {
+    Caffe::set_mode(Caffe::CPU);
+  }
+  NetParameter param;
+  ReadNetParamsFromTextFileOrDie(argv[1], &param);
+  InferenceEngine<float> engine(param, argc > 2 ? argv[2] : "",
+      FLAGS_contexts, FLAGS_max_batch, FLAGS_max_latency_us);
+
+  vector<vector<float> > inputs(FLAGS_clients,
+      vector<float>(engine.input_count()));
+  vector<vector<float> > latencies(FLAGS_clients);
+  vector<shared_ptr<boost::thread> > threads;
+  for (int c = 0; c < FLAGS_clients; ++c) {
+    caffe_rng_gaussian<float>(inputs[c].size(), 0, 1, &inputs[c][0]);
+  }
+  CPUTimer timer;
+  timer.Start();
+  for (int c = 0; c < FLAGS_clients; ++c) {
+    threads.push_back(shared_ptr<boost::thread>(new boost::thread(
+        &Client, &engine, &inputs[c], &latencies[c])));
+  }
+  for (int c = 0; c < FLAGS_clients; ++c) {
+    threads[c]->join();
+  }
+  const float seconds = timer.MilliSeconds() / 1000;
+
+  vector<float> all;
+  for (int c = 0; c < FLAGS_clients; ++c) {
+    all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+  }
+  std::sort(all.begin(), all.end());
+  const int n = all.size();
+  CHECK_GT(n, 0) << "No requests were sent.";
+  LOG(INFO) << n << " requests from " << FLAGS_clients << " clients in "
+      << seconds << " s: " << n / seconds << " samples/s";
+  LOG(INFO) << "Latency p50: " << all[n / 2] << " ms, p99: "
+      << all[std::min(n - 1, n * 99 / 100)] << " ms, max: " << all[n - 1]
+      << " ms";
+  LOG(INFO) << "Average batch: "
+      << static_cast<float>(engine.samples()) / engine.batches()
+      << " samples";
+  return 0;
+}